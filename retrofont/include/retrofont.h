@@ -21,17 +21,46 @@ extern "C" {
 #define RF_EXTRACT_ID(id,letter) (((id) >> ((letter) * 8)) & 0xFF)
 
 // glyph lookup cache configuration
-#define RF_GLYPH_CACHE_MIN  32  //!< first codepoint to cache
-#define RF_GLYPH_CACHE_MAX 255  //!< last codepoint to cache
-#define RF_GLYPH_CACHE_SIZE (RF_GLYPH_CACHE_MAX - RF_GLYPH_CACHE_MIN + 1)  //!< size of the glyph case
+#define RF_GLYPH_CACHE_BITS   10  //!< log2 of the number of glyph cache slots
+#define RF_GLYPH_CACHE_SIZE (1 << (RF_GLYPH_CACHE_BITS))  //!< size of the glyph cache
+#define RF_GLYPH_CACHE_PROBES  8  //!< maximum number of slots to probe in the glyph cache
+
+// glyph lookup table layout (must match util/font_import.py)
+#define RF_GLYPH_PAGE_BITS  6  //!< log2 of the number of codepoints per glyph page
+#define RF_GLYPH_BLOCK_BITS 6  //!< log2 of the number of pages per glyph block
+#define RF_GLYPH_MISSING       0xFFFFFFFFu  //!< glyph page entry for codepoints without a glyph
+#define RF_GLYPH_FROM_FALLBACK 0x80000000u  //!< glyph page entry flag: glyph comes from another font of the same size
 
 // palette cache configuration
-#define RF_PAL_CACHE_BITS 4  //!< bits per component to reduce color prior to palette lookup
-#define RF_PAL_CACHE_SIZE (1 << ((RF_PAL_CACHE_BITS) * 3))  //!< size of the palette cache
+#define RF_PAL_LUT_BITS   5  //!< bits per component to reduce color prior to palette lookup
+
+// tile cache configuration
+#define RF_TILE_KEY_WORDS  8  //!< number of 32-bit words in a tile cache key
+#define RF_TILE_LOG_SIZE 256  //!< number of tile cache lookups recorded per band in parallel rendering
+
+// cell color memo configuration
+#define RF_COLOR_MEMO_BITS 6  //!< log2 of the number of resolved cell color memo slots
+#define RF_COLOR_MEMO_SIZE (1 << (RF_COLOR_MEMO_BITS))  //!< size of the resolved cell color memo
+
+// indexed output palette configuration
+#define RF_MAX_PALETTE_SIZE 256  //!< maximum number of entries in an RF_PF_INDEXED8 palette
+#define RF_PAL_HASH_SIZE    512  //!< size of the RGB-to-index hash table (must be a power of two)
+#define RF_MAX_PENDING_MOVES 16  //!< maximum number of bitmap moves queued between two RF_Render() calls
+
+// character set detector configuration
+#define RF_DETECT_RUN_EVIDENCE     20  //!< run length of a pseudographics character that decides the character set
+#define RF_DETECT_UTF8_EVIDENCE    32  //!< number of valid multi-byte UTF-8 sequences that decide for UTF-8
+#define RF_DETECT_SAMPLE_PREFIX 65536  //!< number of bytes that are always analyzed in sampling mode
+#define RF_DETECT_SAMPLE_BLOCK   4096  //!< size of the blocks that are analyzed or skipped in sampling mode
+#define RF_DETECT_DECIDE_BLOCK   4096  //!< interval (in bytes) at which the detector checks whether the evidence is decisive
 
 // forward definitions of structures
 typedef struct s_RF_Coord          RF_Coord;
+typedef struct s_RF_Rect           RF_Rect;
+typedef struct s_RF_BitmapMove     RF_BitmapMove;
+typedef struct s_RF_ColorMemo      RF_ColorMemo;
 typedef struct s_RF_Cell           RF_Cell;
+typedef struct s_RF_CompactCell    RF_CompactCell;
 typedef struct s_RF_RenderCommand  RF_RenderCommand;
 typedef struct s_RF_SysClass       RF_SysClass;
 typedef struct s_RF_System         RF_System;
@@ -39,6 +68,7 @@ typedef struct s_RF_Font           RF_Font;
 typedef struct s_RF_GlyphMapEntry  RF_GlyphMapEntry;
 typedef struct s_RF_FallbackGlyphs RF_FallbackGlyphs;
 typedef struct s_RF_Charset        RF_Charset;
+typedef struct s_RF_Detector       RF_Detector;
 typedef struct s_RF_Context        RF_Context;
 
 // color-related constants and macros
@@ -77,6 +107,25 @@ typedef enum e_RF_FallbackMode {
     RF_FB_FONT_CHAR,  //!< allow both types of fallback, but prefer font fallback
 } RF_FallbackMode;
 
+//! glyph rasterization kernels
+typedef enum e_RF_RasterKernel {
+    RF_RK_AUTO = 0,  //!< automatically select the fastest kernel supported by the CPU
+    RF_RK_SCALAR,    //!< portable per-pixel reference implementation
+    RF_RK_SSE2,      //!< SSE2 kernel (x86 only; 8 pixels per step)
+    RF_RK_AVX2,      //!< AVX2 kernel (x86 only; 16 pixels per step)
+} RF_RasterKernel;
+
+//! bitmap pixel formats
+typedef enum e_RF_PixelFormat {
+    RF_PF_RGB888 = 0,  //!< 3 bytes per pixel: R, G, B (default)
+    RF_PF_RGBA8888,    //!< 4 bytes per pixel: R, G, B, A (alpha is always 255)
+    RF_PF_BGRA8888,    //!< 4 bytes per pixel: B, G, R, A (alpha is always 255)
+    RF_PF_XRGB8888,    //!< native-endian 32-bit words 0x00RRGGBB
+    RF_PF_RGB565,      //!< native-endian 16-bit words, red in the upper bits
+    RF_PF_INDEXED8,    //!< 1 byte per pixel: index into the context's palette
+   _RF_PF_COUNT        //!< number of defined pixel formats
+} RF_PixelFormat;
+
 //! text markup types
 typedef enum e_RF_MarkupType {
     RF_MT_NONE     = 0x99,  //!< no markup (plain text)
@@ -100,21 +149,74 @@ typedef enum e_RF_MonitorType {
    _RF_MONITOR_COUNT       //!< number of defined monitor types
 } RF_MonitorType;
 
+//! classes of markup that the parsers skipped because they don't support it
+typedef enum e_RF_Diagnostic {
+    RF_DIAG_ANSI_SGR = 0,  //!< unsupported ANSI SGR (attribute / color) code
+    RF_DIAG_ANSI_CSI,      //!< unsupported ANSI CSI sequence
+    RF_DIAG_ANSI_PRIVATE,  //!< ANSI CSI sequence with a private marker (e.g. DEC modes)
+    RF_DIAG_ANSI_ESC,      //!< unsupported ANSI ESC sequence (e.g. character set designation)
+    RF_DIAG_ANSI_STRING,   //!< ANSI control string (OSC, DCS, SOS, PM, APC)
+    RF_DIAG_INTERNAL,      //!< invalid internal markup sequence
+   _RF_DIAG_COUNT          //!< number of defined diagnostic classes
+} RF_Diagnostic;
+
 // misc other constants
 #define RF_SIZE_DEFAULT ((uint16_t)(-1))       //!< system default size for RF_ResizeScreen()
 #define RF_SIZE_PIXELS  0x8000u                //!< system's default_screen_size is in pixels
 #define RF_SIZE_MASK    (RF_SIZE_PIXELS - 1u)  //!< mask to remove RF_SIZE_PIXELS flag
 #define RF_CHARSET_AUTO ((uint32_t)(-1))       //!< automatic character set detection
+#define RF_THREADS_AUTO 0                      //!< one render thread per CPU core for RF_SetRenderThreads()
+#define RF_SCREEN_CMD(letter) (0x80000000u | (uint32_t)(letter))  //!< internal markup command in a precompiled default screen
+
+//! job function for RF_ParallelFor: process item 'index' of 'job'
+typedef void (*RF_JobFunc) (void* job, int index);
+
+//! application-supplied parallel-for implementation:
+//! must call func(job, i) for all 0 <= i < count, in any order and on any
+//! thread(s), and return only after all of these calls have finished
+typedef void (*RF_ParallelFor) (void* user, RF_JobFunc func, void* job, int count);
+
+//! diagnostics callback, see RF_SetDiagnosticCallback()
+//! \param text   description of the offending sequence, e.g. "ESC [ ? 25 l"
+//! \param count  number of occurrences of this diagnostic class so far
+typedef void (*RF_DiagnosticFunc) (void* user, RF_Diagnostic diag, const char* text, uint32_t count);
 
 //! 2D point coordinate
 struct s_RF_Coord {
     uint16_t x, y;
 };
 
+//! 2D rectangle (in pixels)
+struct s_RF_Rect {
+    RF_Coord ul;  //!< upper-left corner (inclusive)
+    RF_Coord lr;  //!< lower-right corner (exclusive)
+};
+
+//! \private move of already rendered cells inside the bitmap, to be done by RF_Render()
+struct s_RF_BitmapMove {
+    RF_Rect area;     //!< source area, or the whole scrolled region if 'scroll' is set (in cells)
+    int16_t dx, dy;   //!< offset to move by (in cells)
+    bool scroll;      //!< true: content that's moved out of 'area' is discarded
+};
+
+//! \private memoized result of a system's map_cell_colors() method
+struct s_RF_ColorMemo {
+    uint32_t fg_in, bg_in;  //!< input colors (after substitution of the context's default colors)
+    uint32_t fg, bg;        //!< resolved RGB colors
+    uint8_t attribs;        //!< input cell attributes (0xFF = empty slot)
+};
+
+//! \private glyph rasterization kernel, as used by RF_Render() (see rfraster.c):
+//! expands one bit mask per glyph row into pixels of 1 to 4 bytes each
+typedef void (*RF_RasterFunc) (uint8_t* pixel, size_t stride, const uint32_t* masks, uint16_t rows, uint16_t width, uint32_t fg, uint32_t bg);
+
 //! single text screen cell
+//! \note API change: earlier versions had a 'dirty' flag in each cell that
+//!       had to be set after modifying cells in ctx->screen directly; this
+//!       has been removed in favor of RF_InvalidateRegionAB() and
+//!       RF_InvalidateRegionPS(), so code that sets it no longer compiles.
 struct s_RF_Cell {
     uint32_t codepoint;    //!< unicode codepoint of glyph to render
-    uint32_t dirty:1;      //!< "needs update" flag
     uint32_t bold:1;       //!< bold attribute flag
     uint32_t dim:1;        //!< dim attribute flag
     uint32_t underline:1;  //!< underline attribute flag
@@ -125,6 +227,12 @@ struct s_RF_Cell {
     uint32_t bg;           //!< background color (0xRRGGBB or RF_COLOR_*)
 };
 
+//! single text screen cell in the compact screen layout (see RF_SetCompactScreen())
+struct s_RF_CompactCell {
+    uint32_t codepoint;    //!< unicode codepoint of glyph to render
+    uint32_t attr;         //!< index into the context's attribute table
+};
+
 //! command structure used in the render_cell system class method
 struct s_RF_RenderCommand {
     // these fields are inputs to the render_cell() class method
@@ -166,6 +274,29 @@ struct s_RF_RenderCommand {
 //!       reverse_* and underline flags!
 void RF_RenderCell(RF_RenderCommand* cmd);
 
+//! convert an RGB color into a pixel value for the context's pixel format
+//! \note For the 16- and 32-bit formats, the pixel value can be stored by
+//!       copying the first bytes_per_pixel bytes of the uint32_t;
+//!       for RGB888, it's just the RGB color. In RF_PF_INDEXED8 mode,
+//!       this allocates a palette entry if the color isn't used yet.
+uint32_t RF_MapRGBToPixel(RF_Context* ctx, uint32_t color);
+
+//! fill a horizontal run of pixels in the context's pixel format
+//! (for use by the render_cell class method)
+void RF_FillPixels(RF_Context* ctx, uint8_t* pixel, uint32_t color, uint16_t count);
+
+//! invert the colors of a horizontal run of pixels, leaving alpha alone
+//! (for use by the render_cell class method)
+void RF_InvertPixels(RF_Context* ctx, uint8_t* pixel, uint16_t count);
+
+//! select the glyph rasterization kernel used by RF_RenderCell()
+//! \note This is a global setting that affects all contexts. All kernels
+//!       produce the same output; this is mainly useful for testing.
+//!       It must not be called while another thread is rendering.
+//! \returns the kernel that is actually used (if the CPU doesn't support the
+//!          requested kernel, the next best one will be used instead)
+RF_RasterKernel RF_SetRasterKernel(RF_RasterKernel kernel);
+
 //! method table for a system class
 struct s_RF_SysClass {
     //! map a border color to RGB
@@ -196,6 +327,30 @@ struct s_RF_SysClass {
     //! to the built-in RF_System::font_size filter.
     //! \note This can be NULL; in that case, every font will be accepted.
     bool (*check_font) (uint32_t sys_id, const RF_Font* font);
+
+    //! resolve a cell's colors to RGB.
+    //! By providing this method, a system declares that its cell color
+    //! mapping is a pure function of cmd->fg, cmd->bg, the cell's attribute
+    //! flags, the system and the context's default colors -- in particular,
+    //! it must not depend on the codepoint, cursor or blink phase.
+    //! The results are memoized per context, so this is only called for
+    //! color/attribute combinations that haven't been seen before;
+    //! prepare_cell() and render_cell() then receive the resolved colors.
+    //! \note This can be NULL; in that case, prepare_cell() or render_cell()
+    //!       resolve the colors for every cell.
+    //! \note Only the fg and bg members of 'cmd' may be modified.
+    void (*map_cell_colors) (RF_RenderCommand* cmd);
+
+    //! whether the output of render_cell() may be kept in the tile cache.
+    //! By setting this, a system declares that the pixels render_cell()
+    //! produces only depend on the render command as it is passed in
+    //! (glyph, codepoint, colors and rendering flags), the cell's attribute
+    //! flags, is_cursor, ctx->insert and the system and font; blink_phase
+    //! may only be evaluated for blinking cells and the cursor, and only
+    //! its lowest bit.
+    //! \note This is ignored if render_cell() is NULL; RF_RenderCell()
+    //!       output is always cacheable.
+    bool render_cell_cacheable;
 };
 
 //! single entry of a codepoint-to-glyph map
@@ -237,6 +392,11 @@ struct s_RF_Font {
     uint32_t glyph_count;               //!< number of codepoints in the glyph map
     uint32_t fallback_offset;           //!< bitmap offset of the fallback glyph
     uint16_t underline_row;             //!< row where underlining shall be done; 0 = no underline support
+    const uint16_t *block_map;          //!< glyph lookup table: maps codepoint>>(RF_GLYPH_PAGE_BITS+RF_GLYPH_BLOCK_BITS)
+                                        //!< to blocks in RF_GlyphBlocks; glyphs from fallback fonts of the same size
+                                        //!< are already merged in (marked with RF_GLYPH_FROM_FALLBACK)
+                                        //!< \note can be NULL; glyph_map is used then
+    uint16_t block_count;               //!< number of entries in block_map
 };
 
 //! character set registry item
@@ -254,27 +414,69 @@ struct s_RF_Charset {
                                   //!< can be NULL
 };
 
+//! incremental character set and markup type detector, see RF_InitDetector()
+struct s_RF_Detector {
+    const RF_Charset* charset;  //!< detected character set (NULL = not decided yet)
+    RF_MarkupType markup;       //!< detected markup type (RF_MT_AUTO = not decided yet)
+    size_t offset;              //!< number of bytes fed into the detector so far
+    size_t analyzed;            //!< number of bytes that have actually been analyzed
+//private:
+    uint32_t sample_rate;      //!< \private analyze only every n-th block after the prefix (<= 1 = everything)
+    size_t scan_budget;        //!< \private maximum number of bytes to analyze (0 = unlimited)
+    bool internal_valid;       //!< \private every backtick so far was followed by a valid internal markup command
+    bool skip_ascii;           //!< \private no character set has 7-bit run_chars or common_chars, so plain 7-bit text can be skipped
+    uint32_t hist[256];        //!< \private histogram of byte values (except plain 7-bit text if skip_ascii is set)
+    uint32_t max_run[256];     //!< \private longest run of each byte value
+    uint32_t run;              //!< \private length of the current run
+    uint8_t prev;              //!< \private previous byte (i.e. the byte that is currently repeated)
+    bool utf8_valid;           //!< \private everything analyzed so far has been valid UTF-8
+    uint8_t utf8_pending;      //!< \private number of continuation bytes the next chunk must start with
+    uint8_t utf8_skip;         //!< \private number of continuation bytes that may be skipped after a sampling gap
+};
+
 //! fallback registry item
 struct s_RF_FallbackGlyphs {
     RF_Coord font_size;                 //!< font size in pixels (zero width = end of list)
     const RF_GlyphMapEntry *glyph_map;  //!< codepoint-to-gylph map
                                         //!< \note MUST be sorted by codepoint!
     uint32_t glyph_count;               //!< number of codepoints in the glyph map
+    const uint16_t *block_map;          //!< glyph lookup table (see RF_Font::block_map); can be NULL
+    uint16_t block_count;               //!< number of entries in block_map
 };
 
 //! RetroFont instance.
-//! In general, all non-private members are free to access, but read-only,
-//! except screen, which is read-write.
+//! In general, all non-private members are free to access, but read-only.
+//! Cells are best accessed with RF_ReadCell() and RF_WriteCell(); the cells
+//! in screen may be modified directly (see RF_GetCell()), but they are
+//! stored in row_map order, and screen is NULL in the compact layout.
 struct s_RF_Context {
     RF_Cell *screen;            //!< screen contents (character cells)
-                                //!< \note When changing any cell here,
-                                //!<       make sure to set its dirty attribute!
+                                //!< \note When changing any cell here, make sure to
+                                //!<       call RF_InvalidateRegionAB() (or RF_Invalidate())!
+                                //!< \note This is NULL if the compact screen layout is used;
+                                //!<       RF_ReadCell() and RF_WriteCell() work in both layouts.
+                                //!< \note Rows are not stored in screen order; see row_map.
+    RF_CompactCell *compact_screen;  //!< screen contents in the compact layout (NULL if not used)
+    uint16_t *row_map;          //!< storage row of each screen row, i.e. screen row y starts at
+                                //!< screen[row_map[y] * screen_size.x] (or compact_screen[...]);
+                                //!< scrolling full-width regions only rotates these entries
     RF_Coord screen_size;       //!< size of the screen (in character cells)
     const RF_System *system;    //!< currently selected system
     const RF_Font *font;        //!< currently selected font
     RF_FallbackMode fallback;   //!< what to do with invalid glyphs
-    uint8_t *bitmap;            //!< rendered bitmap, top-down, RGB888 format
-    size_t stride;              //!< distance between rows (always bitmap_size.x * 3)
+    uint8_t *bitmap;            //!< rendered bitmap, top-down, in the selected pixel format
+    size_t stride;              //!< distance between rows in bytes
+                                //!< (bitmap_size.x * bytes_per_pixel, plus padding if requested)
+    RF_PixelFormat format;      //!< pixel format of the bitmap
+    uint8_t bytes_per_pixel;    //!< size of a pixel in the bitmap, in bytes
+    uint32_t palette[RF_MAX_PALETTE_SIZE];  //!< RGB colors used in the bitmap (RF_PF_INDEXED8 only)
+    uint16_t palette_size;                  //!< number of valid palette entries (RF_PF_INDEXED8 only)
+                                            //!< \note Palette entries are assigned as colors are
+                                            //!<       rendered and never change until the next
+                                            //!<       RF_ResizeScreenEx() call; new entries are
+                                            //!<       only ever appended. If more than
+                                            //!<       RF_MAX_PALETTE_SIZE colors are used, the
+                                            //!<       nearest existing entry is used instead.
     RF_Coord bitmap_size;       //!< size of the bitmap, in pixels
     RF_Coord main_ul;           //!< pixel coordinate of the upper-left corner of the main screen area
     RF_Coord main_lr;           //!< pixel coordinate of the lower-right corner of the main screen area (non inclusive)
@@ -282,6 +484,9 @@ struct s_RF_Context {
     float pixel_aspect;         //!< system's pixel aspect ratio
     uint32_t border_rgb;        //!< border color (translated to RGB by RF_Render)
     RF_Cell attrib;             //!< attribute for next added character
+    uint32_t tile_hits;         //!< number of cells rendered from the tile cache
+    uint32_t tile_misses;       //!< number of cells rendered and added to the tile cache
+    uint32_t diag_counts[_RF_DIAG_COUNT];  //!< number of skipped markup sequences, by RF_Diagnostic class
     bool insert;                //!< false: RF_PutChar overwrites, true: RF_PutChar inserts on current line
 
 //private: // (renderer)
@@ -291,10 +496,64 @@ struct s_RF_Context {
     uint32_t border_color;      //!< \private border color (default / standard / RGB)
     bool border_color_changed;  //!< \private true if the border color changed
     bool has_border;            //!< \private whether the border in included in the bitmap
+    uint16_t stride_align;      //!< \private row alignment in bytes (0 = no padding)
+    bool bitmap_external;       //!< \private whether the bitmap is owned by the caller
+    RF_Coord target_size;       //!< \private size of the caller-owned bitmap, in pixels
     uint8_t last_blink_phase;   //!< \private blink phase of the last RF_Render() call
-    uint32_t glyph_offset_cache[RF_GLYPH_CACHE_SIZE];  //!< \private glyph cache (-1 = uncached)
+    uint32_t *dirty_map;        //!< \private bitmap of cells that need to be redrawn (cell_map_pitch words per row)
+    uint32_t *row_epoch;        //!< \private invalidation epoch each row has last been rendered in;
+                                //!<          rows with an epoch other than dirty_epoch are entirely dirty
+    uint32_t dirty_epoch;       //!< \private current invalidation epoch (incremented by RF_Invalidate())
+    uint32_t *blink_map;        //!< \private bitmap of cells that had the blink attribute when they
+                                //!<          were last rendered (cell_map_pitch words per row)
+    uint16_t *blink_row_count;  //!< \private number of bits set in each row of blink_map
+    RF_Cell *history_rows;      //!< \private screen-wide row buffers for lines from the scrollback buffer
+                                //!<          (one per render band, at least one)
+    int history_row_count;      //!< \private number of rows in history_rows
+    uint16_t cell_map_pitch;    //!< \private number of 32-bit words per row in dirty_map and blink_map
+    RF_BitmapMove pending_moves[RF_MAX_PENDING_MOVES];  //!< \private rendered cells that have been moved by
+                                                        //!<          scrolling or copying since the last RF_Render()
+    uint8_t pending_move_count;                         //!< \private number of valid entries in pending_moves
+    uint32_t glyph_cache_cp[RF_GLYPH_CACHE_SIZE];      //!< \private glyph cache: codepoint (-1 = empty slot)
+    uint32_t glyph_cache_offset[RF_GLYPH_CACHE_SIZE];  //!< \private glyph cache: bitmap offset (including
+                                                       //!<          the fallback glyph for missing codepoints)
     const RF_FallbackGlyphs* fb_glyphs;                //!< \private fallback glyph list (NULL = no fallback)
-    uint8_t pal_cache[RF_PAL_CACHE_SIZE];  //!< \private palette cache (0xFF = uncached)
+    const void* pal_lut;              //!< \private shared lookup table of the last palette used with RF_PaletteLookup()
+    const uint32_t* pal_lut_key;      //!< \private palette that pal_lut belongs to
+    uint32_t pal_lut_size;            //!< \private number of entries in the palette that pal_lut belongs to
+    uint32_t pal_hash_rgb[RF_PAL_HASH_SIZE];   //!< \private RGB color of indexed palette hash entries (-1 = empty)
+    uint8_t pal_hash_index[RF_PAL_HASH_SIZE];  //!< \private palette index of indexed palette hash entries
+    RF_ColorMemo color_memo[RF_COLOR_MEMO_SIZE];  //!< \private memoized results of the system's map_cell_colors()
+    uint32_t color_memo_fg;                       //!< \private default foreground color the memo is valid for
+    uint32_t color_memo_bg;                       //!< \private default background color the memo is valid for
+
+//private: // (parallel renderer)
+    RF_ParallelFor parallel_for;  //!< \private parallel-for implementation (NULL = single-threaded)
+    void* parallel_user;          //!< \private user pointer for parallel_for
+    int parallel_bands;           //!< \private number of horizontal bands to render in parallel
+    void* worker_pool;            //!< \private internal worker pool (NULL = none)
+    void* band_fills;             //!< \private per-band glyph cache and color memo fills for parallel rendering (NULL = not allocated yet)
+    int band_fill_bands;          //!< \private number of bands band_fills has been allocated for
+
+//private: // (screen storage)
+    uint8_t *cells;             //!< \private screen contents, in whichever layout is used
+    uint8_t cell_bytes;         //!< \private size of a cell in bytes (sizeof(RF_Cell) or sizeof(RF_CompactCell))
+    RF_Cell *attr_table;        //!< \private interned attributes for the compact layout (codepoint unused)
+    uint32_t attr_count;        //!< \private number of entries in attr_table
+    uint32_t attr_capacity;     //!< \private allocated number of entries in attr_table
+    uint32_t *attr_hash;        //!< \private attribute hash table (attr_table index + 1, 0 = empty;
+                                //!<          twice as many entries as attr_capacity)
+    uint32_t attr_last;         //!< \private most recently interned attribute
+
+//private: // (tile cache)
+    int tile_cache_size;          //!< \private maximum number of cached tiles (0 = no tile cache)
+    void* tile_cache;             //!< \private tile cache (NULL = not allocated yet)
+    void* tile_log;               //!< \private per-band logs of tile cache lookups for parallel rendering (NULL = not allocated yet)
+    int tile_log_bands;           //!< \private number of bands tile_log has been allocated for
+
+//private: // (scrollback)
+    void* scrollback;           //!< \private scrollback buffer (NULL = no scrollback)
+    uint32_t scrollback_view;   //!< \private number of lines the view is scrolled back (0 = live screen)
 
 //private: // (markup parser)
     uint8_t utf8_cb_count;      //!< \private UTF-8 continuation byte count
@@ -303,8 +562,18 @@ struct s_RF_Context {
     #define RF_MAX_NUMS 16
     uint32_t num[RF_MAX_NUMS];  //!< \private number buffer (e.g. current UTF-8 codepoint, or ESC CSI parameters)
     uint8_t num_idx;            //!< \private index in number buffer
-    uint8_t esc_type;           //!< \private internal escape type enumeration
+    uint8_t esc_type;           //!< \private internal escape type enumeration (ANSI: parser state)
+    uint8_t esc_collect;        //!< \private private marker or last intermediate byte of the current ANSI sequence
     const void* esc_class;      //!< \private pointer to internal escape type descriptor
+    RF_Coord saved_cursor;      //!< \private cursor position saved by ANSI "ESC 7" or "CSI s"
+    RF_Cell saved_attrib;       //!< \private attribute saved by ANSI "ESC 7"
+    uint16_t margin_top;        //!< \private first row of the ANSI scrolling region
+    uint16_t margin_bottom;     //!< \private last row of the ANSI scrolling region, plus one
+                                //!<          (reset to the screen height by RF_ResizeScreen())
+    uint8_t feed_markup;        //!< \private markup type detected by RF_Feed() with RF_MT_AUTO (0 = none yet)
+    RF_DiagnosticFunc diag_func;  //!< \private diagnostics callback (NULL = only count)
+    void* diag_user;              //!< \private user pointer for diag_func
+    uint32_t diag_burst;          //!< \private number of occurrences per class that are always reported
 };
 
 // central registries
@@ -313,6 +582,8 @@ extern const RF_System* const  RF_SystemList[];          //!< system registry
 extern const RF_Font           RF_FontList[];            //!< font registry
 extern const RF_Charset        RF_Charsets[];            //!< character set registry
 extern const uint8_t           RF_GlyphBitmaps[];        //!< \private glyph bitmaps
+extern const uint16_t          RF_GlyphBlocks[];         //!< \private glyph lookup table: page numbers
+extern const uint32_t          RF_GlyphPages[];          //!< \private glyph lookup table: bitmap offsets
 extern const RF_FallbackGlyphs RF_FallbackGlyphsList[];  //!< \private fallback glyph map registry
 extern const RF_GlyphMapEntry  RF_FallbackMap[];         //!< \private fallback character map
 extern const uint32_t          RF_FallbackMapSize;       //!< \private number of entries in RF_FallbackMap
@@ -343,6 +614,27 @@ void RF_SetFallbackMode(RF_Context* ctx, RF_FallbackMode mode);
 //! \note This *MUST* be called after RF_CreateContext/RF_SetSystem and RF_SetFont
 bool RF_ResizeScreen(RF_Context* ctx, uint16_t new_width, uint16_t new_height, bool with_border);
 
+//! resize the screen and select the bitmap format
+//! \param format        pixel format of the bitmap
+//! \param stride_align  alignment of bitmap rows in bytes (must be a power of
+//!                      two; 0 = no padding between rows)
+//! \note RF_ResizeScreen() keeps the format and alignment set here
+bool RF_ResizeScreenEx(RF_Context* ctx, uint16_t new_width, uint16_t new_height, bool with_border, RF_PixelFormat format, uint16_t stride_align);
+
+//! render into a caller-owned bitmap instead of an internally allocated one
+//! (e.g. a mapped pixel buffer, shared memory, or a part of a larger image)
+//! \param bitmap  pointer to the upper-left pixel of the target area
+//!                (NULL = go back to an internally allocated bitmap)
+//! \param stride  distance between rows in bytes
+//! \param width   width  of the target area in pixels (must be >= bitmap_size.x)
+//! \param height  height of the target area in pixels (must be >= bitmap_size.y)
+//! \returns true if successful, false if the target area is too small
+//! \note This must be called after RF_ResizeScreen(Ex), which determines the
+//!       bitmap size and format. Further RF_ResizeScreen(Ex) calls keep
+//!       rendering into the caller's bitmap, but fail if the new bitmap
+//!       wouldn't fit. The caller's bitmap is never freed by the library.
+bool RF_SetTargetBitmap(RF_Context* ctx, uint8_t* bitmap, size_t stride, uint16_t width, uint16_t height);
+
 //! check whether a specific system can use a specific font
 bool RF_SystemCanUseFont(const RF_System* sys, const RF_Font* font);
 //! check whether the current system can use a specific font
@@ -359,6 +651,7 @@ void RF_MoveCursor(RF_Context* ctx, uint16_t new_col, uint16_t new_row);
 #define RF_SetBorderColor(ctx, c)     do { (ctx)->border_color = c; (ctx)->border_color_changed = true; } while(0)
 
 //! clear the screen
+//! This also resets the ANSI scrolling region and saved cursor.
 //! \param cell  cell contents to fill the screen with; NULL = use empty cell
 void RF_ClearScreen(RF_Context* ctx, const RF_Cell* cell);
 //! clear the screen, all attributes and all colors
@@ -371,6 +664,12 @@ void RF_DemoScreen(RF_Context* ctx);
 //! invalidate the whole screen
 void RF_Invalidate(RF_Context* ctx, bool with_border);
 
+//! mark a region of cells as "needs update"
+//! This must be called after modifying cells in ctx->screen directly.
+void RF_InvalidateRegionAB(RF_Context* ctx, int x0, int y0, int x1, int y1);
+//! same as RF_InvalidateRegionAB, but with position+size instead of rectangle
+void RF_InvalidateRegionPS(RF_Context* ctx, int x0, int y0, int w, int h);
+
 //! put a single character on-screen (with the currently selected attribute).
 //! RF_CP_* values are handled specially.
 void RF_AddChar(RF_Context* ctx, uint32_t codepoint);
@@ -379,19 +678,97 @@ void RF_AddChar(RF_Context* ctx, uint32_t codepoint);
 //! \param charset  character set to use (only 'charmap' field will be used); NULL = UTF-8
 void RF_AddText(RF_Context* ctx, const char* str, const RF_Charset* charset, RF_MarkupType mt);
 
+//! add a chunk of a text stream, optionally with markup.
+//! Unlike RF_AddText(), the data doesn't need to be NUL-terminated (NUL bytes
+//! don't end the data; they are ignored, like on a terminal, unless the
+//! character set maps them to a glyph), and UTF-8 and escape sequences
+//! may be split across chunks arbitrarily, so this can be used directly on
+//! buffers returned by read() from pipes, ptys or serial ports.
+//! \param charset  character set to use (only 'charmap' field will be used); NULL = UTF-8
+//! \param mt       markup type; with RF_MT_AUTO, the first markup type that is
+//!                 detected in the stream is used for all following chunks,
+//!                 until RF_ResetParser() is called
+void RF_Feed(RF_Context* ctx, const void* data, size_t len, const RF_Charset* charset, RF_MarkupType mt);
+
+//! clear the screen (like RF_ClearAll) and show the system's default screen.
+//! This has the same result as adding the system's default_screen with
+//! RF_AddText(ctx, ..., NULL, RF_MT_INTERNAL) at the home position, but the
+//! default screens of the built-in systems are parsed at build time already.
+//! \returns false if the system doesn't have a default screen
+//!          (the screen is cleared nevertheless)
+bool RF_LoadDefaultScreen(RF_Context* ctx);
+
 //! heuristically detect character set in a text string; *very* unreliable!
 const RF_Charset* RF_DetectCharset(const char* str);
 
+//! initialize an incremental character set and markup type detector.
+//! Unlike RF_DetectCharset() and RF_DetectMarkupType(), the detector can be
+//! fed a document in chunks, it determines both properties in a single pass,
+//! and it reports each result as soon as the evidence is decisive (a long run
+//! of a pseudographics character, enough valid multi-byte UTF-8 sequences,
+//! or an Escape character). The evidence is checked at fixed offsets (every
+//! RF_DETECT_DECIDE_BLOCK bytes), so the results don't depend on how the
+//! document is split into chunks.
+//! \param sample_rate  sampling mode for large documents: after the first
+//!                     RF_DETECT_SAMPLE_PREFIX bytes, only every n-th block of
+//!                     RF_DETECT_SAMPLE_BLOCK bytes is analyzed (0 or 1 = all)
+//! \param scan_budget  maximum number of bytes to analyze; when it's used up,
+//!                     the detector decides based on what it has seen so far
+//!                     (0 = unlimited)
+void RF_InitDetector(RF_Detector* det, uint32_t sample_rate, size_t scan_budget);
+
+//! feed a chunk of a document into a detector; results that are already
+//! certain are stored in det->charset and det->markup
+//! \returns true if both results are certain, i.e. feeding more data is
+//!          pointless (feeding it anyway doesn't change the results)
+bool RF_FeedDetector(RF_Detector* det, const void* data, size_t len);
+
+//! decide the results that aren't certain yet, after all data has been fed;
+//! they are the same that RF_DetectCharset() and RF_DetectMarkupType() would
+//! have returned for the whole document (or the analyzed parts of it)
+void RF_FinishDetector(RF_Detector* det);
+
 //! heuristically detect markup type in a text string
 RF_MarkupType RF_DetectMarkupType(const char* str);
 
+//! same as RF_DetectMarkupType, but for a buffer that isn't NUL-terminated
+RF_MarkupType RF_DetectMarkupTypeEx(const void* data, size_t len);
+
 //! reset the markup parser
+//! This also resets the ANSI scrolling region and saved cursor.
 void RF_ResetParser(RF_Context* ctx);
 
+//! set up reporting of markup sequences that the parsers skip.
+//! Skipped sequences are always counted in ctx->diag_counts; the callback
+//! additionally gets a description of the first 'burst' occurrences of each
+//! class, and after that, only of the occurrences whose count is a power of
+//! two, so a stream full of unsupported sequences can't flood it.
+//! \param func  callback function (NULL = only count)
+//! \note This also resets the counters.
+void RF_SetDiagnosticCallback(RF_Context* ctx, RF_DiagnosticFunc func, void* user, uint32_t burst);
+
 //! determine the address of a cell
-//! \returns NULL if the cell coordinates are invalid
+//! \returns NULL if the cell coordinates are invalid,
+//!          or if the compact screen layout is used
+//! \note If the cell is modified, RF_InvalidateRegionAB() must be called.
 RF_Cell* RF_GetCell(RF_Context* ctx, int x, int y);
 
+//! read a cell's contents (works in both screen layouts)
+//! \returns false if the cell coordinates are invalid
+bool RF_ReadCell(const RF_Context* ctx, int x, int y, RF_Cell* cell);
+
+//! set a cell's contents and mark it as dirty (works in both screen layouts)
+//! \returns false if the cell coordinates are invalid
+bool RF_WriteCell(RF_Context* ctx, int x, int y, const RF_Cell* cell);
+
+//! switch between the standard and the compact screen layout
+//! In the compact layout, cells are stored as RF_CompactCell (8 bytes instead
+//! of 16), with all attributes and colors stored in a per-context table of
+//! distinct attribute combinations. The screen contents are preserved.
+//! ctx->screen is NULL while the compact layout is used.
+//! \returns false if the layout could not be changed (out of memory)
+bool RF_SetCompactScreen(RF_Context* ctx, bool compact);
+
 //! fill a region with blanks
 //! \param attrib  attribute to use (NULL = use defaults)
 void RF_ClearRegionAB(RF_Context* ctx, int x0, int y0, int x1, int y1, const RF_Cell* attrib);
@@ -411,9 +788,79 @@ void RF_ScrollRegionAB(RF_Context* ctx, int x0, int y0, int x1, int y1, int dx,
 void RF_ScrollRegionPS(RF_Context* ctx, int x0, int y0, int w, int h, int dx, int dy, const RF_Cell* attrib);
 
 //! render the screen (or rather, the "dirty" parts of it)
-//! \returns true if anything changed, false otherwise
+//! \returns true if the bitmap changed, false otherwise
+//!          (i.e. exactly when RF_RenderEx() would report changed rectangles;
+//!          a border color change without a border only updates border_rgb)
 bool RF_Render(RF_Context* ctx, uint32_t time_msec);
 
+//! render the screen and report which parts of the bitmap have changed
+//! \param rects      array that receives the changed rectangles (in pixels);
+//!                   if there are more than max_rects of them, some are merged
+//! \param max_rects  size of the rects array
+//! \returns number of rectangles stored in rects (0 = nothing changed);
+//!          if rects is NULL, 1 is returned if anything changed
+int RF_RenderEx(RF_Context* ctx, uint32_t time_msec, RF_Rect* rects, int max_rects);
+
+//! render using multiple threads from an internal worker pool
+//! The screen is split into horizontal bands that are rendered in parallel;
+//! this is only done if enough cells need to be redrawn, and never in
+//! RF_PF_INDEXED8 mode (because palette allocation is sequential).
+//! \param num_threads  number of threads to use, including the calling thread
+//!                     (1 = single-threaded, which is the default;
+//!                     RF_THREADS_AUTO = one thread per CPU core)
+//! \returns number of threads actually used
+int RF_SetRenderThreads(RF_Context* ctx, int num_threads);
+
+//! set the size of the rendered-cell tile cache
+//! With the tile cache enabled, fully rendered cells are kept in an LRU cache,
+//! keyed by glyph and all rendering attributes, and copied into the bitmap
+//! when the same combination occurs again. The cache statistics in
+//! ctx->tile_hits and ctx->tile_misses can be used to tune the size.
+//! \param tiles  maximum number of cached cells (0 = disable the tile cache,
+//!               which is the default)
+//! \note This also resets the statistics.
+//! \note The tile cache is not used for systems whose render_cell() method
+//!       isn't declared cacheable (see RF_SysClass::render_cell_cacheable).
+//! \note In parallel band rendering, the bands only read from the cache;
+//!       the tiles they rendered are added after all bands are finished.
+void RF_SetTileCacheSize(RF_Context* ctx, int tiles);
+
+//! enable, resize or disable the scrollback buffer
+//! Lines that are scrolled off the top of the screen (by RF_AddChar(), or by
+//! scrolling a full-width region that starts at the top row) are stored in
+//! compressed form. When the memory budget is exhausted, the oldest lines
+//! are discarded.
+//! \param max_bytes  memory budget in bytes (0 = disable the scrollback buffer
+//!                   and discard all stored lines, which is the default)
+//! \returns true if successful
+bool RF_SetScrollback(RF_Context* ctx, size_t max_bytes);
+
+//! get the number of lines currently stored in the scrollback buffer
+uint32_t RF_GetScrollbackSize(const RF_Context* ctx);
+
+//! retrieve a line from the scrollback buffer
+//! \param age        line to retrieve (1 = line that has been scrolled off most recently)
+//! \param cells      receives the line's cells; cells beyond the stored line
+//!                   length are filled with RF_EmptyCell
+//! \param max_cells  number of cells to retrieve
+//! \returns number of cells stored for the line (without trailing empty cells),
+//!          or -1 if there is no such line
+int RF_GetScrollbackLine(const RF_Context* ctx, uint32_t age, RF_Cell* cells, int max_cells);
+
+//! scroll the view back into the scrollback buffer
+//! While the view is scrolled back, RF_Render() shows the last 'offset' lines
+//! from the scrollback buffer at the top, followed by the upper part of the
+//! screen. Lines that are scrolled off the screen meanwhile don't move the view.
+//! \param offset  number of lines to scroll back (0 = show the screen)
+//! \returns the offset actually used (limited to the size of the scrollback buffer)
+uint32_t RF_SetScrollbackView(RF_Context* ctx, uint32_t offset);
+
+//! render using an application-supplied parallel-for implementation
+//! \param pfor   parallel-for implementation (NULL = single-threaded rendering)
+//! \param user   user pointer passed into pfor
+//! \param bands  number of horizontal bands to split the screen into
+void RF_SetParallelFor(RF_Context* ctx, RF_ParallelFor pfor, void* user, int bands);
+
 //! map any RGB color to one of the standard 16 colors (RF_COLOR_DEFAULT is left untouched)
 //! \param bright_threshold  if the brightest component is brighter than this, the bright flag is set
 uint32_t RF_MapRGBToStandardColor(uint32_t color, uint8_t bright_threshold);
@@ -425,20 +872,22 @@ uint32_t RF_MapRGBToStandardColor(uint32_t color, uint8_t bright_threshold);
 //! \param bright1  intensity value for   active components if bright flag is     set
 uint32_t RF_MapStandardColorToRGB(uint32_t color, uint8_t std0, uint8_t std1, uint8_t bright0, uint8_t bright1);
 
-//! \private look up a color from a palette (using the context's cache)
+//! \private look up a color from a palette (using a shared lookup table)
 //! \param ctx       context to use for caching; NULL for no cache
 //! \param pal       palette data (i.e. array of RGB colors to match against)
 //! \param pal_size  number of entries in the palette
 //! \param color     color to search for (must be an RGB color)
 //! \returns index of the closest color in the palette
-//! \note If 'ctx' is valid, the context's palette cache will be used; this
-//!       will make subsequent lookups of the same (or similar) color(s) much
-//!       faster, but matching will only have RF_PAL_CACHE_BITS bits of
-//!       precision per component, and only the first 255 palette entries are
-//!       cacheable.
+//! \note If 'ctx' is valid, a lookup table for the palette is used that
+//!       maps all colors with RF_PAL_LUT_BITS bits of precision per component.
+//!       The table is built when a palette is used for the first time and
+//!       shared (read-only) by all contexts that use the same palette;
+//!       the tables are freed when the last context is destroyed.
+//!       Without 'ctx', the whole palette is searched for the nearest match (by RGB distance).
 uint32_t RF_PaletteLookup(RF_Context* ctx, const uint32_t* pal, uint32_t pal_size, uint32_t color);
 
-//! \private invalidate a context's palette cache
+//! \private make a context forget its palette lookup table
+//! \note This only needs to be called if the contents of a palette array change.
 void RF_InvalidatePalette(RF_Context* ctx);
 
 //! destroy a context
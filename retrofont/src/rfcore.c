@@ -8,15 +8,56 @@
 
 #include "retrofont.h"
 
-const RF_Cell RF_EmptyCell = { 32, 1, 0,0,0,0,0,0, RF_COLOR_DEFAULT, RF_COLOR_DEFAULT };
+extern void* RF_CreateWorkerPool(int num_threads);
+extern void RF_FreeWorkerPool(void* pool);
+extern int RF_GetWorkerPoolSize(void* pool);
+extern void RF_RunWorkerPool(void* pool, RF_JobFunc func, void* job, int count);
+extern int RF_GetCPUCount(void);
+
+extern void* RF_CreateTileCache(int capacity, uint16_t width, uint16_t height, uint8_t bpp);
+extern void RF_FreeTileCache(void* tc);
+extern void RF_ClearTileCache(void* tc);
+extern bool RF_TileCacheMatches(void* tc, int capacity, uint16_t width, uint16_t height, uint8_t bpp);
+extern const uint8_t* RF_TileCacheFind(void* tc, const uint32_t* key);
+extern uint8_t* RF_TileCacheInsert(void* tc, const uint32_t* key);
+extern const uint8_t* RF_TileCachePeek(const void* tc, const uint32_t* key);
+
+extern const void* RF_GetPaletteLUT(const uint32_t* pal, uint32_t pal_size);
+extern uint32_t RF_PaletteLUTLookup(const void* lut, uint32_t color);
+extern uint32_t RF_PaletteSearch(const uint32_t* pal, uint32_t pal_size, uint32_t color);
+extern void RF_AddPaletteLUTUser(void);
+extern void RF_RemovePaletteLUTUser(void);
+
+extern void* RF_CreateScrollback(size_t max_bytes);
+extern void RF_FreeScrollback(void* sb);
+extern void RF_SetScrollbackBudget(void* sb, size_t max_bytes);
+extern uint32_t RF_GetScrollbackLineCount(const void* sb);
+extern bool RF_ScrollbackPush(void* sb, const RF_Cell* cells, uint16_t count);
+extern int RF_ScrollbackGet(const void* sb, uint32_t age, RF_Cell* cells, int max_cells);
+
+const RF_Cell RF_EmptyCell = { 32, 0,0,0,0,0,0, RF_COLOR_DEFAULT, RF_COLOR_DEFAULT };
+
+// resolved cell color memo: direct-mapped, keyed by input colors and attributes
+#define COLOR_MEMO_EMPTY 0xFFu
+#define COLOR_MEMO_SLOT(fg, bg, attribs) ((((fg) ^ ((bg) << 7) ^ (attribs)) * 0x9E3779B1u) >> (32 - RF_COLOR_MEMO_BITS))
+
+static void clear_color_memo(RF_Context* ctx) {
+    for (int i = 0;  i < RF_COLOR_MEMO_SIZE;  ++i) {
+        ctx->color_memo[i].attribs = COLOR_MEMO_EMPTY;
+    }
+    ctx->color_memo_fg = ctx->default_fg;
+    ctx->color_memo_bg = ctx->default_bg;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 
 RF_Context* RF_CreateContext(uint32_t sys_id) {
     RF_Context* ctx = (RF_Context*) calloc(1, sizeof(RF_Context));
     if (!ctx) { return NULL; }
+    ctx->cell_bytes = sizeof(RF_Cell);
     if (!sys_id) { sys_id = RF_SystemList[0]->sys_id; }
     if (!RF_SetSystem(ctx, sys_id)) { free((void*)ctx); return NULL; }
+    RF_AddPaletteLUTUser();
     return ctx;
 }
 
@@ -40,6 +81,7 @@ bool RF_SetSystem(RF_Context* ctx, uint32_t sys_id) {
             }
             ctx->border_color_changed = true;
             RF_InvalidatePalette(ctx);
+            clear_color_memo(ctx);
             return true;
         }
     }
@@ -82,7 +124,8 @@ void RF_SetFallbackMode(RF_Context* ctx, RF_FallbackMode mode) {
     if (!ctx) { return; }
     RF_Invalidate(ctx, false);
     ctx->fallback = mode;
-    memset((void*)ctx->glyph_offset_cache, 0xFF, sizeof(ctx->glyph_offset_cache));
+    memset((void*)ctx->glyph_cache_cp, 0xFF, sizeof(ctx->glyph_cache_cp));
+    RF_ClearTileCache(ctx->tile_cache);  // the font (and thus underline position etc.) may have changed
     ctx->fb_glyphs = NULL;
     if (ctx->font && ((mode == RF_FB_FONT) || (mode == RF_FB_FONT_CHAR) || (mode == RF_FB_CHAR_FONT))) {
         for (const RF_FallbackGlyphs* fb = RF_FallbackGlyphsList;  fb->font_size.x && fb->font_size.y && fb->glyph_map;  ++fb) {
@@ -95,12 +138,246 @@ void RF_SetFallbackMode(RF_Context* ctx, RF_FallbackMode mode) {
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+
+// whether the compact screen layout is used
+#define IS_COMPACT(ctx) ((ctx)->cell_bytes == sizeof(RF_CompactCell))
+
+// address of a cell in either screen layout (coordinates must be valid)
+#define CELL_PTR(ctx, cx, cy) (&(ctx)->cells[((size_t)(ctx)->row_map[cy] * (ctx)->screen_size.x + (size_t)(cx)) * (ctx)->cell_bytes])
+
+#define RF_ATTR_MIN_CAPACITY 64  //!< initial size of the attribute table
+
+// pack a cell's attribute flags into a single word
+static inline uint32_t attr_flags(const RF_Cell* c) {
+    return (c->bold ? 1u : 0u) | (c->dim ? 2u : 0u) | (c->underline ? 4u : 0u)
+         | (c->blink ? 8u : 0u) | (c->reverse ? 16u : 0u) | (c->invisible ? 32u : 0u);
+}
+
+static inline bool attr_equal(const RF_Cell* a, const RF_Cell* b) {
+    return (a->fg == b->fg) && (a->bg == b->bg) && (attr_flags(a) == attr_flags(b));
+}
+
+static inline uint32_t attr_hash(const RF_Cell* c) {
+    return ((c->fg * 0x9E3779B1u) ^ (c->bg * 0x85EBCA77u) ^ (attr_flags(c) * 0xC2B2AE3Du)) >> 7;
+}
+
+// look up or add an attribute in the hash table; returns the table index,
+// or (uint32_t)(-1) if the table is full
+static uint32_t attr_insert(RF_Context* ctx, const RF_Cell* attrib) {
+    uint32_t mask = 2u * ctx->attr_capacity - 1u;
+    for (uint32_t h = attr_hash(attrib) & mask;;  h = (h + 1u) & mask) {
+        uint32_t slot = ctx->attr_hash[h];
+        if (!slot) {
+            RF_Cell* a;
+            if (ctx->attr_count >= ctx->attr_capacity) { return (uint32_t)(-1); }
+            a = &ctx->attr_table[ctx->attr_count];
+            *a = *attrib;
+            a->codepoint = 0;
+            ctx->attr_hash[h] = ++ctx->attr_count;
+            return ctx->attr_count - 1u;
+        }
+        if (attr_equal(&ctx->attr_table[slot - 1u], attrib)) { return slot - 1u; }
+    }
+}
+
+// (re-)allocate an empty attribute table
+static bool attr_alloc(RF_Context* ctx, uint32_t capacity) {
+    RF_Cell* table = (RF_Cell*) malloc(capacity * sizeof(RF_Cell));
+    uint32_t* hash = (uint32_t*) calloc(2u * capacity, sizeof(uint32_t));
+    if (!table || !hash) { free((void*)table);  free((void*)hash);  return false; }
+    free((void*)ctx->attr_table);
+    free((void*)ctx->attr_hash);
+    ctx->attr_table = table;
+    ctx->attr_hash = hash;
+    ctx->attr_capacity = capacity;
+    ctx->attr_count = ctx->attr_last = 0;
+    return true;
+}
+
+// make room in a full attribute table: if the table is already large,
+// throw away the attributes the screen doesn't use any longer;
+// otherwise, grow the table
+static bool attr_make_room(RF_Context* ctx) {
+    size_t cells = (size_t)ctx->screen_size.x * (size_t)ctx->screen_size.y;
+    uint32_t old_count = ctx->attr_count;
+    RF_Cell* old_table = ctx->attr_table;
+    uint32_t* old_hash = ctx->attr_hash;
+    bool collect = ctx->compact_screen && (ctx->attr_capacity >= (2u * cells + RF_ATTR_MIN_CAPACITY));
+    ctx->attr_table = NULL;  ctx->attr_hash = NULL;
+    if (!attr_alloc(ctx, collect ? ctx->attr_capacity : (2u * ctx->attr_capacity))) {
+        ctx->attr_table = old_table;  ctx->attr_hash = old_hash;
+        ctx->attr_count = old_count;
+        return false;
+    }
+    if (collect) {
+        // re-intern the attributes of all cells
+        uint32_t* remap = (uint32_t*) malloc(old_count * sizeof(uint32_t));
+        if (!remap) { free((void*)ctx->attr_table);  free((void*)ctx->attr_hash);
+                      ctx->attr_table = old_table;  ctx->attr_hash = old_hash;  ctx->attr_count = old_count;
+                      return false; }
+        memset((void*)remap, 0xFF, old_count * sizeof(uint32_t));
+        RF_CompactCell* c = ctx->compact_screen;
+        for (size_t n = cells;  n;  --n) {
+            if (remap[c->attr] == (uint32_t)(-1)) { remap[c->attr] = attr_insert(ctx, &old_table[c->attr]); }
+            c->attr = remap[c->attr];
+            ++c;
+        }
+        free((void*)remap);
+    } else {
+        for (uint32_t i = 0;  i < old_count;  ++i) { attr_insert(ctx, &old_table[i]); }
+    }
+    free((void*)old_table);
+    free((void*)old_hash);
+    return true;
+}
+
+// get the attribute table index for a cell's attributes
+static uint32_t intern_attrib(RF_Context* ctx, const RF_Cell* attrib) {
+    uint32_t index;
+    if (ctx->attr_count && attr_equal(&ctx->attr_table[ctx->attr_last], attrib)) { return ctx->attr_last; }
+    index = attr_insert(ctx, attrib);
+    if (index == (uint32_t)(-1)) {
+        if (!attr_make_room(ctx)) { return 0; }  // out of memory -> degrade gracefully
+        index = attr_insert(ctx, attrib);
+    }
+    ctx->attr_last = index;
+    return index;
+}
+
+// store a cell (with an explicit codepoint) in the screen's layout
+static inline void store_cell(RF_Context* ctx, uint8_t* dest, const RF_Cell* src, uint32_t codepoint) {
+    if (IS_COMPACT(ctx)) {
+        RF_CompactCell* c = (RF_CompactCell*) dest;
+        c->attr = intern_attrib(ctx, src);
+        c->codepoint = codepoint;
+    } else {
+        RF_Cell* c = (RF_Cell*) dest;
+        *c = *src;
+        c->codepoint = codepoint;
+    }
+}
+
+// retrieve a cell from the screen's layout
+static inline void load_cell(const RF_Context* ctx, const uint8_t* src, RF_Cell* dest) {
+    if (IS_COMPACT(ctx)) {
+        const RF_CompactCell* c = (const RF_CompactCell*) src;
+        *dest = ctx->attr_table[c->attr];
+        dest->codepoint = c->codepoint;
+    } else {
+        *dest = *((const RF_Cell*) src);
+    }
+}
+
+// change a cell's codepoint (the codepoint is the first member in both layouts)
+static inline void set_codepoint(uint8_t* cell, uint32_t codepoint) {
+    memcpy((void*)cell, (const void*)&codepoint, sizeof(uint32_t));
+}
+
+// fill cells with copies of a cell, in the screen's layout
+static void fill_cells(RF_Context* ctx, uint8_t* dest, size_t count, const RF_Cell* src, uint32_t codepoint) {
+    if (!count) { return; }
+    // copy whole typed cells; a memcpy() with the run-time cell size
+    // becomes a slow string instruction per cell
+    if (IS_COMPACT(ctx)) {
+        RF_CompactCell tmpl, *cell = (RF_CompactCell*) dest;
+        tmpl.codepoint = codepoint;
+        tmpl.attr = intern_attrib(ctx, src);
+        for (;  count;  --count) { *cell++ = tmpl; }
+    } else {
+        RF_Cell tmpl = *src, *cell = (RF_Cell*) dest;
+        tmpl.codepoint = codepoint;
+        for (;  count;  --count) { *cell++ = tmpl; }
+    }
+}
+
+bool RF_ReadCell(const RF_Context* ctx, int x, int y, RF_Cell* cell) {
+    if (!ctx || !ctx->cells || !cell
+    || (x < 0) || (x >= ctx->screen_size.x)
+    || (y < 0) || (y >= ctx->screen_size.y))
+        { return false; }
+    load_cell(ctx, CELL_PTR(ctx, x, y), cell);
+    return true;
+}
+
+bool RF_WriteCell(RF_Context* ctx, int x, int y, const RF_Cell* cell) {
+    if (!ctx || !ctx->cells || !cell
+    || (x < 0) || (x >= ctx->screen_size.x)
+    || (y < 0) || (y >= ctx->screen_size.y))
+        { return false; }
+    store_cell(ctx, CELL_PTR(ctx, x, y), cell, cell->codepoint);
+    RF_InvalidateRegionPS(ctx, x, y, 1, 1);
+    return true;
+}
+
+// update the public screen pointers after the screen or its layout changed
+static void set_screen_pointers(RF_Context* ctx) {
+    ctx->screen         = IS_COMPACT(ctx) ? NULL : (RF_Cell*) ctx->cells;
+    ctx->compact_screen = IS_COMPACT(ctx) ? (RF_CompactCell*) ctx->cells : NULL;
+}
+
+bool RF_SetCompactScreen(RF_Context* ctx, bool compact) {
+    size_t count;
+    uint8_t *new_cells = NULL;
+    if (!ctx) { return false; }
+    if (compact == IS_COMPACT(ctx)) { return true; }
+    count = (size_t)ctx->screen_size.x * (size_t)ctx->screen_size.y;
+    if (compact) {
+        if (!attr_alloc(ctx, RF_ATTR_MIN_CAPACITY)) { return false; }
+        if (ctx->cells) {
+            RF_CompactCell* c = (RF_CompactCell*) malloc(count * sizeof(RF_CompactCell));
+            if (!c) { return false; }
+            for (size_t i = 0;  i < count;  ++i) {
+                c[i].codepoint = ctx->screen[i].codepoint;
+                c[i].attr = intern_attrib(ctx, &ctx->screen[i]);
+            }
+            new_cells = (uint8_t*) c;
+        }
+        ctx->cell_bytes = sizeof(RF_CompactCell);
+    } else {
+        if (ctx->cells) {
+            RF_Cell* c = (RF_Cell*) malloc(count * sizeof(RF_Cell));
+            if (!c) { return false; }
+            for (size_t i = 0;  i < count;  ++i) {
+                load_cell(ctx, (const uint8_t*) &ctx->compact_screen[i], &c[i]);
+            }
+            new_cells = (uint8_t*) c;
+        }
+        ctx->cell_bytes = sizeof(RF_Cell);
+        free((void*)ctx->attr_table);  ctx->attr_table = NULL;
+        free((void*)ctx->attr_hash);   ctx->attr_hash = NULL;
+        ctx->attr_count = ctx->attr_capacity = ctx->attr_last = 0;
+    }
+    if (ctx->cells) {
+        free((void*)ctx->cells);
+        ctx->cells = new_cells;
+    }
+    set_screen_pointers(ctx);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static const uint8_t pixel_sizes[_RF_PF_COUNT] = { 3, 4, 4, 4, 2, 1 };
+
 bool RF_ResizeScreen(RF_Context* ctx, uint16_t new_width, uint16_t new_height, bool with_border) {
-    RF_Cell *new_screen, *c;
+    if (!ctx) { return false; }
+    return RF_ResizeScreenEx(ctx, new_width, new_height, with_border, ctx->format, ctx->stride_align);
+}
+
+bool RF_ResizeScreenEx(RF_Context* ctx, uint16_t new_width, uint16_t new_height, bool with_border, RF_PixelFormat format, uint16_t stride_align) {
+    uint8_t *new_screen, *c;
+    uint8_t empty_cell[sizeof(RF_Cell)];
     RF_Coord bmpsize;
     uint8_t *new_bmp;
+    uint32_t *new_dirty_map, *new_row_epoch, *new_blink_map;
+    uint16_t *new_blink_row_count, *new_row_map;
+    RF_Cell *new_history;
+    uint16_t cell_map_pitch;
+    size_t stride;
 
     if (!ctx || !ctx->system || (!ctx->system->font_size.x && !ctx->font)) { return false; }
+    if (((unsigned)format >= _RF_PF_COUNT) || (stride_align & (stride_align - 1u))) { return false; }
     if (!new_width)  { new_width  = ctx->screen_size.x; }
     if (!new_height) { new_height = ctx->screen_size.y; }
     uint16_t dsx = ctx->system->default_screen_size.x & RF_SIZE_MASK;
@@ -115,8 +392,23 @@ bool RF_ResizeScreen(RF_Context* ctx, uint16_t new_width, uint16_t new_height, b
                    ? (dsy / ctx->font->font_size.y)
                    : ctx->system->default_screen_size.y;
     }
-    c = new_screen = (RF_Cell*) malloc(sizeof(RF_Cell) * new_width * new_height);
+    c = new_screen = (uint8_t*) malloc((size_t)ctx->cell_bytes * new_width * new_height);
     if (!new_screen) { return false; }
+    cell_map_pitch = (uint16_t)((new_width + 31u) >> 5);
+    new_dirty_map = (uint32_t*) calloc((size_t)cell_map_pitch * new_height, sizeof(uint32_t));
+    new_row_epoch = (uint32_t*) calloc(new_height, sizeof(uint32_t));
+    new_blink_map = (uint32_t*) calloc((size_t)cell_map_pitch * new_height, sizeof(uint32_t));
+    new_blink_row_count = (uint16_t*) calloc(new_height, sizeof(uint16_t));
+    new_row_map = (uint16_t*) malloc(new_height * sizeof(uint16_t));
+    new_history = (RF_Cell*) malloc(new_width * sizeof(RF_Cell));
+    if (!new_dirty_map || !new_row_epoch || !new_blink_map || !new_blink_row_count || !new_row_map || !new_history) {
+        free((void*)new_dirty_map);  free((void*)new_row_epoch);
+        free((void*)new_blink_map);  free((void*)new_blink_row_count);
+        free((void*)new_row_map);    free((void*)new_history);
+        free((void*)new_screen);
+        return false;
+    }
+    for (uint16_t y = 0;  y < new_height;  ++y) { new_row_map[y] = y; }
 
     uint16_t csx = ctx->system->cell_size.x + (ctx->system->font_size.x ? 0 : ctx->font->font_size.x);
     uint16_t csy = ctx->system->cell_size.y + (ctx->system->font_size.y ? 0 : ctx->font->font_size.y);
@@ -134,25 +426,66 @@ bool RF_ResizeScreen(RF_Context* ctx, uint16_t new_width, uint16_t new_height, b
         bmpsize.x += ctx->system->border_ul.x + ctx->system->border_lr.x;
         bmpsize.y += ctx->system->border_ul.y + ctx->system->border_lr.y;
     }
-    new_bmp = (uint8_t*) realloc((void*)ctx->bitmap, (size_t)bmpsize.x * (size_t)bmpsize.y * 3);
-    if (!new_bmp) { free((void*)new_screen); return false; }
+    if (ctx->bitmap_external) {
+        // caller-owned bitmap -> the new bitmap must fit into it
+        stride = ctx->stride;
+        new_bmp = ctx->bitmap;
+        if ((bmpsize.x > ctx->target_size.x) || (bmpsize.y > ctx->target_size.y)
+        ||  (((size_t)bmpsize.x * pixel_sizes[format]) > stride))
+            { free((void*)new_dirty_map); free((void*)new_row_epoch); free((void*)new_blink_map); free((void*)new_blink_row_count); free((void*)new_row_map); free((void*)new_history); free((void*)new_screen); return false; }
+    } else {
+        stride = (size_t)bmpsize.x * pixel_sizes[format];
+        if (stride_align) { stride = (stride + stride_align - 1u) & ~((size_t)stride_align - 1u); }
+        new_bmp = (uint8_t*) realloc((void*)ctx->bitmap, stride * (size_t)bmpsize.y);
+        if (!new_bmp) { free((void*)new_dirty_map); free((void*)new_row_epoch); free((void*)new_blink_map); free((void*)new_blink_row_count); free((void*)new_row_map); free((void*)new_history); free((void*)new_screen); return false; }
+    }
 
-    if (!ctx->screen) { ctx->screen_size.x = ctx->screen_size.y = 0; }
+    if (!ctx->cells) { ctx->screen_size.x = ctx->screen_size.y = 0; }
+    store_cell(ctx, empty_cell, &RF_EmptyCell, RF_EmptyCell.codepoint);
     for (uint16_t y = 0;  y < new_height;  ++y) {
-        const RF_Cell* r = (ctx->screen && (y < ctx->screen_size.y)) ? &ctx->screen[ctx->screen_size.x * y] : NULL;
-        for (uint16_t x = 0;  x < new_width;  ++x) {
-            *c = (r && (x < ctx->screen_size.x)) ? (*r++) : RF_EmptyCell;
-            c->dirty = 1;
-            ++c;
+        uint16_t keep = (ctx->cells && (y < ctx->screen_size.y)) ? ((new_width < ctx->screen_size.x) ? new_width : ctx->screen_size.x) : 0;
+        if (keep) {
+            memcpy((void*)c, (const void*)CELL_PTR(ctx, 0, y), (size_t)keep * ctx->cell_bytes);
+            c += (size_t)keep * ctx->cell_bytes;
+        }
+        for (uint16_t x = keep;  x < new_width;  ++x) {
+            memcpy((void*)c, (const void*)empty_cell, ctx->cell_bytes);
+            c += ctx->cell_bytes;
         }
     }
 
-    free((void*)ctx->screen);
-    ctx->screen = new_screen;
+    free((void*)ctx->cells);
+    free((void*)ctx->row_map);
+    ctx->cells = new_screen;
+    ctx->row_map = new_row_map;
+    set_screen_pointers(ctx);
     ctx->screen_size.x = new_width;
     ctx->screen_size.y = new_height;
+    ctx->margin_top = 0;
+    ctx->margin_bottom = new_height;
+    free((void*)ctx->dirty_map);
+    free((void*)ctx->row_epoch);
+    free((void*)ctx->blink_map);
+    free((void*)ctx->blink_row_count);
+    ctx->dirty_map = new_dirty_map;
+    ctx->row_epoch = new_row_epoch;
+    ctx->blink_map = new_blink_map;
+    ctx->blink_row_count = new_blink_row_count;
+    ctx->cell_map_pitch = cell_map_pitch;
+    free((void*)ctx->history_rows);
+    ctx->history_rows = new_history;
+    ctx->history_row_count = 1;
+    ++ctx->dirty_epoch;  // all rows have epoch 0, so this invalidates everything
+    if (!ctx->dirty_epoch) { ++ctx->dirty_epoch; }
+    ctx->pending_move_count = 0;
     ctx->bitmap = new_bmp;
-    ctx->stride = bmpsize.x * 3;
+    ctx->stride = stride;
+    ctx->format = format;
+    ctx->bytes_per_pixel = pixel_sizes[format];
+    ctx->stride_align = stride_align;
+    ctx->palette_size = 0;
+    memset((void*)ctx->pal_hash_rgb, 0xFF, sizeof(ctx->pal_hash_rgb));
+    RF_ClearTileCache(ctx->tile_cache);
     ctx->bitmap_size = bmpsize;
     ctx->has_border = with_border && ((ctx->system->border_lr.x | ctx->system->border_lr.y | ctx->system->border_ul.x | ctx->system->border_ul.y) != 0);
     if (ctx->has_border) {
@@ -169,60 +502,246 @@ bool RF_ResizeScreen(RF_Context* ctx, uint16_t new_width, uint16_t new_height, b
     return true;
 }
 
+bool RF_SetTargetBitmap(RF_Context* ctx, uint8_t* bitmap, size_t stride, uint16_t width, uint16_t height) {
+    if (!ctx || !ctx->cells) { return false; }
+    if (bitmap) {
+        if ((width < ctx->bitmap_size.x) || (height < ctx->bitmap_size.y)
+        ||  (stride < ((size_t)ctx->bitmap_size.x * ctx->bytes_per_pixel)))
+            { return false; }
+        if (!ctx->bitmap_external) { free((void*)ctx->bitmap); }
+        ctx->bitmap = bitmap;
+        ctx->stride = stride;
+        ctx->target_size.x = width;
+        ctx->target_size.y = height;
+        ctx->bitmap_external = true;
+    } else if (ctx->bitmap_external) {
+        // go back to an internally allocated bitmap of the same geometry
+        ctx->bitmap = NULL;
+        ctx->bitmap_external = false;
+        if (!RF_ResizeScreenEx(ctx, ctx->screen_size.x, ctx->screen_size.y, ctx->has_border, ctx->format, ctx->stride_align)) {
+            return false;
+        }
+    }
+    RF_Invalidate(ctx, true);
+    return true;
+}
+
+// mark a single cell as dirty (coordinates must be valid)
+static inline void mark_dirty(RF_Context* ctx, uint16_t x, uint16_t y) {
+    ctx->dirty_map[y * ctx->cell_map_pitch + (x >> 5)] |= 1u << (x & 31);
+}
+
+// mark cells x0...x1-1 of a row as dirty (coordinates must be valid)
+static void mark_dirty_span(RF_Context* ctx, uint16_t y, uint16_t x0, uint16_t x1) {
+    uint32_t *word, *last, first_mask, last_mask;
+    if (x1 <= x0) { return; }
+    word = &ctx->dirty_map[y * ctx->cell_map_pitch + (x0 >> 5)];
+    last = &ctx->dirty_map[y * ctx->cell_map_pitch + ((x1 - 1) >> 5)];
+    first_mask = ~0u << (x0 & 31);
+    last_mask = ~0u >> (31 - ((x1 - 1) & 31));
+    if (word == last) { *word |= first_mask & last_mask; return; }
+    *word++ |= first_mask;
+    while (word < last) { *word++ = ~0u; }
+    *word |= last_mask;
+}
+
 void RF_MoveCursor(RF_Context* ctx, uint16_t new_col, uint16_t new_row) {
-    if (!ctx || !ctx->screen) { return; }
+    if (!ctx || !ctx->cells) { return; }
     if ((ctx->cursor_pos.x < ctx->screen_size.x) && (ctx->cursor_pos.y < ctx->screen_size.y)) {
-        ctx->screen[ctx->screen_size.x * ctx->cursor_pos.y + ctx->cursor_pos.x].dirty = 1;
+        mark_dirty(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y);
     }
     if ((new_col < ctx->screen_size.x) && (new_row < ctx->screen_size.y)) {
-        ctx->screen[ctx->screen_size.x * new_row + new_col].dirty = 1;
+        mark_dirty(ctx, new_col, new_row);
     }
     ctx->cursor_pos.x = new_col;
     ctx->cursor_pos.y = new_row;
 }
 
+// reset the ANSI scrolling region and saved cursor, which would otherwise
+// leak from one document into the next
+static void reset_terminal_state(RF_Context* ctx) {
+    ctx->margin_top = 0;
+    ctx->margin_bottom = ctx->screen_size.y;
+    ctx->saved_cursor.x = ctx->saved_cursor.y = 0;
+    ctx->saved_attrib = RF_EmptyCell;
+}
+
 void RF_ClearScreen(RF_Context* ctx, const RF_Cell* cell) {
-    RF_Cell* c;
-    if (!ctx || !ctx->screen) { return; }
+    if (!ctx || !ctx->cells) { return; }
     if (!cell) { cell = &RF_EmptyCell; }
-    c = ctx->screen;
-    for (size_t count = (size_t)ctx->screen_size.x * (size_t)ctx->screen_size.y;  count;  --count) {
-        *c = *cell;
-        c->dirty = 1;
-        ++c;
-    }
+    fill_cells(ctx, ctx->cells, (size_t)ctx->screen_size.x * (size_t)ctx->screen_size.y, cell, cell->codepoint);
+    reset_terminal_state(ctx);
+    RF_Invalidate(ctx, false);
 }
 
 void RF_Invalidate(RF_Context* ctx, bool with_border) {
-    RF_Cell *c;
-    if (!ctx || !ctx->screen) { return; }
-    c = ctx->screen;
-    for (size_t count = (size_t)ctx->screen_size.x * (size_t)ctx->screen_size.y;  count;  --count) {
-        c->dirty = 1;
-        ++c;
-    }
+    if (!ctx || !ctx->cells) { return; }
+    // start a new epoch; this makes all rows dirty without touching them
+    // (skipping epoch 0, which freshly allocated rows are in)
+    ++ctx->dirty_epoch;
+    if (!ctx->dirty_epoch) { ++ctx->dirty_epoch; }
+    ctx->pending_move_count = 0;  // no need to move pixels that are redrawn anyway
     if (with_border) { ctx->border_color_changed = true; }
 }
 
+void RF_InvalidateRegionAB(RF_Context* ctx, int x0, int y0, int x1, int y1) {
+    if (!ctx || !ctx->cells) { return; }
+    if (x0 < 0) { x0 = 0; }
+    if (y0 < 0) { y0 = 0; }
+    if (x1 >= ctx->screen_size.x) { x1 = ctx->screen_size.x; }
+    if (y1 >= ctx->screen_size.y) { y1 = ctx->screen_size.y; }
+    if ((x1 <= x0) || (y1 <= y0)) { return; }
+    for (int y = y0;  y < y1;  ++y) {
+        mark_dirty_span(ctx, (uint16_t)y, (uint16_t)x0, (uint16_t)x1);
+    }
+}
+void RF_InvalidateRegionPS(RF_Context* ctx, int x0, int y0, int w, int h) {
+    RF_InvalidateRegionAB(ctx, x0,y0, x0+w,y0+h);
+}
+
 void RF_DestroyContext(RF_Context* ctx) {
     if (!ctx) { return; }
-    free((void*)ctx->screen);  ctx->screen = NULL;
-    free((void*)ctx->bitmap);  ctx->bitmap = NULL;
+    free((void*)ctx->cells);  ctx->cells = NULL;
+    ctx->screen = NULL;  ctx->compact_screen = NULL;
+    free((void*)ctx->row_map);
+    free((void*)ctx->attr_table);
+    free((void*)ctx->attr_hash);
+    free((void*)ctx->dirty_map);
+    free((void*)ctx->row_epoch);
+    free((void*)ctx->blink_map);
+    free((void*)ctx->blink_row_count);
+    free((void*)ctx->history_rows);
+    if (!ctx->bitmap_external) { free((void*)ctx->bitmap); }
+    ctx->bitmap = NULL;
+    RF_FreeWorkerPool(ctx->worker_pool);
+    RF_FreeTileCache(ctx->tile_cache);
+    free((void*)ctx->tile_log);
+    free((void*)ctx->band_fills);
+    RF_FreeScrollback(ctx->scrollback);
     free((void*)ctx);
+    RF_RemovePaletteLUTUser();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-#define PUT_PIXEL(p, color) do { \
-    uint32_t color_ = color; \
-    *p++ = RF_COLOR_R(color_); \
-    *p++ = RF_COLOR_G(color_); \
-    *p++ = RF_COLOR_B(color_); \
+// store a pixel value (as returned by RF_MapRGBToPixel) and advance the pointer
+#define PUT_PIXEL(p, bpp, value) do { \
+    uint32_t value_ = value; \
+    if ((bpp) == 3) { \
+        *p++ = RF_COLOR_R(value_); \
+        *p++ = RF_COLOR_G(value_); \
+        *p++ = RF_COLOR_B(value_); \
+    } else if ((bpp) == 4) { \
+        memcpy((void*)p, (const void*)&value_, 4);  p += 4; \
+    } else if ((bpp) == 1) { \
+        *p++ = (uint8_t)value_; \
+    } else { \
+        uint16_t value16_ = (uint16_t)value_; \
+        memcpy((void*)p, (const void*)&value16_, 2);  p += 2; \
+    } \
 } while (0)
 
-static uint8_t* fill_border(uint8_t* p, uint32_t color, size_t count) {
-    while (count--) { PUT_PIXEL(p, color); }
-    return p;
+// find or allocate the palette index for an RGB color in RF_PF_INDEXED8 mode
+static uint8_t palette_index(RF_Context* ctx, uint32_t color) {
+    uint32_t h = (color * 0x9E3779B1u) >> 16;
+    uint32_t best_dist = 0xFFFFFFFFu;
+    uint16_t i;
+    uint8_t index = 0;
+    int probes = 8;
+    color &= 0xFFFFFFu;
+    // look up the color in the hash table
+    for (;;) {
+        h &= RF_PAL_HASH_SIZE - 1;
+        if (ctx->pal_hash_rgb[h] == color) { return ctx->pal_hash_index[h]; }
+        if ((ctx->pal_hash_rgb[h] == 0xFFFFFFFFu) || !--probes) { break; }
+        ++h;
+    }
+    // the color may still be in the palette if its hash chain was too long
+    for (i = 0;  (i < ctx->palette_size) && (ctx->palette[i] != color);  ++i) {}
+    if (i < ctx->palette_size) {
+        index = (uint8_t)i;
+    } else if (ctx->palette_size < RF_MAX_PALETTE_SIZE) {
+        // allocate a new palette entry
+        index = (uint8_t)ctx->palette_size++;
+        ctx->palette[index] = color;
+    } else {
+        // palette is full -> use the nearest existing color
+        for (i = 0;  i < RF_MAX_PALETTE_SIZE;  ++i) {
+            int dr = (int)RF_COLOR_R(color) - (int)RF_COLOR_R(ctx->palette[i]);
+            int dg = (int)RF_COLOR_G(color) - (int)RF_COLOR_G(ctx->palette[i]);
+            int db = (int)RF_COLOR_B(color) - (int)RF_COLOR_B(ctx->palette[i]);
+            uint32_t dist = (uint32_t)(dr*dr + dg*dg + db*db);
+            if (dist < best_dist) { best_dist = dist;  index = (uint8_t)i; }
+        }
+    }
+    // remember the result, in the first empty slot or (if the chain is too
+    // long) in place of the last probed entry; an evicted color is found by
+    // the palette search above again, so it can't be allocated twice
+    ctx->pal_hash_rgb[h] = color;
+    ctx->pal_hash_index[h] = index;
+    return index;
+}
+
+uint32_t RF_MapRGBToPixel(RF_Context* ctx, uint32_t color) {
+    uint8_t b[4];
+    uint32_t value;
+    switch (ctx->format) {
+        case RF_PF_RGBA8888:
+            b[0] = RF_COLOR_R(color);  b[1] = RF_COLOR_G(color);  b[2] = RF_COLOR_B(color);  b[3] = 0xFF;
+            break;
+        case RF_PF_BGRA8888:
+            b[0] = RF_COLOR_B(color);  b[1] = RF_COLOR_G(color);  b[2] = RF_COLOR_R(color);  b[3] = 0xFF;
+            break;
+        case RF_PF_RGB565:
+            return ((uint32_t)(RF_COLOR_R(color) & 0xF8) << 8) | ((uint32_t)(RF_COLOR_G(color) & 0xFC) << 3) | (uint32_t)(RF_COLOR_B(color) >> 3);
+        case RF_PF_INDEXED8:
+            return palette_index(ctx, color);
+        default:  // RGB888 and XRGB8888
+            return color & 0xFFFFFFu;
+    }
+    memcpy((void*)&value, (const void*)b, 4);
+    return value;
+}
+
+void RF_FillPixels(RF_Context* ctx, uint8_t* pixel, uint32_t color, uint16_t count) {
+    const uint8_t bpp = ctx->bytes_per_pixel;
+    const uint32_t value = RF_MapRGBToPixel(ctx, color);
+    while (count--) { PUT_PIXEL(pixel, bpp, value); }
+}
+
+void RF_InvertPixels(RF_Context* ctx, uint8_t* pixel, uint16_t count) {
+    uint32_t mask;
+    if (ctx->format == RF_PF_INDEXED8) {
+        for (;  count;  --count) {
+            *pixel = palette_index(ctx, ctx->palette[*pixel] ^ 0xFFFFFFu);
+            ++pixel;
+        }
+        return;
+    }
+    // XOR'ing white and black cancels out the alpha bits
+    mask = RF_MapRGBToPixel(ctx, 0xFFFFFF) ^ RF_MapRGBToPixel(ctx, 0);
+    if (ctx->bytes_per_pixel == 3) {
+        for (count *= 3;  count;  --count) { *pixel++ ^= 0xFF; }
+    } else if (ctx->bytes_per_pixel == 4) {
+        for (;  count;  --count) {
+            uint32_t v;
+            memcpy((void*)&v, (const void*)pixel, 4);  v ^= mask;
+            memcpy((void*)pixel, (const void*)&v, 4);  pixel += 4;
+        }
+    } else {
+        for (;  count;  --count) {
+            uint16_t v;
+            memcpy((void*)&v, (const void*)pixel, 2);  v ^= (uint16_t)mask;
+            memcpy((void*)pixel, (const void*)&v, 2);  pixel += 2;
+        }
+    }
+}
+
+static void fill_rect(RF_Context* ctx, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint32_t color) {
+    if ((x1 <= x0) || (y1 <= y0)) { return; }
+    for (uint16_t y = y0;  y < y1;  ++y) {
+        RF_FillPixels(ctx, &ctx->bitmap[y * ctx->stride + x0 * ctx->bytes_per_pixel], color, x1 - x0);
+    }
 }
 
 #define INVALID_GLYPH ((uint32_t)(-1))
@@ -239,57 +758,326 @@ static uint32_t glyph_map_lookup(const RF_GlyphMapEntry *map, uint32_t count, ui
     return (map[a].codepoint == codepoint) ? map[a].bitmap_offset : INVALID_GLYPH;
 }
 
-static uint32_t glyph_map_lookup_with_fallback(const RF_GlyphMapEntry *map, uint32_t count, uint32_t codepoint, bool allow_fallback) {
-    uint32_t header, multi_fb_count;
-    uint32_t offset = glyph_map_lookup(map, count, codepoint);
-    if ((offset != INVALID_GLYPH) || !allow_fallback) { return offset; }
-    // if we arrived here, we need to look for fallback characters -> fetch the header
+static uint32_t glyph_table_lookup(const uint16_t *block_map, uint16_t block_count, uint32_t codepoint) {
+    // three-level table lookup: block map -> block (page numbers) -> page (bitmap offsets)
+    uint32_t block = codepoint >> (RF_GLYPH_PAGE_BITS + RF_GLYPH_BLOCK_BITS);
+    uint32_t page;
+    if (block >= block_count) { return INVALID_GLYPH; }
+    page = RF_GlyphBlocks[((uint32_t)block_map[block] << RF_GLYPH_BLOCK_BITS)
+                        | ((codepoint >> RF_GLYPH_PAGE_BITS) & ((1u << RF_GLYPH_BLOCK_BITS) - 1u))];
+    return RF_GlyphPages[(page << RF_GLYPH_PAGE_BITS) | (codepoint & ((1u << RF_GLYPH_PAGE_BITS) - 1u))];
+}
+
+// look up a glyph in a font or fallback glyph set, using the lookup table if
+// there is one; glyphs from fallback fonts are reported as INVALID_GLYPH
+#define glyph_lookup(src, codepoint) glyph_lookup_int((src)->glyph_map, (src)->glyph_count, (src)->block_map, (src)->block_count, codepoint)
+static uint32_t glyph_lookup_int(const RF_GlyphMapEntry *map, uint32_t count, const uint16_t *block_map, uint16_t block_count, uint32_t codepoint) {
+    uint32_t offset;
+    if (!block_map) { return glyph_map_lookup(map, count, codepoint); }
+    offset = glyph_table_lookup(block_map, block_count, codepoint);
+    return (offset & RF_GLYPH_FROM_FALLBACK) ? INVALID_GLYPH : offset;
+}
+
+// look up fallback characters for a codepoint that's not in a font or fallback glyph set
+#define glyph_lookup_char_fallback(src, codepoint) glyph_lookup_char_fallback_int((src)->glyph_map, (src)->glyph_count, (src)->block_map, (src)->block_count, codepoint)
+static uint32_t glyph_lookup_char_fallback_int(const RF_GlyphMapEntry *map, uint32_t count, const uint16_t *block_map, uint16_t block_count, uint32_t codepoint) {
+    uint32_t header, multi_fb_count, offset;
+    // fetch the header
     header = glyph_map_lookup(RF_FallbackMap, RF_FallbackMapSize, codepoint);
     if (header == INVALID_GLYPH) { return header; }
     // decode header; if it's a single fallback entry, look that up
     multi_fb_count = header >> 24;
-    if (!multi_fb_count) { return glyph_map_lookup(map, count, header); }
+    if (!multi_fb_count) { return glyph_lookup_int(map, count, block_map, block_count, header); }
     // if we arrived here, there's multiple possible fallback characters -> iterate over them
     header &= 0xFFFFFF;
     do {
-        offset = glyph_map_lookup(map, count, RF_MultiFallbackData[header++]);
+        offset = glyph_lookup_int(map, count, block_map, block_count, RF_MultiFallbackData[header++]);
     } while (--multi_fb_count && (offset == INVALID_GLYPH));
     return offset;
 }
 
-bool RF_Render(RF_Context* ctx, uint32_t time_msec) {
+static uint32_t glyph_lookup_with_fallback(const RF_Context* ctx, uint32_t codepoint) {
+    const RF_Font* font = ctx->font;
+    uint32_t entry, offset;
+
+    // try the font's native glyph map first; if the font has a lookup table,
+    // this already tells which fallback font glyph to use, if any
+    entry = font->block_map ? glyph_table_lookup(font->block_map, font->block_count, codepoint)
+                            : glyph_map_lookup(font->glyph_map, font->glyph_count, codepoint);
+    if (!(entry & RF_GLYPH_FROM_FALLBACK)) { return entry; }
+
+    // look for fallback characters in the font itself (if allowed to)
+    offset = INVALID_GLYPH;
+    if ((ctx->fallback == RF_FB_CHAR) || (ctx->fallback == RF_FB_CHAR_FONT)) {
+        offset = glyph_lookup_char_fallback(font, codepoint);
+    }
+
+    // look for fallback glyphs in other fonts of the same size (if allowed to)
+    if ((offset == INVALID_GLYPH) && ctx->fb_glyphs) {
+        if (!font->block_map) {
+            offset = glyph_lookup(ctx->fb_glyphs, codepoint);
+        } else if (entry != INVALID_GLYPH) {
+            offset = entry & ~RF_GLYPH_FROM_FALLBACK;
+        }
+        if ((offset == INVALID_GLYPH) && ((ctx->fallback == RF_FB_CHAR_FONT) || (ctx->fallback == RF_FB_FONT_CHAR))) {
+            offset = glyph_lookup_char_fallback(ctx->fb_glyphs, codepoint);
+        }
+    }
+
+    // last resort: use font's built-in fallback glyph
+    return (offset == INVALID_GLYPH) ? font->fallback_offset : offset;
+}
+
+extern RF_RasterFunc RF_GetRasterFunc(uint8_t bytes_per_pixel);
+extern void RF_InitRasterKernel(void);
+
+// glyph cache: open addressing with linear probing over all codepoints
+#define GLYPH_CACHE_EMPTY ((uint32_t)(-1))
+#define GLYPH_CACHE_HASH(cp) (((cp) * 0x9E3779B1u) >> (32 - RF_GLYPH_CACHE_BITS))
+
+static uint32_t glyph_cache_get(const RF_Context* ctx, uint32_t codepoint) {
+    uint32_t slot = GLYPH_CACHE_HASH(codepoint);
+    if (codepoint == GLYPH_CACHE_EMPTY) { return INVALID_GLYPH; }
+    for (int probe = RF_GLYPH_CACHE_PROBES;  probe;  --probe) {
+        if (ctx->glyph_cache_cp[slot] == codepoint) { return ctx->glyph_cache_offset[slot]; }
+        if (ctx->glyph_cache_cp[slot] == GLYPH_CACHE_EMPTY) { break; }
+        slot = (slot + 1) & (RF_GLYPH_CACHE_SIZE - 1);
+    }
+    return INVALID_GLYPH;
+}
+
+static void glyph_cache_put(RF_Context* ctx, uint32_t codepoint, uint32_t offset) {
+    uint32_t home = GLYPH_CACHE_HASH(codepoint), slot = home;
+    if (codepoint == GLYPH_CACHE_EMPTY) { return; }
+    for (int probe = RF_GLYPH_CACHE_PROBES;  probe;  --probe) {
+        if (ctx->glyph_cache_cp[slot] == GLYPH_CACHE_EMPTY) { break; }
+        slot = (slot + 1) & (RF_GLYPH_CACHE_SIZE - 1);
+    }
+    if (ctx->glyph_cache_cp[slot] != GLYPH_CACHE_EMPTY) {
+        slot = home;  // no free slot in reach -> replace the entry in the home slot
+    }
+    ctx->glyph_cache_cp[slot] = codepoint;
+    ctx->glyph_cache_offset[slot] = offset;
+}
+
+// resolve the colors of a render command with the system's map_cell_colors()
+// method, using (and filling) the memo; 'last' holds the previous cell's
+// result, which is the most likely hit by far; the input colors are passed
+// by value (they're in cmd->fg/bg as well) because reading them back right
+// after they have been stored defeats store forwarding
+static void map_cell_colors_memo(RF_Context* ctx, RF_RenderCommand* cmd, uint32_t fg, uint32_t bg, RF_ColorMemo* last) {
+    uint8_t attribs = (uint8_t)attr_flags(cmd->cell);
+    RF_ColorMemo* m;
+    if ((last->attribs == attribs) && (last->fg_in == fg) && (last->bg_in == bg)) {
+        cmd->fg = last->fg;
+        cmd->bg = last->bg;
+        return;
+    }
+    m = &ctx->color_memo[COLOR_MEMO_SLOT(fg, bg, attribs)];
+    if ((m->attribs != attribs) || (m->fg_in != fg) || (m->bg_in != bg)) {
+        m->fg_in = fg;
+        m->bg_in = bg;
+        ctx->system->cls->map_cell_colors(cmd);
+        m->fg = cmd->fg;
+        m->bg = cmd->bg;
+        m->attribs = attribs;
+    }
+    cmd->fg = m->fg;
+    cmd->bg = m->bg;
+    *last = *m;
+}
+
+//! list of changed rectangles collected during rendering
+typedef struct s_RF_RectList {
+    RF_Rect *rects;  //!< rectangle storage (NULL = don't collect rectangles)
+    int max_rects;   //!< capacity of 'rects'
+    int count;       //!< number of valid rectangles
+} RF_RectList;
+
+static void add_dirty_rect(RF_RectList* list, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
+    RF_Rect *r, *best = NULL;
+    uint32_t best_growth = 0xFFFFFFFFu;
+    if (!list->rects || (x1 <= x0) || (y1 <= y0)) { return; }
+    // extend a rectangle of the same width that ends directly above this one
+    for (r = list->rects;  r < &list->rects[list->count];  ++r) {
+        if ((r->ul.x == x0) && (r->lr.x == x1) && (r->lr.y == y0)) {
+            r->lr.y = y1;
+            return;
+        }
+    }
+    // if there's still room, just add the rectangle
+    if (list->count < list->max_rects) {
+        r = &list->rects[list->count++];
+        r->ul.x = x0;  r->ul.y = y0;
+        r->lr.x = x1;  r->lr.y = y1;
+        return;
+    }
+    // otherwise, merge it into the rectangle that grows least by doing so
+    for (r = list->rects;  r < &list->rects[list->count];  ++r) {
+        uint32_t ux0 = (r->ul.x < x0) ? r->ul.x : x0,  ux1 = (r->lr.x > x1) ? r->lr.x : x1;
+        uint32_t uy0 = (r->ul.y < y0) ? r->ul.y : y0,  uy1 = (r->lr.y > y1) ? r->lr.y : y1;
+        uint32_t growth = (ux1 - ux0) * (uy1 - uy0) - (uint32_t)(r->lr.x - r->ul.x) * (uint32_t)(r->lr.y - r->ul.y);
+        if (growth < best_growth) { best = r;  best_growth = growth; }
+    }
+    if (x0 < best->ul.x) { best->ul.x = x0; }
+    if (y0 < best->ul.y) { best->ul.y = y0; }
+    if (x1 > best->lr.x) { best->lr.x = x1; }
+    if (y1 > best->lr.y) { best->lr.y = y1; }
+}
+
+//! tile cache lookup recorded by a band in parallel rendering
+typedef struct s_RF_TileLogEntry {
+    uint32_t key[RF_TILE_KEY_WORDS];  //!< tile key
+    const uint8_t* pixel;             //!< location of the newly rendered tile in the bitmap (NULL = cache hit)
+} RF_TileLogEntry;
+
+//! tile cache lookups of a band in parallel rendering
+typedef struct s_RF_TileLog {
+    RF_TileLogEntry* entries;  //!< recorded lookups (RF_TILE_LOG_SIZE entries)
+    int count;                 //!< number of recorded lookups
+    uint32_t hits;             //!< number of cells rendered from the tile cache
+    uint32_t misses;           //!< number of cells rendered normally
+} RF_TileLog;
+
+// copy a tile into the bitmap or vice versa
+static void copy_tile(const RF_Context* ctx, uint8_t* dest, size_t dest_stride, const uint8_t* src, size_t src_stride) {
+    const size_t row_bytes = (size_t)ctx->cell_size.x * ctx->bytes_per_pixel;
+    for (uint16_t y = ctx->cell_size.y;  y;  --y) {
+        memcpy((void*)dest, (const void*)src, row_bytes);
+        dest += dest_stride;
+        src += src_stride;
+    }
+}
+
+// render a cell through the tile cache;
+// with a log (parallel rendering), the cache is only read, and the lookups
+// are recorded so that merge_tile_log() can update the cache later
+static void render_cell_cached(RF_RenderCommand* cmd, uint32_t glyph_offset, RF_TileLog* log) {
+    RF_Context* ctx = cmd->ctx;
+    const size_t row_bytes = (size_t)ctx->cell_size.x * ctx->bytes_per_pixel;
+    const uint8_t* tile;
+    uint32_t key[RF_TILE_KEY_WORDS];
+    key[0] = glyph_offset;
+    key[1] = cmd->fg;
+    key[2] = cmd->bg;
+    key[3] = (uint32_t)cmd->offset.x | ((uint32_t)cmd->offset.y << 16);
+    key[4] = (uint32_t)cmd->line_start | ((uint32_t)cmd->line_end << 16);
+    key[5] = (cmd->line_xor  ? 1u : 0u)
+           | (cmd->underline ? 2u : 0u)
+           | (cmd->bold      ? 4u : 0u)
+           | (cmd->invisible ? 8u : 0u)
+           | (((cmd->reverse_attr ? 1u : 0u) ^ (cmd->reverse_cursor ? 1u : 0u) ^ (cmd->reverse_blink ? 1u : 0u)) << 4);
+    if (ctx->system->cls->render_cell) {
+        // add everything else a cacheable render_cell() may depend on
+        bool phase = (cmd->cell->blink || cmd->is_cursor) && (cmd->blink_phase & 1);
+        key[5] |= (cmd->reverse_attr   ? 0x20u : 0u)
+               |  (cmd->reverse_cursor ? 0x40u : 0u)
+               |  (cmd->reverse_blink  ? 0x80u : 0u);
+        key[6] = cmd->codepoint;
+        key[7] = attr_flags(cmd->cell)
+               | (cmd->is_cursor ? 0x100u : 0u)
+               | (phase          ? 0x200u : 0u)
+               | (ctx->insert    ? 0x400u : 0u);
+    } else {
+        key[6] = key[7] = 0;
+    }
+    tile = log ? RF_TileCachePeek(ctx->tile_cache, key) : RF_TileCacheFind(ctx->tile_cache, key);
+    if (tile) {
+        if (log) { ++log->hits; } else { ++ctx->tile_hits; }
+        copy_tile(ctx, cmd->pixel, ctx->stride, tile, row_bytes);
+    } else {
+        if (log) { ++log->misses; } else { ++ctx->tile_misses; }
+        if (ctx->system->cls->render_cell) {
+            ctx->system->cls->render_cell(cmd);
+        } else {
+            RF_RenderCell(cmd);
+        }
+        if (!log) {
+            copy_tile(ctx, RF_TileCacheInsert(ctx->tile_cache, key), row_bytes, cmd->pixel, ctx->stride);
+        }
+    }
+    if (log && (log->count < RF_TILE_LOG_SIZE)) {
+        // (lookups beyond the log size are simply not cached)
+        RF_TileLogEntry* e = &log->entries[log->count++];
+        memcpy((void*)e->key, (const void*)key, sizeof(key));
+        e->pixel = tile ? NULL : cmd->pixel;
+    }
+}
+
+// update the tile cache with the lookups a band has done in parallel rendering
+static void merge_tile_log(RF_Context* ctx, const RF_TileLog* log) {
+    const size_t row_bytes = (size_t)ctx->cell_size.x * ctx->bytes_per_pixel;
+    for (const RF_TileLogEntry* e = log->entries;  e < &log->entries[log->count];  ++e) {
+        // hits are marked as recently used; misses are added, unless another
+        // band has rendered the same tile already
+        if (!RF_TileCacheFind(ctx->tile_cache, e->key) && e->pixel) {
+            copy_tile(ctx, RF_TileCacheInsert(ctx->tile_cache, e->key), row_bytes, e->pixel, ctx->stride);
+        }
+    }
+    ctx->tile_hits += log->hits;
+    ctx->tile_misses += log->misses;
+}
+
+// render cell rows y0...y1-1
+// (history = screen-wide buffer for lines from the scrollback buffer)
+static bool render_rows(RF_Context* ctx, uint8_t blink_phase, uint16_t y0, uint16_t y1, RF_RectList* dirty, RF_Cell* history, RF_TileLog* tile_log) {
     bool result = false;
     RF_RenderCommand cmd;
-    if (!ctx || !ctx->system || !ctx->font || !ctx->screen || !ctx->bitmap) { return false; }
-    if (ctx->border_color_changed) {
-        uint32_t color = ctx->system->cls->map_border_color(ctx, ctx->border_color);
-        if (ctx->has_border) {
-            uint8_t* p = fill_border(ctx->bitmap, color, ctx->bitmap_size.x * ctx->main_ul.y + ctx->main_ul.x);
-            for (uint16_t y = ctx->screen_size.y * ctx->cell_size.y;  y;  --y) {
-                p += ctx->screen_size.x * ctx->cell_size.x * 3;
-                if (y > 1) { p = fill_border(p, color, ctx->bitmap_size.x - ctx->main_lr.x + ctx->main_ul.x); }
+    RF_Cell unpacked;  // current cell, if the compact screen layout is used
+    RF_ColorMemo last_colors = { 0, 0, 0, 0, COLOR_MEMO_EMPTY };  // colors resolved for the previous cell
+    uint32_t cell_fg, cell_bg;  // current cell's colors, with the default colors substituted
+    uint32_t view = ctx->scrollback_view;
+    cmd.ctx = ctx;
+    cmd.blink_phase = blink_phase;
+    for (uint16_t y = y0;  y < y1;  ++y) {
+        uint32_t *dirty_row = &ctx->dirty_map[y * ctx->cell_map_pitch];
+        bool full_row = (ctx->row_epoch[y] != ctx->dirty_epoch);
+        if (!full_row) {
+            // skip clean rows without looking at their cells
+            bool any_dirty = false;
+            for (uint16_t i = 0;  i < ctx->cell_map_pitch;  ++i) {
+                if (dirty_row[i]) { any_dirty = true;  break; }
             }
-            fill_border(p, color, ctx->bitmap_size.x - ctx->main_lr.x + ctx->bitmap_size.x * (ctx->bitmap_size.y - ctx->main_lr.y));
+            if (!any_dirty) { continue; }
+        }
+        const uint8_t* cell_ptr;
+        uint8_t cell_bytes = ctx->cell_bytes;
+        bool compact = IS_COMPACT(ctx);
+        if (y < view) {
+            RF_ScrollbackGet(ctx->scrollback, view - y, history, ctx->screen_size.x);
+            cell_ptr = (const uint8_t*) history;
+            cell_bytes = sizeof(RF_Cell);
+            compact = false;
+        } else {
+            cell_ptr = CELL_PTR(ctx, 0, y - view);
         }
-        result = true;
-        ctx->border_rgb = color;
-        ctx->border_color_changed = false;
-    }
-    cmd.ctx = ctx;
-    cmd.cell = ctx->screen;
-    cmd.blink_phase = ctx->system->blink_interval_msec ? (uint8_t)(time_msec / ctx->system->blink_interval_msec) : 0;
-    for (uint16_t y = 0;  y < ctx->screen_size.y;  ++y) {
         uint8_t* pixel_ptr = &ctx->bitmap[((ctx->has_border ? ctx->system->border_ul.y : 0) + y * ctx->cell_size.y) * ctx->stride
-                                         + (ctx->has_border ? ctx->system->border_ul.x : 0) * 3];
+                                         + (ctx->has_border ? ctx->system->border_ul.x : 0) * ctx->bytes_per_pixel];
+        int run_start = -1;  // first cell of the current run of rendered cells (-1 = no run)
         for (uint16_t x = 0;  x < ctx->screen_size.x;  ++x) {
-            cmd.is_cursor = (y == ctx->cursor_pos.y) && (x == ctx->cursor_pos.x);
-            if (cmd.cell->dirty || ((cmd.blink_phase != ctx->last_blink_phase) && (cmd.cell->blink || cmd.is_cursor))) {
+            cmd.is_cursor = ((uint32_t)y == (ctx->cursor_pos.y + view)) && (x == ctx->cursor_pos.x);
+            if (!full_row && !(dirty_row[x >> 5] & (1u << (x & 31)))) {
+                if (run_start >= 0) {
+                    add_dirty_rect(dirty, ctx->main_ul.x + run_start * ctx->cell_size.x, ctx->main_ul.y + y * ctx->cell_size.y,
+                                          ctx->main_ul.x + x         * ctx->cell_size.x, ctx->main_ul.y + (y + 1) * ctx->cell_size.y);
+                    run_start = -1;
+                }
+            } else {
+                if (run_start < 0) { run_start = x; }
                 // prepare the RenderCommand
+                if (compact) {
+                    load_cell(ctx, cell_ptr, &unpacked);
+                    cmd.cell = &unpacked;
+                } else {
+                    cmd.cell = (RF_Cell*) cell_ptr;
+                }
                 cmd.glyph_data = NULL;
                 cmd.pixel = pixel_ptr;
                 cmd.codepoint = cmd.cell->codepoint;
-                cmd.fg = cmd.cell->fg;  if (cmd.fg == RF_COLOR_DEFAULT) { cmd.fg = ctx->default_fg; }
-                cmd.bg = cmd.cell->bg;  if (cmd.bg == RF_COLOR_DEFAULT) { cmd.bg = ctx->default_bg; }
+                cell_fg = cmd.cell->fg;  if (cell_fg == RF_COLOR_DEFAULT) { cell_fg = ctx->default_fg; }
+                cell_bg = cmd.cell->bg;  if (cell_bg == RF_COLOR_DEFAULT) { cell_bg = ctx->default_bg; }
+                cmd.fg = cell_fg;
+                cmd.bg = cell_bg;
                 cmd.offset.x = cmd.offset.y = 0;
                 cmd.line_start = cmd.line_end = 0;
                 cmd.line_xor = true;
@@ -297,60 +1085,450 @@ bool RF_Render(RF_Context* ctx, uint32_t time_msec) {
                 cmd.invisible = !!cmd.cell->invisible;
                 cmd.reverse_attr = !!cmd.cell->reverse;
                 cmd.reverse_cursor = cmd.reverse_blink = false;
+                if (ctx->system->cls->map_cell_colors) {
+                    map_cell_colors_memo(ctx, &cmd, cell_fg, cell_bg, &last_colors);
+                }
                 if (ctx->system->cls->prepare_cell) {
                     ctx->system->cls->prepare_cell(&cmd);
                 }
 
                 // try to retrieve the offset from the cache
-                uint32_t cache_index = cmd.codepoint - RF_GLYPH_CACHE_MIN;
-                uint32_t offset = (cache_index < RF_GLYPH_CACHE_SIZE) ? ctx->glyph_offset_cache[cache_index] : INVALID_GLYPH;
-                // if the glyph is not cached (or not cacheable), look it up the hard way
+                uint32_t offset = glyph_cache_get(ctx, cmd.codepoint);
                 if (offset == INVALID_GLYPH) {
                     // not cached (or not cacheable) -> look up the glyph the hard way
-                    {
-                        // try the font's native glyph map first
-                        offset = glyph_map_lookup_with_fallback(
-                                    ctx->font->glyph_map, ctx->font->glyph_count, cmd.codepoint,
-                                    (ctx->fallback == RF_FB_CHAR) || (ctx->fallback == RF_FB_CHAR_FONT));
-                    }
-                    if ((offset == INVALID_GLYPH) && ctx->fb_glyphs) {
-                        // look for fallback glyphs in other fonts of the same size (if allowed to)
-                        offset = glyph_map_lookup_with_fallback(
-                                    ctx->fb_glyphs->glyph_map, ctx->fb_glyphs->glyph_count, cmd.codepoint,
-                                    (ctx->fallback == RF_FB_CHAR_FONT) || (ctx->fallback == RF_FB_FONT_CHAR));
-                    }
-                    if (offset == INVALID_GLYPH) {
-                        // last resort: use font's built-in fallback glyph
-                        offset = ctx->font->fallback_offset;
-                    }
-                    if (cache_index < RF_GLYPH_CACHE_SIZE) {
-                        // store in cache
-                        ctx->glyph_offset_cache[cache_index] = offset;
-                    }
+                    offset = glyph_lookup_with_fallback(ctx, cmd.codepoint);
+                    // store in cache (even if it's the fallback glyph, so that
+                    // missing glyphs don't need to be looked up again)
+                    glyph_cache_put(ctx, cmd.codepoint, offset);
                 }
 
                 // render the glyph
                 cmd.glyph_data = &RF_GlyphBitmaps[offset];
-                if (ctx->system->cls->render_cell) {
+                if (ctx->tile_cache && (!ctx->system->cls->render_cell || ctx->system->cls->render_cell_cacheable)) {
+                    render_cell_cached(&cmd, offset, tile_log);
+                } else if (ctx->system->cls->render_cell) {
                     ctx->system->cls->render_cell(&cmd);
                 } else {
                     RF_RenderCell(&cmd);
                 }
-                cmd.cell->dirty = 0;
                 result = true;
+
+                // keep the blinking cell index up to date
+                {
+                    uint32_t *word = &ctx->blink_map[y * ctx->cell_map_pitch + (x >> 5)];
+                    uint32_t bit = 1u << (x & 31);
+                    if (cmd.cell->blink) {
+                        if (!(*word & bit)) { *word |= bit;   ++ctx->blink_row_count[y]; }
+                    } else {
+                        if (*word & bit)    { *word &= ~bit;  --ctx->blink_row_count[y]; }
+                    }
+                }
+            }
+            cell_ptr += cell_bytes;
+            pixel_ptr += ctx->cell_size.x * ctx->bytes_per_pixel;
+        }
+        if (run_start >= 0) {
+            add_dirty_rect(dirty, ctx->main_ul.x + run_start       * ctx->cell_size.x, ctx->main_ul.y + y * ctx->cell_size.y,
+                                  ctx->main_ul.x + ctx->screen_size.x * ctx->cell_size.x, ctx->main_ul.y + (y + 1) * ctx->cell_size.y);
+        }
+        // the row is clean now
+        memset((void*)dirty_row, 0, ctx->cell_map_pitch * sizeof(uint32_t));
+        ctx->row_epoch[y] = ctx->dirty_epoch;
+    }
+    return result;
+}
+
+#define RF_MAX_BANDS 64            //!< maximum number of bands for parallel rendering
+#define RF_BAND_RECTS 8            //!< number of dirty rectangles collected per band
+#define RF_PARALLEL_MIN_CELLS 512  //!< minimum number of cells to redraw to make parallel rendering worthwhile
+#define RF_BAND_GLYPH_FILLS 64     //!< number of glyph cache fills recorded per band
+#define RF_BAND_MEMO_FILLS 16      //!< number of color memo fills recorded per band
+
+//! glyph cache and color memo entries a band has added in parallel rendering
+typedef struct s_RF_BandFills {
+    int glyph_count;                              //!< number of recorded glyph cache entries
+    int memo_count;                               //!< number of recorded color memo entries
+    uint32_t glyph_cp[RF_BAND_GLYPH_FILLS];       //!< glyph cache entries: codepoint
+    uint32_t glyph_offset[RF_BAND_GLYPH_FILLS];   //!< glyph cache entries: bitmap offset
+    RF_ColorMemo memo[RF_BAND_MEMO_FILLS];        //!< color memo entries
+} RF_BandFills;
+
+//! state of a parallel rendering job
+typedef struct s_RF_BandJob {
+    RF_Context* ctx;      //!< context to render
+    uint8_t blink_phase;  //!< current blink phase
+    int bands;            //!< number of bands
+    bool collect_rects;   //!< whether dirty rectangles shall be collected
+    RF_TileLog* tile_logs;  //!< per-band tile cache lookups (NULL = don't use the tile cache)
+    RF_BandFills* fills;    //!< per-band glyph cache and color memo fills (NULL = don't record them)
+    const void* pal_lut[RF_MAX_BANDS];           //!< per-band palette lookup table state after rendering
+    const uint32_t* pal_lut_key[RF_MAX_BANDS];   //!< (see RF_Context::pal_lut_key)
+    uint32_t pal_lut_size[RF_MAX_BANDS];         //!< (see RF_Context::pal_lut_size)
+    bool result[RF_MAX_BANDS];                    //!< per-band RF_Render() result
+    RF_RectList dirty[RF_MAX_BANDS];              //!< per-band dirty rectangle lists
+    RF_Rect rects[RF_MAX_BANDS][RF_BAND_RECTS];   //!< per-band dirty rectangle storage
+} RF_BandJob;
+
+// record the glyph cache and color memo entries a band has added to its copy
+// of the context; the original context isn't modified while the bands are
+// running, so everything that differs from it is new
+// (entries beyond the log size are simply not kept)
+static void record_band_fills(const RF_Context* ctx, const RF_Context* band_ctx, RF_BandFills* fills) {
+    fills->glyph_count = fills->memo_count = 0;
+    for (int i = 0;  i < RF_GLYPH_CACHE_SIZE;  ++i) {
+        if ((band_ctx->glyph_cache_cp[i] != ctx->glyph_cache_cp[i]) && (band_ctx->glyph_cache_cp[i] != GLYPH_CACHE_EMPTY)
+        &&  (fills->glyph_count < RF_BAND_GLYPH_FILLS)) {
+            fills->glyph_cp[fills->glyph_count] = band_ctx->glyph_cache_cp[i];
+            fills->glyph_offset[fills->glyph_count++] = band_ctx->glyph_cache_offset[i];
+        }
+    }
+    for (int i = 0;  i < RF_COLOR_MEMO_SIZE;  ++i) {
+        const RF_ColorMemo* m = &band_ctx->color_memo[i];
+        if ((m->attribs != ctx->color_memo[i].attribs) || (m->fg_in != ctx->color_memo[i].fg_in) || (m->bg_in != ctx->color_memo[i].bg_in)) {
+            if ((m->attribs != COLOR_MEMO_EMPTY) && (fills->memo_count < RF_BAND_MEMO_FILLS)) {
+                fills->memo[fills->memo_count++] = *m;
+            }
+        }
+    }
+}
+
+// add the glyph cache and color memo entries a band has recorded to the context
+static void merge_band_fills(RF_Context* ctx, const RF_BandFills* fills) {
+    for (int i = 0;  i < fills->glyph_count;  ++i) {
+        // (another band may have added the same glyph already)
+        if (glyph_cache_get(ctx, fills->glyph_cp[i]) == INVALID_GLYPH) {
+            glyph_cache_put(ctx, fills->glyph_cp[i], fills->glyph_offset[i]);
+        }
+    }
+    for (int i = 0;  i < fills->memo_count;  ++i) {
+        const RF_ColorMemo* m = &fills->memo[i];
+        ctx->color_memo[COLOR_MEMO_SLOT(m->fg_in, m->bg_in, m->attribs)] = *m;
+    }
+}
+
+static void render_band(void* job_, int index) {
+    RF_BandJob* job = (RF_BandJob*) job_;
+    // render on a private copy of the context, so the bands don't race on the caches
+    // (the tile cache is shared, but only read from while the bands are running;
+    // the glyph cache and color memo fills are recorded and merged afterwards)
+    RF_Context band_ctx = *job->ctx;
+    RF_TileLog* tile_log = job->tile_logs ? &job->tile_logs[index] : NULL;
+    if (!tile_log) { band_ctx.tile_cache = NULL; }
+    uint16_t y0 = (uint16_t)((int)band_ctx.screen_size.y *  index      / job->bands);
+    uint16_t y1 = (uint16_t)((int)band_ctx.screen_size.y * (index + 1) / job->bands);
+    job->dirty[index].rects = job->collect_rects ? job->rects[index] : NULL;
+    job->dirty[index].max_rects = RF_BAND_RECTS;
+    job->dirty[index].count = 0;
+    RF_Cell* history = band_ctx.scrollback_view ? &band_ctx.history_rows[(size_t)index * band_ctx.screen_size.x] : NULL;
+    job->result[index] = render_rows(&band_ctx, job->blink_phase, y0, y1, &job->dirty[index], history, tile_log);
+    job->pal_lut[index] = band_ctx.pal_lut;
+    job->pal_lut_key[index] = band_ctx.pal_lut_key;
+    job->pal_lut_size[index] = band_ctx.pal_lut_size;
+    if (job->fills) { record_band_fills(job->ctx, &band_ctx, &job->fills[index]); }
+}
+
+// get the tile cache lookup logs for parallel rendering, (re-)allocating
+// them if required; returns NULL if that fails
+static RF_TileLog* alloc_tile_logs(RF_Context* ctx, int bands) {
+    RF_TileLog* logs;
+    RF_TileLogEntry* entries;
+    if (bands > ctx->tile_log_bands) {
+        free((void*)ctx->tile_log);
+        ctx->tile_log_bands = 0;
+        ctx->tile_log = malloc((size_t)bands * (sizeof(RF_TileLog) + RF_TILE_LOG_SIZE * sizeof(RF_TileLogEntry)));
+        if (!ctx->tile_log) { return NULL; }
+        ctx->tile_log_bands = bands;
+    }
+    logs = (RF_TileLog*) ctx->tile_log;
+    entries = (RF_TileLogEntry*) &logs[ctx->tile_log_bands];
+    for (int i = 0;  i < bands;  ++i) {
+        logs[i].entries = &entries[i * RF_TILE_LOG_SIZE];
+        logs[i].count = 0;
+        logs[i].hits = logs[i].misses = 0;
+    }
+    return logs;
+}
+
+// get the glyph cache and color memo fill logs for parallel rendering,
+// (re-)allocating them if required; returns NULL if that fails
+static RF_BandFills* alloc_band_fills(RF_Context* ctx, int bands) {
+    if (bands > ctx->band_fill_bands) {
+        free((void*)ctx->band_fills);
+        ctx->band_fill_bands = 0;
+        ctx->band_fills = malloc((size_t)bands * sizeof(RF_BandFills));
+        if (!ctx->band_fills) { return NULL; }
+        ctx->band_fill_bands = bands;
+    }
+    return (RF_BandFills*) ctx->band_fills;
+}
+
+// make sure that there's a scrollback row buffer for each band;
+// returns false if that fails (then, rendering has to be single-threaded)
+static bool alloc_history_rows(RF_Context* ctx, int bands) {
+    RF_Cell* rows;
+    if (ctx->history_row_count >= bands) { return true; }
+    rows = (RF_Cell*) realloc((void*)ctx->history_rows, (size_t)bands * ctx->screen_size.x * sizeof(RF_Cell));
+    if (!rows) { return false; }
+    ctx->history_rows = rows;
+    ctx->history_row_count = bands;
+    return true;
+}
+
+// check whether any cell needs to be redrawn
+static bool any_cell_dirty(const RF_Context* ctx) {
+    for (uint16_t y = 0;  y < ctx->screen_size.y;  ++y) {
+        if (ctx->row_epoch[y] != ctx->dirty_epoch) { return true; }
+        const uint32_t *word = &ctx->dirty_map[y * ctx->cell_map_pitch];
+        for (uint16_t i = ctx->cell_map_pitch;  i;  --i) {
+            if (*word++) { return true; }
+        }
+    }
+    return false;
+}
+
+// check whether enough cells need to be redrawn to make parallel rendering worthwhile
+static bool worth_parallel(const RF_Context* ctx) {
+    int count = 0;
+    for (uint16_t y = 0;  y < ctx->screen_size.y;  ++y) {
+        if (ctx->row_epoch[y] != ctx->dirty_epoch) {
+            count += ctx->screen_size.x;
+        } else {
+            const uint32_t *word = &ctx->dirty_map[y * ctx->cell_map_pitch];
+            for (uint16_t i = ctx->cell_map_pitch;  i;  --i) {
+                for (uint32_t bits = *word++;  bits;  bits &= bits - 1u) { ++count; }
+            }
+        }
+        if (count >= RF_PARALLEL_MIN_CELLS) { return true; }
+    }
+    return false;
+}
+
+// mark the cells that need to be redrawn due to a blink phase change dirty,
+// i.e. the cells that were blinking when they were last rendered, and the cursor
+static void invalidate_blinking_cells(RF_Context* ctx) {
+    for (uint16_t y = 0;  y < ctx->screen_size.y;  ++y) {
+        if (!ctx->blink_row_count[y]) { continue; }
+        const uint32_t *blink_word = &ctx->blink_map[y * ctx->cell_map_pitch];
+        uint32_t *dirty_word = &ctx->dirty_map[y * ctx->cell_map_pitch];
+        for (uint16_t i = ctx->cell_map_pitch;  i;  --i) {
+            *dirty_word++ |= *blink_word++;
+        }
+    }
+    if ((ctx->cursor_pos.x < ctx->screen_size.x) && (ctx->cursor_pos.y < ctx->screen_size.y)) {
+        mark_dirty(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y);
+    }
+}
+
+// move the pixels of cells that have been scrolled or copied since the last
+// render, in the same order the cells have been moved
+static bool apply_bitmap_moves(RF_Context* ctx, RF_RectList* dirty) {
+    bool result = false;
+    const size_t cell_bytes = (size_t)ctx->cell_size.x * ctx->bytes_per_pixel;
+    for (const RF_BitmapMove* m = ctx->pending_moves;  m < &ctx->pending_moves[ctx->pending_move_count];  ++m) {
+        int sx0 = m->area.ul.x, sy0 = m->area.ul.y, sx1 = m->area.lr.x, sy1 = m->area.lr.y;
+        if (m->scroll) {
+            // only the part that stays inside the region is moved
+            if (m->dx > 0) { sx1 -= m->dx; } else { sx0 -= m->dx; }
+            if (m->dy > 0) { sy1 -= m->dy; } else { sy0 -= m->dy; }
+        }
+        if ((sx1 <= sx0) || (sy1 <= sy0)) { continue; }
+        int lines = (sy1 - sy0) * ctx->cell_size.y;
+        int src  = ctx->main_ul.y + sy0 * ctx->cell_size.y;
+        int dest = src + m->dy * ctx->cell_size.y;
+        int step = 1;
+        size_t src_x  = ctx->main_ul.x * (size_t)ctx->bytes_per_pixel + sx0 * cell_bytes;
+        size_t dest_x = ctx->main_ul.x * (size_t)ctx->bytes_per_pixel + (sx0 + m->dx) * cell_bytes;
+        size_t bytes = (size_t)(sx1 - sx0) * cell_bytes;
+        add_dirty_rect(dirty, ctx->main_ul.x + (sx0 + m->dx) * ctx->cell_size.x, (uint16_t)dest,
+                              ctx->main_ul.x + (sx1 + m->dx) * ctx->cell_size.x, (uint16_t)(dest + lines));
+        if (m->dy > 0) { src += lines - 1;  dest += lines - 1;  step = -1; }  // bottom-up
+        for (;  lines;  --lines) {
+            memmove((void*)&ctx->bitmap[dest * ctx->stride + dest_x], (const void*)&ctx->bitmap[src * ctx->stride + src_x], bytes);
+            src += step;  dest += step;
+        }
+        result = true;
+    }
+    ctx->pending_move_count = 0;
+    return result;
+}
+
+static bool render_int(RF_Context* ctx, uint32_t time_msec, RF_RectList* dirty) {
+    bool result = false;
+    uint8_t blink_phase;
+    int bands;
+    if (!ctx || !ctx->system || !ctx->font || !ctx->cells || !ctx->bitmap) { return false; }
+    RF_InitRasterKernel();  // (before the band threads start)
+    if (ctx->border_color_changed) {
+        uint32_t color = ctx->system->cls->map_border_color(ctx, ctx->border_color);
+        if (ctx->has_border) {
+            fill_rect(ctx, 0, 0, ctx->bitmap_size.x, ctx->main_ul.y, color);                                  // top
+            fill_rect(ctx, 0, ctx->main_ul.y, ctx->main_ul.x, ctx->main_lr.y, color);                          // left
+            fill_rect(ctx, ctx->main_lr.x, ctx->main_ul.y, ctx->bitmap_size.x, ctx->main_lr.y, color);         // right
+            fill_rect(ctx, 0, ctx->main_lr.y, ctx->bitmap_size.x, ctx->bitmap_size.y, color);                 // bottom
+            add_dirty_rect(dirty, 0, 0, ctx->bitmap_size.x, ctx->main_ul.y);                                  // top
+            add_dirty_rect(dirty, 0, ctx->main_ul.y, ctx->main_ul.x, ctx->main_lr.y);                          // left
+            add_dirty_rect(dirty, ctx->main_lr.x, ctx->main_ul.y, ctx->bitmap_size.x, ctx->main_lr.y);         // right
+            add_dirty_rect(dirty, 0, ctx->main_lr.y, ctx->bitmap_size.x, ctx->bitmap_size.y);                 // bottom
+            result = true;
+        }
+        // (without a border, only border_rgb changes, not the bitmap)
+        ctx->border_rgb = color;
+        ctx->border_color_changed = false;
+    }
+    if ((ctx->color_memo_fg != ctx->default_fg) || (ctx->color_memo_bg != ctx->default_bg)) {
+        // default colors changed (RF_SetForegroundColor(), RF_SetBackgroundColor(),
+        // RF_ClearAll()) -> resolved colors may have changed too
+        clear_color_memo(ctx);
+    }
+    if (ctx->scrollback_view) {
+        // the screen is shown shifted down, so its dirty state doesn't apply
+        // to the bitmap -> redraw everything if anything changed
+        uint32_t lines = RF_GetScrollbackLineCount(ctx->scrollback);
+        if ((ctx->scrollback_view > lines) || ctx->pending_move_count || any_cell_dirty(ctx)) {
+            if (ctx->scrollback_view > lines) { ctx->scrollback_view = lines; }
+            RF_Invalidate(ctx, false);
+        }
+    }
+    result |= apply_bitmap_moves(ctx, dirty);
+    blink_phase = ctx->system->blink_interval_msec ? (uint8_t)(time_msec / ctx->system->blink_interval_msec) : 0;
+    if (blink_phase != ctx->last_blink_phase) { invalidate_blinking_cells(ctx); }
+    if (ctx->tile_cache_size
+    && !RF_TileCacheMatches(ctx->tile_cache, ctx->tile_cache_size, ctx->cell_size.x, ctx->cell_size.y, ctx->bytes_per_pixel)) {
+        // (re-)create the tile cache with the current cell geometry
+        RF_FreeTileCache(ctx->tile_cache);
+        ctx->tile_cache = RF_CreateTileCache(ctx->tile_cache_size, ctx->cell_size.x, ctx->cell_size.y, ctx->bytes_per_pixel);
+    }
+    bands = (ctx->parallel_bands < ctx->screen_size.y) ? ctx->parallel_bands : ctx->screen_size.y;
+    if (ctx->parallel_for && (bands > 1) && (ctx->format != RF_PF_INDEXED8) && worth_parallel(ctx)
+    && (!ctx->scrollback_view || alloc_history_rows(ctx, bands))) {
+        RF_BandJob job;
+        job.ctx = ctx;
+        job.blink_phase = blink_phase;
+        job.bands = bands;
+        job.collect_rects = (dirty->rects != NULL);
+        job.tile_logs = ctx->tile_cache ? alloc_tile_logs(ctx, job.bands) : NULL;
+        job.fills = alloc_band_fills(ctx, job.bands);
+        ctx->parallel_for(ctx->parallel_user, render_band, (void*)&job, job.bands);
+        for (int i = 0;  i < job.bands;  ++i) {
+            result |= job.result[i];
+            if (job.tile_logs) { merge_tile_log(ctx, &job.tile_logs[i]); }
+            if (job.fills) { merge_band_fills(ctx, &job.fills[i]); }
+            if (job.pal_lut[i] && ((job.pal_lut_key[i] != ctx->pal_lut_key) || (job.pal_lut_size[i] != ctx->pal_lut_size))) {
+                // keep the palette lookup table a band has resolved, so the
+                // bands of the next frame don't need to look it up again
+                ctx->pal_lut = job.pal_lut[i];
+                ctx->pal_lut_key = job.pal_lut_key[i];
+                ctx->pal_lut_size = job.pal_lut_size[i];
+            }
+            for (int j = 0;  j < job.dirty[i].count;  ++j) {
+                const RF_Rect* r = &job.rects[i][j];
+                add_dirty_rect(dirty, r->ul.x, r->ul.y, r->lr.x, r->lr.y);
             }
-            ++cmd.cell;
-            pixel_ptr += ctx->cell_size.x * 3;
         }
+    } else {
+        result |= render_rows(ctx, blink_phase, 0, ctx->screen_size.y, dirty, ctx->history_rows, NULL);
     }
-    ctx->last_blink_phase = cmd.blink_phase;
+    ctx->last_blink_phase = blink_phase;
     return result;
 }
 
+bool RF_Render(RF_Context* ctx, uint32_t time_msec) {
+    RF_RectList dirty = { NULL, 0, 0 };
+    return render_int(ctx, time_msec, &dirty);
+}
+
+int RF_RenderEx(RF_Context* ctx, uint32_t time_msec, RF_Rect* rects, int max_rects) {
+    RF_RectList dirty = { NULL, 0, 0 };
+    if (!rects || (max_rects < 1)) { return render_int(ctx, time_msec, &dirty) ? 1 : 0; }
+    dirty.rects = rects;
+    dirty.max_rects = max_rects;
+    render_int(ctx, time_msec, &dirty);
+    return dirty.count;
+}
+
+int RF_SetRenderThreads(RF_Context* ctx, int num_threads) {
+    if (!ctx) { return 1; }
+    RF_FreeWorkerPool(ctx->worker_pool);
+    ctx->worker_pool = NULL;
+    if (num_threads == RF_THREADS_AUTO) { num_threads = RF_GetCPUCount(); }
+    if (num_threads > RF_MAX_BANDS) { num_threads = RF_MAX_BANDS; }
+    ctx->worker_pool = RF_CreateWorkerPool(num_threads);
+    if (!ctx->worker_pool) {
+        ctx->parallel_for = NULL;
+        ctx->parallel_bands = 1;
+        return 1;
+    }
+    num_threads = RF_GetWorkerPoolSize(ctx->worker_pool);
+    ctx->parallel_for = RF_RunWorkerPool;
+    ctx->parallel_user = ctx->worker_pool;
+    // use more bands than threads, so that uneven bands balance out
+    ctx->parallel_bands = (2 * num_threads < RF_MAX_BANDS) ? (2 * num_threads) : RF_MAX_BANDS;
+    return num_threads;
+}
+
+void RF_SetTileCacheSize(RF_Context* ctx, int tiles) {
+    if (!ctx) { return; }
+    RF_FreeTileCache(ctx->tile_cache);
+    ctx->tile_cache = NULL;
+    ctx->tile_cache_size = (tiles > 0) ? tiles : 0;
+    ctx->tile_hits = ctx->tile_misses = 0;
+}
+
+bool RF_SetScrollback(RF_Context* ctx, size_t max_bytes) {
+    if (!ctx) { return false; }
+    if (!max_bytes) {
+        RF_FreeScrollback(ctx->scrollback);
+        ctx->scrollback = NULL;
+        RF_SetScrollbackView(ctx, 0);
+        return true;
+    }
+    if (ctx->scrollback) {
+        RF_SetScrollbackBudget(ctx->scrollback, max_bytes);
+    } else {
+        ctx->scrollback = RF_CreateScrollback(max_bytes);
+    }
+    return (ctx->scrollback != NULL);
+}
+
+uint32_t RF_GetScrollbackSize(const RF_Context* ctx) {
+    return ctx ? RF_GetScrollbackLineCount(ctx->scrollback) : 0;
+}
+
+int RF_GetScrollbackLine(const RF_Context* ctx, uint32_t age, RF_Cell* cells, int max_cells) {
+    return ctx ? RF_ScrollbackGet(ctx->scrollback, age, cells, max_cells) : -1;
+}
+
+uint32_t RF_SetScrollbackView(RF_Context* ctx, uint32_t offset) {
+    uint32_t lines;
+    if (!ctx) { return 0; }
+    lines = RF_GetScrollbackLineCount(ctx->scrollback);
+    if (offset > lines) { offset = lines; }
+    if (offset != ctx->scrollback_view) {
+        ctx->scrollback_view = offset;
+        RF_Invalidate(ctx, false);
+    }
+    return offset;
+}
+
+void RF_SetParallelFor(RF_Context* ctx, RF_ParallelFor pfor, void* user, int bands) {
+    if (!ctx) { return; }
+    RF_FreeWorkerPool(ctx->worker_pool);
+    ctx->worker_pool = NULL;
+    ctx->parallel_for = pfor;
+    ctx->parallel_user = user;
+    ctx->parallel_bands = (bands < RF_MAX_BANDS) ? bands : RF_MAX_BANDS;
+}
+
+
+#define RF_RASTER_MAX_WIDTH  32  //!< maximum cell width supported by the SIMD kernels
+#define RF_RASTER_MAX_HEIGHT 64  //!< maximum cell height supported by the SIMD kernels
+
 void RF_RenderCell(RF_RenderCommand* cmd) {
-    uint8_t *p, bits, mask, lsb, lsb_mask;
+    uint8_t *p, bits, mask, lsb, lsb_mask, bpp;
     const uint8_t *g;
     uint16_t uline_pos;
+    uint32_t fg, bg;
+    RF_RasterFunc raster;
     if (!cmd || !cmd->cell || !cmd->pixel || !cmd->glyph_data) { return; }
     if (!RF_IS_RGB_COLOR(cmd->fg)) { cmd->fg = (cmd->fg == RF_COLOR_DEFAULT) ? 0xFFFFFF : RF_MapStandardColorToRGB(cmd->fg, 0,160, 0,255); }
     if (!RF_IS_RGB_COLOR(cmd->bg)) { cmd->bg = (cmd->bg == RF_COLOR_DEFAULT) ? 0xFFFFFF : RF_MapStandardColorToRGB(cmd->bg, 0,160, 0,255); }
@@ -361,6 +1539,39 @@ void RF_RenderCell(RF_RenderCommand* cmd) {
     lsb_mask = cmd->bold ? 1 : 0;
     uline_pos = (cmd->underline && cmd->ctx->font->underline_row) ? (cmd->offset.y + cmd->ctx->font->underline_row) : cmd->ctx->cell_size.y;
     g = cmd->glyph_data;
+    bpp = cmd->ctx->bytes_per_pixel;
+    fg = RF_MapRGBToPixel(cmd->ctx, cmd->fg);
+    bg = RF_MapRGBToPixel(cmd->ctx, cmd->bg);
+
+    // fast path: compute a foreground bit mask for each row, then let a
+    // SIMD kernel expand that into pixels
+    raster = RF_GetRasterFunc(bpp);
+    if (raster && (cmd->ctx->cell_size.x <= RF_RASTER_MAX_WIDTH) && (cmd->ctx->cell_size.y <= RF_RASTER_MAX_HEIGHT)
+    &&  (cmd->offset.x < cmd->ctx->cell_size.x)) {
+        uint32_t row_masks[RF_RASTER_MAX_HEIGHT];
+        const uint16_t glyph_width = cmd->ctx->cell_size.x - cmd->offset.x;
+        const uint16_t glyph_bytes = (((glyph_width < cmd->ctx->font->font_size.x) ? glyph_width : cmd->ctx->font->font_size.x) + 7) >> 3;
+        const uint32_t prefix_mask = (1u << cmd->offset.x) - 1u;
+        const uint32_t width_mask = (cmd->ctx->cell_size.x < 32) ? ((1u << cmd->ctx->cell_size.x) - 1u) : 0xFFFFFFFFu;
+        for (uint16_t y = 0;  y < cmd->ctx->cell_size.y;  ++y) {
+            const bool xline_row = (y >= cmd->line_start) && (y < cmd->line_end);
+            const uint32_t line_or  = ((y == uline_pos) || (xline_row && !cmd->line_xor)) ? 0xFFFFFFFFu : 0u;
+            const uint32_t line_xor = (xline_row && cmd->line_xor) ? 0xFFFFFFFFu : 0u;
+            uint32_t row = 0;
+            if ((y >= cmd->offset.y) && (y < (cmd->offset.y + cmd->ctx->font->font_size.y))) {
+                for (uint16_t i = 0;  i < glyph_bytes;  ++i) {
+                    row |= ((uint32_t)((*g++) & mask)) << (i << 3);
+                }
+                if (lsb_mask) { row |= row << 1; }
+            }
+            row = (((row | line_or) ^ line_xor) << cmd->offset.x) | ((line_or ^ line_xor) & prefix_mask);
+            row_masks[y] = row & width_mask;
+        }
+        raster(cmd->pixel, cmd->ctx->stride, row_masks, cmd->ctx->cell_size.y, cmd->ctx->cell_size.x, fg, bg);
+        return;
+    }
+
+    // reference implementation
     for (uint16_t y = 0;  y < cmd->ctx->cell_size.y;  ++y) {
         const bool core_row = (y >= cmd->offset.y) && (y < (cmd->offset.y + cmd->ctx->font->font_size.y));
         const bool uline_row = (y == uline_pos);
@@ -369,14 +1580,14 @@ void RF_RenderCell(RF_RenderCommand* cmd) {
         const uint8_t line_xor = xline_row && cmd->line_xor ? 1 : 0;
         p = &cmd->pixel[cmd->ctx->stride * y];
         for (uint16_t x = cmd->offset.x;  x;  --x) {
-            PUT_PIXEL(p, (line_or ^ line_xor) ? cmd->fg : cmd->bg);
+            PUT_PIXEL(p, bpp, (line_or ^ line_xor) ? fg : bg);
         }
         bits = lsb = 0;
         for (uint16_t x = 0;  x < (cmd->ctx->cell_size.x - cmd->offset.x);  ++x) {
             if (core_row && (x < cmd->ctx->font->font_size.x) && !(x & 7)) {
                 bits = (*g++) & mask;
             }
-            PUT_PIXEL(p, (((bits & 1) | lsb | line_or) ^ line_xor) ? cmd->fg : cmd->bg);
+            PUT_PIXEL(p, bpp, (((bits & 1) | lsb | line_or) ^ line_xor) ? fg : bg);
             lsb = bits & lsb_mask;
             bits >>= 1;
         }
@@ -386,7 +1597,7 @@ void RF_RenderCell(RF_RenderCommand* cmd) {
 ///////////////////////////////////////////////////////////////////////////////
 
 void RF_DemoScreen(RF_Context* ctx) {
-    if (!ctx || !ctx->screen) { return; }
+    if (!ctx || !ctx->cells) { return; }
     static const uint32_t cp_offsets[] = {
         0x0020, 0x0040, 0x0060,          // Basic Latin (a.k.a. standard ASCII)
         0x00A0, 0x00C0, 0x00E0,          // Latin-1 Supplement
@@ -398,8 +1609,9 @@ void RF_DemoScreen(RF_Context* ctx) {
     };
     uint16_t demo_row_count = (uint16_t)(sizeof(cp_offsets) / sizeof(*cp_offsets));
     uint16_t attribute_start_row = (ctx->screen_size.y > demo_row_count) || (ctx->screen_size.x > 32) ? demo_row_count : 9;
-    RF_Cell *c = ctx->screen;
+    RF_Cell cell, *c = &cell;
     for (uint16_t y = 0;  y < ctx->screen_size.y;  ++y) {
+        uint8_t *dest = CELL_PTR(ctx, 0, y);
         for (uint16_t x = 0;  x < ctx->screen_size.x;  ++x) {
             uint32_t row_mod = 3;
             *c = RF_EmptyCell;
@@ -449,22 +1661,24 @@ void RF_DemoScreen(RF_Context* ctx) {
                     c->codepoint += 0x1FBF0 - 0x1FBC6;  // make ST's LED digits visible
                 }
             }
-            c->dirty = 1;
-            ++c;
+            store_cell(ctx, dest, c, c->codepoint);
+            dest += ctx->cell_bytes;
         }
     }
+    RF_Invalidate(ctx, false);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 void RF_AddChar(RF_Context* ctx, uint32_t codepoint) {
-    RF_Cell* pos;
+    uint8_t* pos;
+    RF_Cell fill;
     if (!codepoint) { return; }
-    if (!ctx || !ctx->screen
+    if (!ctx || !ctx->cells
     || (ctx->cursor_pos.x >= ctx->screen_size.x)
     || (ctx->cursor_pos.y >= ctx->screen_size.y))
         { return; }
-    pos = &ctx->screen[ctx->cursor_pos.y * ctx->screen_size.x + ctx->cursor_pos.x];
+    pos = CELL_PTR(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y);
     if (codepoint == RF_CP_TAB) {
         if (ctx->insert) {
             for (uint16_t i = 8 - (ctx->cursor_pos.x & 7);  i;  --i) {
@@ -493,16 +1707,17 @@ void RF_AddChar(RF_Context* ctx, uint32_t codepoint) {
             RF_CopyRegionAB(ctx, ctx->cursor_pos.x,ctx->cursor_pos.y-1, ctx->screen_size.x,ctx->cursor_pos.y, 0,ctx->cursor_pos.y, &ctx->attrib);
             // clear what remains
             RF_ClearRegionPS(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y - 1, ctx->screen_size.x, 1, &ctx->attrib);
-            RF_ClearRegionPS(ctx, ctx->screen_size.x - ctx->cursor_pos.x, ctx->cursor_pos.y, ctx->screen_size.x, 1,
-                             &ctx->screen[ctx->cursor_pos.y * ctx->screen_size.x + ctx->screen_size.x - ctx->cursor_pos.x - 1]);
+            load_cell(ctx, CELL_PTR(ctx, ctx->screen_size.x - ctx->cursor_pos.x - 1, ctx->cursor_pos.y), &fill);
+            RF_ClearRegionPS(ctx, ctx->screen_size.x - ctx->cursor_pos.x, ctx->cursor_pos.y, ctx->screen_size.x, 1, &fill);
             ctx->cursor_pos.x = 0;
-        } else if ((ctx->cursor_pos.y + 1) == ctx->screen_size.y) {
-            // overwrite mode, at end of screen -> insert new line
-            RF_ScrollRegionAB(ctx, 0,0, ctx->screen_size.x,ctx->screen_size.y, 0,-1, &ctx->screen[ctx->screen_size.x * ctx->screen_size.y - 1]);
+        } else if ((ctx->cursor_pos.y + 1) == ctx->margin_bottom) {
+            // overwrite mode, at end of screen (or scrolling region) -> insert new line
+            load_cell(ctx, CELL_PTR(ctx, ctx->screen_size.x - 1, ctx->margin_bottom - 1), &fill);
+            RF_ScrollRegionAB(ctx, 0,ctx->margin_top, ctx->screen_size.x,ctx->margin_bottom, 0,-1, &fill);
             ctx->cursor_pos.x = 0;
         } else {
             // otherwise, only move cursor in overwrite mode
-            pos->dirty = 1;
+            mark_dirty(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y);
             ctx->cursor_pos.x = 0;
             if ((++(ctx->cursor_pos.y)) >= ctx->screen_size.y) {
                 ctx->cursor_pos.y = ctx->screen_size.y - 1;
@@ -513,36 +1728,28 @@ void RF_AddChar(RF_Context* ctx, uint32_t codepoint) {
     } else if (codepoint == RF_CP_BACKSPACE) {
         if (ctx->cursor_pos.x) {
             if (ctx->insert) {
-                --pos;
-                for (uint16_t i = ctx->cursor_pos.x;  i < ctx->screen_size.x;  ++i) {
-                    *pos = pos[1];
-                    pos->dirty = 1;
-                    ++pos;
-                }
+                memmove((void*)(pos - ctx->cell_bytes), (const void*)pos, (size_t)(ctx->screen_size.x - ctx->cursor_pos.x) * ctx->cell_bytes);
+                pos = CELL_PTR(ctx, ctx->screen_size.x - 1, ctx->cursor_pos.y);
+                mark_dirty_span(ctx, ctx->cursor_pos.y, ctx->cursor_pos.x - 1, ctx->screen_size.x);
             } else {
-                pos->dirty = 1;
-                --pos;
+                mark_dirty_span(ctx, ctx->cursor_pos.y, ctx->cursor_pos.x - 1, ctx->cursor_pos.x + 1);
+                pos -= ctx->cell_bytes;
             }
             --ctx->cursor_pos.x;
-            pos->codepoint = 32;
+            set_codepoint(pos, 32);
         }
     } else if (codepoint == RF_CP_DELETE) {
-        for (uint16_t i = ctx->cursor_pos.x + 1;  i < ctx->screen_size.x;  ++i) {
-            *pos = pos[1];
-            pos->dirty = 1;
-            ++pos;
-        }
-        pos->codepoint = 32;
+        memmove((void*)pos, (const void*)(pos + ctx->cell_bytes), (size_t)(ctx->screen_size.x - ctx->cursor_pos.x - 1) * ctx->cell_bytes);
+        set_codepoint(CELL_PTR(ctx, ctx->screen_size.x - 1, ctx->cursor_pos.y), 32);
+        mark_dirty_span(ctx, ctx->cursor_pos.y, ctx->cursor_pos.x, ctx->screen_size.x);
     } else {
         if (ctx->insert) {
-            for (uint16_t i = ctx->screen_size.x - 1 - ctx->cursor_pos.x;  i;  --i) {
-                pos[i] = pos[i-1];
-                pos[i].dirty = true;
-            }
+            memmove((void*)(pos + ctx->cell_bytes), (const void*)pos, (size_t)(ctx->screen_size.x - 1 - ctx->cursor_pos.x) * ctx->cell_bytes);
+            mark_dirty_span(ctx, ctx->cursor_pos.y, ctx->cursor_pos.x, ctx->screen_size.x);
+        } else {
+            mark_dirty(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y);
         }
-        *pos = ctx->attrib;
-        pos->codepoint = codepoint;
-        pos->dirty = 1;
+        store_cell(ctx, pos, &ctx->attrib, codepoint);
         if ((++(ctx->cursor_pos.x)) >= ctx->screen_size.x) {
             ctx->cursor_pos.x = 0;
             if (ctx->insert) {
@@ -552,17 +1759,16 @@ void RF_AddChar(RF_Context* ctx, uint32_t codepoint) {
                 } else {
                     RF_ScrollRegionAB(ctx, 0,ctx->cursor_pos.y, ctx->screen_size.x,ctx->screen_size.y, 0,1, &ctx->attrib);
                 }
-            } else {
-                if ((++(ctx->cursor_pos.y)) >= ctx->screen_size.y) {
-                    RF_ScrollRegionAB(ctx, 0,0, ctx->screen_size.x,ctx->screen_size.y, 0,-1, &ctx->attrib);
-                    --ctx->cursor_pos.y;
-                }
+            } else if ((ctx->cursor_pos.y + 1) == ctx->margin_bottom) {
+                RF_ScrollRegionAB(ctx, 0,ctx->margin_top, ctx->screen_size.x,ctx->margin_bottom, 0,-1, &ctx->attrib);
+            } else if ((ctx->cursor_pos.y + 1) < ctx->screen_size.y) {
+                ++ctx->cursor_pos.y;
             }
         }
     }
     // regardless of what just happened, mark the new cursor position as dirty
     if ((ctx->cursor_pos.x < ctx->screen_size.x) && (ctx->cursor_pos.y < ctx->screen_size.y)) {
-        ctx->screen[ctx->cursor_pos.y * ctx->screen_size.x + ctx->cursor_pos.x].dirty = 1;
+        mark_dirty(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y);
     }
 }
 
@@ -570,40 +1776,117 @@ RF_Cell* RF_GetCell(RF_Context* ctx, int x, int y) {
     return (ctx && ctx->screen
          && (x >= 0) && (x < ctx->screen_size.x)
          && (y >= 0) && (y < ctx->screen_size.y))
-         ? &ctx->screen[x + y * ctx->screen_size.x]
+         ? (RF_Cell*) CELL_PTR(ctx, x, y)
          : NULL;
 }
 
 void RF_ClearRegionAB(RF_Context* ctx, int x0, int y0, int x1, int y1, const RF_Cell* attrib) {
-    RF_Cell* c;
-    if (!ctx || !ctx->screen) { return; }
+    if (!ctx || !ctx->cells) { return; }
     if (x0 < 0) { x0 = 0; }
     if (y0 < 0) { y0 = 0; }
     if (x1 >= ctx->screen_size.x) { x1 = ctx->screen_size.x; }
     if (y1 >= ctx->screen_size.y) { y1 = ctx->screen_size.y; }
     if ((x1 <= x0) || (y1 <= y0)) { return; }
     if (!attrib) { attrib = &RF_EmptyCell; }
-    c = &ctx->screen[x0 + y0 * ctx->screen_size.x];
-    x1 -= x0;
-    for (y1 -= y0;  y1;  --y1) {
-        for (int x = x1;  x;  --x) {
-            *c = *attrib;
-            c->codepoint = 32;
-            c->dirty = 1;
-            ++c;
-        }
-        c += ctx->screen_size.x - x1;
+    for (int y = y0;  y < y1;  ++y) {
+        fill_cells(ctx, CELL_PTR(ctx, x0, y), (size_t)(x1 - x0), attrib, 32);
+        mark_dirty_span(ctx, (uint16_t)y, (uint16_t)x0, (uint16_t)x1);
     }
 }
 void RF_ClearRegionPS(RF_Context* ctx, int x0, int y0, int w, int h, const RF_Cell* attrib) {
     RF_ClearRegionAB(ctx, x0,y0, x0+w,y0+h, attrib);
 }
 
+// queue a move of rendered cells inside the bitmap;
+// returns false if the queue is full
+static bool queue_bitmap_move(RF_Context* ctx, int x0, int y0, int x1, int y1, int dx, int dy, bool scroll) {
+    RF_BitmapMove* m;
+    if (ctx->pending_move_count) {
+        m = &ctx->pending_moves[ctx->pending_move_count - 1];
+        if (scroll && m->scroll
+        && (m->area.ul.x == x0) && (m->area.ul.y == y0) && (m->area.lr.x == x1) && (m->area.lr.y == y1)) {
+            // the same region has been scrolled again -> merge both moves
+            // (cells that are scrolled in are always redrawn, so it doesn't
+            // matter what pixels end up there)
+            dx += m->dx;  if (dx > (x1 - x0)) { dx = x1 - x0; }  if (dx < (x0 - x1)) { dx = x0 - x1; }
+            dy += m->dy;  if (dy > (y1 - y0)) { dy = y1 - y0; }  if (dy < (y0 - y1)) { dy = y0 - y1; }
+            m->dx = (int16_t)dx;
+            m->dy = (int16_t)dy;
+            return true;
+        }
+    }
+    if (ctx->pending_move_count >= RF_MAX_PENDING_MOVES) { return false; }
+    m = &ctx->pending_moves[ctx->pending_move_count++];
+    m->area.ul.x = (uint16_t)x0;  m->area.ul.y = (uint16_t)y0;
+    m->area.lr.x = (uint16_t)x1;  m->area.lr.y = (uint16_t)y1;
+    m->dx = (int16_t)dx;
+    m->dy = (int16_t)dy;
+    m->scroll = scroll;
+    return true;
+}
+
+// move the dirty and blink state of w*h cells along with their pixels
+static void move_cell_state(RF_Context* ctx, int sx, int sy, int tx, int ty, int w, int h) {
+    int xstep = (tx > sx) ? -1 : 1, ystep = (ty > sy) ? -1 : 1;
+    for (int n = h, yi = (ystep < 0) ? (h - 1) : 0;  n;  --n, yi += ystep) {
+        int src_row = sy + yi, dest_row = ty + yi;
+        if (ctx->row_epoch[dest_row] != ctx->dirty_epoch) { continue; }  // redrawn entirely anyway
+        if (ctx->row_epoch[src_row] != ctx->dirty_epoch) {
+            // the source pixels are outdated
+            mark_dirty_span(ctx, (uint16_t)dest_row, (uint16_t)tx, (uint16_t)(tx + w));
+            continue;
+        }
+        const uint32_t *src_dirty = &ctx->dirty_map[src_row * ctx->cell_map_pitch];
+        const uint32_t *src_blink = &ctx->blink_map[src_row * ctx->cell_map_pitch];
+        uint32_t *dest_dirty = &ctx->dirty_map[dest_row * ctx->cell_map_pitch];
+        uint32_t *dest_blink = &ctx->blink_map[dest_row * ctx->cell_map_pitch];
+        for (int m = w, xi = (xstep < 0) ? (w - 1) : 0;  m;  --m, xi += xstep) {
+            int s = sx + xi, d = tx + xi;
+            uint32_t sbit = 1u << (s & 31), dbit = 1u << (d & 31);
+            if (src_dirty[s >> 5] & sbit) { dest_dirty[d >> 5] |= dbit; } else { dest_dirty[d >> 5] &= ~dbit; }
+            if (src_blink[s >> 5] & sbit) {
+                if (!(dest_blink[d >> 5] & dbit)) { dest_blink[d >> 5] |= dbit;   ++ctx->blink_row_count[dest_row]; }
+            } else {
+                if (dest_blink[d >> 5] & dbit)    { dest_blink[d >> 5] &= ~dbit;  --ctx->blink_row_count[dest_row]; }
+            }
+        }
+    }
+}
+
+// after w*h cells have been copied (or scrolled within 'area'), move their
+// rendered pixels along instead of redrawing them
+static void move_rendered_cells(RF_Context* ctx, int sx, int sy, int tx, int ty, int w, int h, const RF_Rect* area) {
+    bool cursor_valid = (ctx->cursor_pos.x < ctx->screen_size.x) && (ctx->cursor_pos.y < ctx->screen_size.y);
+    bool queued;
+    // the cursor is drawn into the bitmap, so it must be removed from the moved pixels
+    if (cursor_valid) { mark_dirty(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y); }
+    queued = area ? queue_bitmap_move(ctx, area->ul.x, area->ul.y, area->lr.x, area->lr.y, tx - sx, ty - sy, true)
+                  : queue_bitmap_move(ctx, sx, sy, sx + w, sy + h, tx - sx, ty - sy, false);
+    if (queued) {
+        move_cell_state(ctx, sx, sy, tx, ty, w, h);
+    } else {
+        RF_InvalidateRegionPS(ctx, tx, ty, w, h);
+    }
+    if (cursor_valid) { mark_dirty(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y); }
+}
+
+// copy w*h cells (coordinates must be valid)
+static void copy_cells(RF_Context* ctx, int sx, int sy, int tx, int ty, int w, int h) {
+    // copy row by row (memmove takes care of horizontal overlap);
+    // go bottom-up if the destination is below the source
+    int ydir = (sy < ty) ? -1 : 1;
+    int y = (ydir < 0) ? (h - 1) : 0;
+    for (int n = h;  n;  --n) {
+        memmove((void*)CELL_PTR(ctx, tx, ty + y), (const void*)CELL_PTR(ctx, sx, sy + y), (size_t)w * ctx->cell_bytes);
+        y += ydir;
+    }
+}
+
 void RF_CopyRegionInt(RF_Context* ctx, int src_x0, int src_y0, int src_x1, int src_y1, int dest_x0, int dest_y0, int dest_x1, int dest_y1, const RF_Cell* attrib) {
     int pad_l = 0, pad_r = 0, pad_t = 0, pad_b = 0;
     int w, t, h;
 //printf("CR src=%d,%d~%d,%d(%dx%d) dest=%d,%d~%d,%d(%dx%d) pad=%d,%d~%d,%d\n", src_x0,src_y0,src_x1,src_y1,src_x1-src_x0,src_y1-src_y0, dest_x0,dest_y0,dest_x1,dest_y1,dest_x1-dest_x0,dest_y1-dest_y0, pad_l,pad_t,pad_r,pad_b);
-    if (!ctx || !ctx->screen) { return; }
+    if (!ctx || !ctx->cells) { return; }
     if (dest_x0 < 0) { src_x0 -= dest_x0; dest_x0 = 0; }
     if (dest_y0 < 0) { src_y0 -= dest_y0; dest_y0 = 0; }
     t = dest_x1 - ctx->screen_size.x;  if (t > 0) { src_x1 -= t; dest_x1 = ctx->screen_size.x; }
@@ -617,22 +1900,8 @@ void RF_CopyRegionInt(RF_Context* ctx, int src_x0, int src_y0, int src_x1, int s
     assert((src_x1 - src_x0) == w);
     assert((src_y1 - src_y0) == h);
     if ((w > 0) && (h > 0) && ((src_x0 != dest_x0) || (src_y0 != dest_y0))) {
-        const RF_Cell* p_src  = &ctx->screen[src_x0  + src_y0  * ctx->screen_size.x];
-              RF_Cell* p_dest = &ctx->screen[dest_x0 + dest_y0 * ctx->screen_size.x];
-        int xdir = 1, stride = ctx->screen_size.x;
-        if (src_x0 < dest_x0) { p_src +=  w - 1;           p_dest +=  w - 1;           xdir = -1; }
-        if (src_y0 < dest_y0) { p_src += (h - 1) * stride; p_dest += (h - 1) * stride; stride = -stride; }
-        stride -= xdir * w;
-        for (int y = h;  y;  --y) {
-            for (int x = w;  x;  --x) {
-                *p_dest = *p_src;
-                p_dest->dirty = 1;
-                p_src  += xdir;
-                p_dest += xdir;
-            }
-            p_src  += stride;
-            p_dest += stride;
-        }
+        copy_cells(ctx, src_x0, src_y0, dest_x0, dest_y0, w, h);
+        move_rendered_cells(ctx, src_x0, src_y0, dest_x0, dest_y0, w, h, NULL);
     }
     if (pad_t) { RF_ClearRegionPS(ctx, dest_x0 - pad_l, dest_y0 - pad_t, pad_l + w + pad_r, pad_t, attrib); }
     if (pad_b) { RF_ClearRegionPS(ctx, dest_x0 - pad_l, dest_y1,         pad_l + w + pad_r, pad_b, attrib); }
@@ -646,15 +1915,105 @@ void RF_CopyRegionPS(RF_Context* ctx, int src_x0, int src_y0, int dest_x0, int d
     RF_CopyRegionInt(ctx, src_x0,src_y0, src_x0+w,src_y0+h, dest_x0,dest_y0, dest_x0+w,dest_y0+h, attrib);
 }
 
+// push the top 'count' rows of the screen into the scrollback buffer
+static void save_scrollback_lines(RF_Context* ctx, int count) {
+    RF_Cell* line = IS_COMPACT(ctx) ? ctx->history_rows : NULL;
+    for (int y = 0;  y < count;  ++y) {
+        const uint8_t* row = CELL_PTR(ctx, 0, y);
+        if (line) {
+            for (uint16_t x = 0;  x < ctx->screen_size.x;  ++x) {
+                load_cell(ctx, &row[x * sizeof(RF_CompactCell)], &line[x]);
+            }
+        }
+        RF_ScrollbackPush(ctx->scrollback, line ? line : (const RF_Cell*) row, ctx->screen_size.x);
+    }
+    if (ctx->scrollback_view) {
+        // keep the view at the same content
+        ctx->scrollback_view += (uint32_t)count;
+    }
+}
+
+static void reverse_row_map(uint16_t* a, int n) {
+    for (int i = 0, j = n - 1;  i < j;  ++i, --j) {
+        uint16_t t = a[i];  a[i] = a[j];  a[j] = t;
+    }
+}
+
+// move the dirty and blink state of rows y0...y1-1 up (dy < 0) or down
+// (dy > 0) by n = abs(dy) rows, where 0 < n < y1-y0
+static void move_row_state(RF_Context* ctx, int y0, int y1, int dy) {
+    int n = (dy < 0) ? -dy : dy, keep = y1 - y0 - n;
+    int src = (dy < 0) ? (y0 + n) : y0, dest = src + dy, vacated = (dy < 0) ? (y1 - n) : y0;
+    size_t map_row = ctx->cell_map_pitch * sizeof(uint32_t);
+    memmove((void*)&ctx->dirty_map[dest * ctx->cell_map_pitch], (const void*)&ctx->dirty_map[src * ctx->cell_map_pitch], keep * map_row);
+    memmove((void*)&ctx->blink_map[dest * ctx->cell_map_pitch], (const void*)&ctx->blink_map[src * ctx->cell_map_pitch], keep * map_row);
+    memmove((void*)&ctx->row_epoch[dest], (const void*)&ctx->row_epoch[src], keep * sizeof(uint32_t));
+    memmove((void*)&ctx->blink_row_count[dest], (const void*)&ctx->blink_row_count[src], keep * sizeof(uint16_t));
+    memset((void*)&ctx->blink_map[vacated * ctx->cell_map_pitch], 0, n * map_row);
+    memset((void*)&ctx->blink_row_count[vacated], 0, n * sizeof(uint16_t));
+}
+
+// scroll full-width rows y0...y1-1 vertically by rotating the row map
+// (coordinates must be valid)
+static void scroll_rows(RF_Context* ctx, int y0, int y1, int dy, const RF_Cell* attrib) {
+    int n = (dy < 0) ? -dy : dy;
+    if (ctx->scrollback && !y0 && (dy < 0)) {
+        // rows scrolled off the top of the screen go into the scrollback buffer
+        save_scrollback_lines(ctx, (n < y1) ? n : y1);
+    }
+    if (n < (y1 - y0)) {
+        bool cursor_valid = (ctx->cursor_pos.x < ctx->screen_size.x) && (ctx->cursor_pos.y < ctx->screen_size.y);
+        // rotate the storage rows, so the ones that scrolled out are re-used for the new lines
+        uint16_t* rows = &ctx->row_map[y0];
+        int shift = (dy < 0) ? n : (y1 - y0 - n);
+        reverse_row_map(rows, shift);
+        reverse_row_map(&rows[shift], y1 - y0 - shift);
+        reverse_row_map(rows, y1 - y0);
+        // move the rendered pixels along
+        if (cursor_valid) { mark_dirty(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y); }
+        if (queue_bitmap_move(ctx, 0, y0, ctx->screen_size.x, y1, 0, dy, true)) {
+            move_row_state(ctx, y0, y1, dy);
+        } else {
+            RF_InvalidateRegionAB(ctx, 0, y0, ctx->screen_size.x, y1);
+        }
+        if (cursor_valid) { mark_dirty(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y); }
+    }
+    if (dy < 0) {
+        RF_ClearRegionAB(ctx, 0, (n < (y1 - y0)) ? (y1 - n) : y0, ctx->screen_size.x, y1, attrib);
+    } else {
+        RF_ClearRegionAB(ctx, 0, y0, ctx->screen_size.x, (n < (y1 - y0)) ? (y0 + n) : y1, attrib);
+    }
+}
+
 void RF_ScrollRegionAB(RF_Context* ctx, int x0, int y0, int x1, int y1, int dx, int dy, const RF_Cell* attrib) {
-    int sx0 = x0, sy0 = y0, tx0 = x0, ty0 = y0, w = x1 - x0, h = y1 - y0;
-//printf("SR %d,%d~%d,%d(%dx%d) by %d,%d\n", x0,y0, x1,y1, w,h, dx,dy);
-    if (!ctx || !ctx->screen || (!dx && !dy) || (w <= 0) || (h <= 0)) { return; }
+    int sx0, sy0, tx0, ty0, w, h;
+//printf("SR %d,%d~%d,%d(%dx%d) by %d,%d\n", x0,y0, x1,y1, x1-x0,y1-y0, dx,dy);
+    if (!ctx || !ctx->cells || (!dx && !dy)) { return; }
+    // clip the region to the screen (anything that would be scrolled in
+    // from outside the screen is cleared anyway)
+    if (x0 < 0) { x0 = 0; }
+    if (y0 < 0) { y0 = 0; }
+    if (x1 > ctx->screen_size.x) { x1 = ctx->screen_size.x; }
+    if (y1 > ctx->screen_size.y) { y1 = ctx->screen_size.y; }
+    if ((x1 <= x0) || (y1 <= y0)) { return; }
+    if (!dx && !x0 && (x1 == ctx->screen_size.x)) {
+        scroll_rows(ctx, y0, y1, dy, attrib);
+        return;
+    }
+    sx0 = tx0 = x0;  sy0 = ty0 = y0;  w = x1 - x0;  h = y1 - y0;
     if (dx > 0) { tx0 += dx; w -= dx; }
     if (dx < 0) { sx0 -= dx; w += dx; }
     if (dy > 0) { ty0 += dy; h -= dy; }
     if (dy < 0) { sy0 -= dy; h += dy; }
-    RF_CopyRegionPS(ctx, sx0,sy0, tx0,ty0, w,h, attrib);
+    if ((w > 0) && (h > 0)) {
+        RF_Rect area;
+        area.ul.x = (uint16_t)x0;  area.ul.y = (uint16_t)y0;
+        area.lr.x = (uint16_t)x1;  area.lr.y = (uint16_t)y1;
+        copy_cells(ctx, sx0, sy0, tx0, ty0, w, h);
+        move_rendered_cells(ctx, sx0, sy0, tx0, ty0, w, h, &area);
+    } else {
+        w = h = 0;  tx0 = x0;  ty0 = y0;  // everything is scrolled out
+    }
     RF_ClearRegionAB(ctx, x0,ty0,  tx0,ty0+h, attrib);  // left
     RF_ClearRegionAB(ctx, tx0+w,y0, x1,ty0+h, attrib);  // right
     RF_ClearRegionAB(ctx, x0,y0,    x1,ty0, attrib);  // top
@@ -667,21 +2026,142 @@ void RF_ScrollRegionPS(RF_Context* ctx, int x0, int y0, int w, int h, int dx, in
 ///////////////////////////////////////////////////////////////////////////////
 
 extern bool RF_ParseInternalMarkup(RF_Context* ctx, uint8_t c);
-extern bool RF_ParseANSIMarkup(RF_Context* ctx, uint8_t c);
+extern bool RF_RunInternalMarkupCommand(RF_Context* ctx, uint8_t letter, uint32_t value);
+extern size_t RF_ParseANSIMarkup(RF_Context* ctx, const uint8_t* data, const uint8_t* end);
+extern size_t RF_UTF8ValidPrefix(const uint8_t* data, size_t len);
 
-void RF_AddText(RF_Context* ctx, const char* str, const RF_Charset* charset, RF_MarkupType mt) {
-    const uint32_t* charmap = charset ? charset->charmap : NULL;
-    if (!ctx || !ctx->screen || !ctx->system || !str || !str[0]) { return; }
-    if (mt == RF_MT_AUTO) { mt = RF_DetectMarkupType(str); }
-    for (;;) {
-        uint8_t c = (uint8_t) *str++;
-        if (!c) { return; }  // end of string
+// decode a UTF-8 sequence that has been checked by RF_UTF8ValidPrefix();
+// returns the sequence length
+static inline size_t decode_utf8(const uint8_t* p, uint32_t* codepoint) {
+    uint8_t c = *p;
+    if (c < 0xE0) { *codepoint = ((uint32_t)(c & 0x1F) <<  6) |  (uint32_t)(p[1] & 0x3F);  return 2; }
+    if (c < 0xF0) { *codepoint = ((uint32_t)(c & 0x0F) << 12) | ((uint32_t)(p[1] & 0x3F) << 6) | (uint32_t)(p[2] & 0x3F);  return 3; }
+    *codepoint = ((uint32_t)(c & 0x07) << 18) | ((uint32_t)(p[1] & 0x3F) << 12) | ((uint32_t)(p[2] & 0x3F) << 6) | (uint32_t)(p[3] & 0x3F);
+    return 4;
+}
+
+// get the next character of a run for add_printable_run(); returns the
+// number of bytes used (0 = the run ends here); without a character map,
+// UTF-8 sequences are decoded as well, but anything malformed or incomplete
+// is left to the regular decoder
+static inline size_t next_run_char(const uint8_t* p, const uint8_t* end, const uint8_t** valid_end, size_t max_chars, const uint32_t* charmap, uint8_t esc_byte, uint32_t* codepoint) {
+    uint32_t cp = *p;
+    size_t n = 1;
+    if ((cp < 32) || (cp == 127) || (cp == esc_byte)) { return 0; }
+    if (charmap) {
+        cp = charmap[cp];
+        if ((cp < 32) || (cp == 127)) { return 0; }
+    } else if (cp > 127) {
+        if (p >= *valid_end) {
+            // validate (at most) as many bytes as the rest of the line can take
+            size_t len = (size_t)(end - p);
+            if (len > (4 * max_chars)) { len = 4 * max_chars; }
+            *valid_end = p + RF_UTF8ValidPrefix(p, len);
+            if (p >= *valid_end) { return 0; }
+        }
+        n = decode_utf8(p, &cp);
+        if ((cp < 32) || (cp == 127)) { return 0; }  // overlong control character
+    }
+    *codepoint = cp;
+    return n;
+}
+
+// fast path for runs of printable characters: store as many characters from
+// data...end-1 as fit into the current line *without* reaching its end (so
+// no wrapping or scrolling can happen), with the current attribute, and
+// return the number of bytes consumed (0 = not applicable, use RF_AddChar)
+static size_t add_printable_run(RF_Context* ctx, const uint8_t* data, const uint8_t* end, const uint32_t* charmap, uint8_t esc_byte) {
+    uint16_t x0 = ctx->cursor_pos.x, y = ctx->cursor_pos.y;
+    size_t max_count, count = 0, n;
+    const uint8_t *p = data, *valid_end = data;  // bytes before valid_end are known-good UTF-8
+    uint32_t cp = 0;
+    uint8_t* pos;
+    if (ctx->insert || (y >= ctx->screen_size.y) || ((x0 + 1) >= ctx->screen_size.x)) { return 0; }
+    max_count = (size_t)(ctx->screen_size.x - 1 - x0);
+    pos = CELL_PTR(ctx, x0, y);
+    if (IS_COMPACT(ctx)) {
+        RF_CompactCell* cell = (RF_CompactCell*) pos;
+        uint32_t attr;
+        // decode the first character before interning the attribute, so
+        // that runs that end right away (e.g. at an escape code) don't pay for it
+        n = (p < end) ? next_run_char(p, end, &valid_end, max_count, charmap, esc_byte, &cp) : 0;
+        if (!n) { return 0; }
+        attr = intern_attrib(ctx, &ctx->attrib);
+        for (;;) {
+            cell[count].codepoint = cp;
+            cell[count].attr = attr;
+            p += n;
+            if ((++count >= max_count) || (p >= end)) { break; }
+            n = next_run_char(p, end, &valid_end, max_count - count, charmap, esc_byte, &cp);
+            if (!n) { break; }
+        }
+    } else {
+        RF_Cell* cell = (RF_Cell*) pos;
+        const RF_Cell tmpl = ctx->attrib;
+        for (;  (count < max_count) && (p < end);  ++count) {
+            n = next_run_char(p, end, &valid_end, max_count - count, charmap, esc_byte, &cp);
+            if (!n) { break; }
+            cell[count] = tmpl;
+            cell[count].codepoint = cp;
+            p += n;
+        }
+    }
+    if (count) {
+        // the old cursor position, all written cells and the new cursor position
+        mark_dirty_span(ctx, y, x0, (uint16_t)(x0 + count + 1));
+        ctx->cursor_pos.x = (uint16_t)(x0 + count);
+    }
+    return (size_t)(p - data);
+}
+
+// same as add_printable_run(), but for already decoded codepoints (i.e. a
+// precompiled default screen); stops at control codes and commands
+static size_t add_codepoint_run(RF_Context* ctx, const uint32_t* cps) {
+    uint16_t x0 = ctx->cursor_pos.x, y = ctx->cursor_pos.y;
+    size_t max_count, count = 0;
+    uint8_t* pos;
+    if (ctx->insert || (y >= ctx->screen_size.y) || ((x0 + 1) >= ctx->screen_size.x)) { return 0; }
+    max_count = (size_t)(ctx->screen_size.x - 1 - x0);
+    pos = CELL_PTR(ctx, x0, y);
+    #define IS_RUN_CHAR(cp) (((cp) >= 32) && ((cp) != 127) && ((cp) < RF_SCREEN_CMD(0)))
+    if (IS_COMPACT(ctx)) {
+        RF_CompactCell* cell = (RF_CompactCell*) pos;
+        uint32_t attr = IS_RUN_CHAR(cps[0]) ? intern_attrib(ctx, &ctx->attrib) : 0;  // (only if the run isn't empty)
+        for (;  (count < max_count) && IS_RUN_CHAR(cps[count]);  ++count) {
+            cell[count].codepoint = cps[count];
+            cell[count].attr = attr;
+        }
+    } else {
+        RF_Cell* cell = (RF_Cell*) pos;
+        const RF_Cell tmpl = ctx->attrib;
+        for (;  (count < max_count) && IS_RUN_CHAR(cps[count]);  ++count) {
+            cell[count] = tmpl;
+            cell[count].codepoint = cps[count];
+        }
+    }
+    #undef IS_RUN_CHAR
+    if (count) {
+        mark_dirty_span(ctx, y, x0, (uint16_t)(x0 + count + 1));
+        ctx->cursor_pos.x = (uint16_t)(x0 + count);
+    }
+    return count;
+}
+
+// feed a range of bytes into the markup and UTF-8 parsers; all parser state
+// lives in the context, so this can be resumed at any byte boundary
+static void parse_bytes(RF_Context* ctx, const uint8_t* data, const uint8_t* end, const uint32_t* charmap, RF_MarkupType mt) {
+    while (data < end) {
+        uint8_t c = *data++;
 
         if (ctx->esc_count) {
             bool res;
+            if (mt == RF_MT_ANSI) {
+                // the ANSI parser takes as many bytes of the sequence as there are
+                data += RF_ParseANSIMarkup(ctx, data - 1, end) - 1;
+                continue;
+            }
             switch (mt) {
                 case RF_MT_INTERNAL: res = RF_ParseInternalMarkup(ctx, c); break;
-                case RF_MT_ANSI:     res = RF_ParseANSIMarkup(ctx, c);     break;
                 default:             res = true;  // unknown markup type -> exit markup mode
             }
             if (res) {
@@ -709,7 +2189,11 @@ void RF_AddText(RF_Context* ctx, const char* str, const RF_Charset* charset, RF_
             }
         }
 
-        // handle normal byte
+        // handle normal byte, trying the fast path for printable runs first
+        {
+            size_t run = add_printable_run(ctx, data - 1, end, charmap, (uint8_t)mt);
+            if (run) { data += run - 1;  continue; }
+        }
         if (c == (uint8_t)mt) {
             // begin of escape sequence
             ctx->esc_count = 1;
@@ -744,12 +2228,71 @@ void RF_AddText(RF_Context* ctx, const char* str, const RF_Charset* charset, RF_
     }
 }
 
+void RF_AddText(RF_Context* ctx, const char* str, const RF_Charset* charset, RF_MarkupType mt) {
+    if (!ctx || !ctx->cells || !ctx->system || !str || !str[0]) { return; }
+    if (mt == RF_MT_AUTO) { mt = RF_DetectMarkupType(str); }
+    parse_bytes(ctx, (const uint8_t*)str, (const uint8_t*)&str[strlen(str)], charset ? charset->charmap : NULL, mt);
+}
+
+void RF_Feed(RF_Context* ctx, const void* data, size_t len, const RF_Charset* charset, RF_MarkupType mt) {
+    if (!ctx || !ctx->cells || !ctx->system || !data || !len) { return; }
+    if (mt == RF_MT_AUTO) {
+        // stick with the first markup type that has been detected in the stream
+        if (!ctx->feed_markup) {
+            mt = RF_DetectMarkupTypeEx(data, len);
+            if (mt != RF_MT_NONE) { ctx->feed_markup = (uint8_t)mt; }
+        } else {
+            mt = (RF_MarkupType)ctx->feed_markup;
+        }
+    }
+    parse_bytes(ctx, (const uint8_t*)data, &((const uint8_t*)data)[len], charset ? charset->charmap : NULL, mt);
+}
+
+extern const uint32_t* const RF_DefaultScreenOps[];  // (generated along with RF_SystemList)
+
+bool RF_LoadDefaultScreen(RF_Context* ctx) {
+    const uint32_t* op = NULL;
+    if (!ctx || !ctx->cells || !ctx->system) { return false; }
+    RF_ClearAll(ctx);
+    RF_MoveCursor(ctx, 0, 0);
+    RF_ResetParser(ctx);
+    if (!ctx->system->default_screen) { return false; }
+
+    // find the precompiled version of the screen
+    for (const RF_System* const* p_sys = RF_SystemList;  *p_sys;  ++p_sys) {
+        if (*p_sys == ctx->system) {
+            op = RF_DefaultScreenOps[p_sys - RF_SystemList];
+            break;
+        }
+    }
+    if (!op) {
+        // not a built-in system (or markup that couldn't be precompiled)
+        RF_AddText(ctx, ctx->system->default_screen, NULL, RF_MT_INTERNAL);
+        return true;
+    }
+
+    // run the precompiled operations: codepoints, or commands with a value
+    while (*op) {
+        if (*op >= RF_SCREEN_CMD(0)) {
+            RF_RunInternalMarkupCommand(ctx, (uint8_t)(*op), op[1]);
+            op += 2;
+        } else {
+            size_t run = add_codepoint_run(ctx, op);
+            if (run) { op += run; }
+            else     { RF_AddChar(ctx, *op++); }
+        }
+    }
+    return true;
+}
+
 void RF_ResetParser(RF_Context* ctx) {
     if (!ctx) { return; }
     ctx->utf8_cb_count = ctx->esc_count = ctx->esc_remain = 0;
     memset((void*)ctx->num, 0, sizeof(ctx->num));
-    ctx->num_idx = ctx->esc_type = 0;
+    ctx->num_idx = ctx->esc_type = ctx->esc_collect = 0;
     ctx->esc_class = NULL;
+    ctx->feed_markup = 0;
+    reset_terminal_state(ctx);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -795,47 +2338,21 @@ uint32_t RF_MapStandardColorToRGB(uint32_t color, uint8_t std0, uint8_t std1, ui
 
 void RF_InvalidatePalette(RF_Context* ctx) {
     if (ctx) {
-        memset(ctx->pal_cache, 0xFF, sizeof(ctx->pal_cache));
+        ctx->pal_lut = NULL;
+        ctx->pal_lut_key = NULL;
+        ctx->pal_lut_size = 0;
     }
 }
 
 uint32_t RF_PaletteLookup(RF_Context* ctx, const uint32_t* pal, uint32_t pal_size, uint32_t color) {
-    uint32_t best_index = 0;
-    uint32_t best_dist = 0x3FFFF;
-    uint32_t cache_idx = 0;
-    uint32_t mask = 0xFFFFFF;
     if (!pal || !pal_size) { return 0; }
-
-    // cache initialization and check
     if (ctx) {
-        cache_idx = ((RF_COLOR_R(color) >> (8 - RF_PAL_CACHE_BITS)) << (RF_PAL_CACHE_BITS * 2))
-                  | ((RF_COLOR_G(color) >> (8 - RF_PAL_CACHE_BITS)) <<  RF_PAL_CACHE_BITS)
-                  |  (RF_COLOR_B(color) >> (8 - RF_PAL_CACHE_BITS));
-        best_index = ctx->pal_cache[cache_idx];
-        if (best_index < 0xFF) { return best_index; }
-        mask = (0xFF << (8 - RF_PAL_CACHE_BITS)) & 0xFF;
-        mask |= (mask << 8) | (mask << 16);
-        color &= mask;
-    }
-
-    // main search loop
-    for (uint32_t index = 0;  index < pal_size;  ++index) {
-        uint32_t check = pal[index] & mask;
-        int32_t cdist = (check & 0xFF) - (color & 0xFF);
-        uint32_t dist = (uint32_t)(cdist * cdist);
-        cdist = ((check >> 8) & 0xFF) - ((color >> 8) & 0xFF);
-        dist += (uint32_t)(cdist * cdist);
-        cdist = ((check >> 16) & 0xFF) - ((color >> 16) & 0xFF);
-        dist += (uint32_t)(cdist * cdist);
-        if (dist < best_dist) {
-            best_dist = dist;
-            best_index = index;
-        }
-    }
-
-    // cache finalization
-    if (ctx && (best_index < 0xFF)) {
-        ctx->pal_cache[cache_idx] = (uint8_t)best_index;
-    }
-    return best_index;
+        if ((pal != ctx->pal_lut_key) || (pal_size != ctx->pal_lut_size)) {
+            ctx->pal_lut = RF_GetPaletteLUT(pal, pal_size);
+            ctx->pal_lut_key = pal;
+            ctx->pal_lut_size = pal_size;
+        }
+        if (ctx->pal_lut) { return RF_PaletteLUTLookup(ctx->pal_lut, color); }
+    }
+    return RF_PaletteSearch(pal, pal_size, color);
 }
@@ -0,0 +1,128 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "retrofont.h"
+
+// Shared palette lookup tables: for each palette that is used with
+// RF_PaletteLookup(), a table that maps every color (reduced to
+// RF_PAL_LUT_BITS bits per component) to the index of the nearest palette
+// entry is built on first use. The tables are immutable after that and
+// shared by all contexts; they are identified by the palette's contents.
+// The tables are freed when the last context is destroyed.
+
+extern void RF_LockGlobal(void);
+extern void RF_UnlockGlobal(void);
+
+#define LUT_SIZE (1u << (3 * RF_PAL_LUT_BITS))
+
+typedef struct s_RF_PaletteLUT {
+    struct s_RF_PaletteLUT* next;  //!< next table in the registry
+    uint32_t pal_size;             //!< number of palette entries
+    uint32_t *pal;                 //!< copy of the palette
+    uint8_t *index8;               //!< lookup table for palettes with up to 256 entries (else NULL)
+    uint16_t *index16;             //!< lookup table for larger palettes (else NULL)
+} RF_PaletteLUT;
+
+static RF_PaletteLUT* lut_registry = NULL;
+static int lut_users = 0;  //!< number of contexts that may hold pointers into the registry
+
+static uint32_t nearest_color(const uint32_t* pal, uint32_t pal_size, uint32_t color) {
+    uint32_t best_index = 0;
+    uint32_t best_dist = 0xFFFFFFFFu;
+    for (uint32_t index = 0;  index < pal_size;  ++index) {
+        int32_t cdist = (int32_t)RF_COLOR_R(pal[index]) - (int32_t)RF_COLOR_R(color);
+        uint32_t dist = (uint32_t)(cdist * cdist);
+        cdist = (int32_t)RF_COLOR_G(pal[index]) - (int32_t)RF_COLOR_G(color);
+        dist += (uint32_t)(cdist * cdist);
+        cdist = (int32_t)RF_COLOR_B(pal[index]) - (int32_t)RF_COLOR_B(color);
+        dist += (uint32_t)(cdist * cdist);
+        if (dist < best_dist) {
+            best_dist = dist;
+            best_index = index;
+        }
+    }
+    return best_index;
+}
+
+uint32_t RF_PaletteSearch(const uint32_t* pal, uint32_t pal_size, uint32_t color) {
+    return (pal && pal_size) ? nearest_color(pal, pal_size, color & 0xFFFFFFu) : 0;
+}
+
+static RF_PaletteLUT* build_lut(const uint32_t* pal, uint32_t pal_size) {
+    RF_PaletteLUT* lut = (RF_PaletteLUT*) calloc(1, sizeof(RF_PaletteLUT));
+    if (!lut) { return NULL; }
+    lut->pal_size = pal_size;
+    lut->pal = (uint32_t*) malloc(pal_size * sizeof(uint32_t));
+    if (pal_size > 256u) {
+        lut->index16 = (uint16_t*) malloc(LUT_SIZE * sizeof(uint16_t));
+    } else {
+        lut->index8 = (uint8_t*) malloc(LUT_SIZE);
+    }
+    if (!lut->pal || (!lut->index8 && !lut->index16)) {
+        free((void*)lut->pal);  free((void*)lut->index8);  free((void*)lut->index16);
+        free((void*)lut);
+        return NULL;
+    }
+    for (uint32_t i = 0;  i < pal_size;  ++i) { lut->pal[i] = pal[i] & 0xFFFFFFu; }
+    // map the center of each color cube cell
+    for (uint32_t i = 0;  i < LUT_SIZE;  ++i) {
+        const uint32_t cmask = (1u << RF_PAL_LUT_BITS) - 1u, shift = 8 - RF_PAL_LUT_BITS, half = (1u << shift) >> 1;
+        uint32_t color = RF_COLOR_RGB((((i >> (2 * RF_PAL_LUT_BITS)) & cmask) << shift) | half,
+                                      (((i >>      RF_PAL_LUT_BITS)  & cmask) << shift) | half,
+                                      (( i                           & cmask) << shift) | half);
+        uint32_t index = nearest_color(lut->pal, pal_size, color);
+        if (lut->index16) { lut->index16[i] = (uint16_t)index; } else { lut->index8[i] = (uint8_t)index; }
+    }
+    return lut;
+}
+
+const void* RF_GetPaletteLUT(const uint32_t* pal, uint32_t pal_size) {
+    RF_PaletteLUT* lut;
+    if (!pal || !pal_size || (pal_size > 65536u)) { return NULL; }
+    RF_LockGlobal();
+    for (lut = lut_registry;  lut;  lut = lut->next) {
+        uint32_t i = 0;
+        if (lut->pal_size != pal_size) { continue; }
+        while ((i < pal_size) && (lut->pal[i] == (pal[i] & 0xFFFFFFu))) { ++i; }
+        if (i == pal_size) { break; }
+    }
+    if (!lut) {
+        lut = build_lut(pal, pal_size);
+        if (lut) {
+            lut->next = lut_registry;
+            lut_registry = lut;
+        }
+    }
+    RF_UnlockGlobal();
+    return (const void*)lut;
+}
+
+uint32_t RF_PaletteLUTLookup(const void* lut_, uint32_t color) {
+    const RF_PaletteLUT* lut = (const RF_PaletteLUT*) lut_;
+    const uint32_t shift = 8 - RF_PAL_LUT_BITS;
+    uint32_t i = ((uint32_t)(RF_COLOR_R(color) >> shift) << (2 * RF_PAL_LUT_BITS))
+               | ((uint32_t)(RF_COLOR_G(color) >> shift) <<      RF_PAL_LUT_BITS)
+               |  (uint32_t)(RF_COLOR_B(color) >> shift);
+    return lut->index16 ? lut->index16[i] : lut->index8[i];
+}
+
+void RF_AddPaletteLUTUser(void) {
+    RF_LockGlobal();
+    ++lut_users;
+    RF_UnlockGlobal();
+}
+
+void RF_RemovePaletteLUTUser(void) {
+    RF_LockGlobal();
+    if (!--lut_users) {
+        // nobody can use the tables anymore -> free them
+        while (lut_registry) {
+            RF_PaletteLUT* lut = lut_registry;
+            lut_registry = lut->next;
+            free((void*)lut->pal);  free((void*)lut->index8);  free((void*)lut->index16);
+            free((void*)lut);
+        }
+    }
+    RF_UnlockGlobal();
+}
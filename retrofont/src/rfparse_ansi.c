@@ -1,12 +1,13 @@
 #include <stdbool.h>
 #include <stdint.h>
-#include <stdio.h>  // DEBUG
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 
 #include "retrofont.h"
 
+extern bool RF_CountDiagnostic(RF_Context* ctx, RF_Diagnostic diag);
+
 static void SGR_ext(RF_Context* ctx, uint8_t* p_i, uint32_t* p_color) {
     if ((*p_i + 1) >= RF_MAX_NUMS) { return; }
     (*p_i)++;
@@ -83,63 +84,367 @@ static void handle_SGR(RF_Context* ctx) {
             case 106: ctx->attrib.fg = RF_COLOR_CYAN    | RF_COLOR_BRIGHT; break;
             case 107: ctx->attrib.fg = RF_COLOR_WHITE   | RF_COLOR_BRIGHT; break;
             default:
-                #ifndef _NDEBUG
-                    printf("unrecognized CSI SGR code %u\n", n);
-                #endif
+                if (RF_CountDiagnostic(ctx, RF_DIAG_ANSI_SGR)) {
+                    char text[16];
+                    snprintf(text, sizeof(text), "SGR %u", n);
+                    ctx->diag_func(ctx->diag_user, RF_DIAG_ANSI_SGR, text, ctx->diag_counts[RF_DIAG_ANSI_SGR]);
+                }
                 break;
         }
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
 
-bool RF_ParseANSIMarkup(RF_Context* ctx, uint8_t c) {
-    // handle initial character
-    if (ctx->esc_count == 1) {
-        memset((void*)ctx->num, 0, sizeof(ctx->num));
-        ctx->num_idx = ctx->esc_type = 0;
-        switch (c) {
-            case '[':
-                // start sequence capture
-                ctx->esc_type = c;
-                return false;
-            default:
-                return true;  // ignore invalid/unrecognized Escape sequence
-        }
+// The parser is a table-driven state machine after the DEC VT500 state
+// diagram (as documented by Paul Williams): each byte is mapped to a byte
+// class, and the current state and the byte class select an action and the
+// next state. The "ground" state (normal text) is implemented by the caller;
+// the ESC byte that leaves it is never passed to the parser, and the parser
+// clears ctx->esc_count when it goes back there.
+
+// byte classes
+enum {
+    C_CTL,  // C0 control characters (executed, even inside a sequence)
+    C_BEL,  // BEL (also ends OSC strings)
+    C_CAN,  // CAN, SUB (abort the sequence)
+    C_ESC,  // ESC (restart with a new sequence)
+    C_INT,  // intermediate bytes (0x20-0x2F)
+    C_DIG,  // digits
+    C_COL,  // colon (sub-parameters; not supported)
+    C_SEM,  // semicolon (parameter separator)
+    C_PRV,  // private parameter markers (0x3C-0x3F)
+    C_UPR,  // final bytes 0x40-0x5F, except for the ones below
+    C_DCS,  // 'P' (ESC P = DCS)
+    C_STR,  // 'X', '^', '_' (ESC X / ^ / _ = SOS, PM, APC)
+    C_CSI,  // '[' (ESC [ = CSI)
+    C_OSC,  // ']' (ESC ] = OSC)
+    C_FIN,  // final bytes 0x60-0x7E
+    C_DEL,  // DEL (ignored)
+    C_HI8,  // 0x80-0xFF (abort the sequence, except in strings)
+    NUM_BYTE_CLASSES
+};
+
+static const uint8_t ansi_byte_class[256] = {
+    C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_BEL, C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_CTL,  // 00-0F
+    C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_CTL, C_CAN, C_CTL, C_CAN, C_ESC, C_CTL, C_CTL, C_CTL, C_CTL,  // 10-1F
+    C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT, C_INT,  // 20-2F
+    C_DIG, C_DIG, C_DIG, C_DIG, C_DIG, C_DIG, C_DIG, C_DIG, C_DIG, C_DIG, C_COL, C_SEM, C_PRV, C_PRV, C_PRV, C_PRV,  // 30-3F
+    C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR,  // 40-4F
+    C_DCS, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_UPR, C_STR, C_UPR, C_UPR, C_CSI, C_UPR, C_OSC, C_STR, C_STR,  // 50-5F
+    C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN,  // 60-6F
+    C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_FIN, C_DEL,  // 70-7F
+    C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8,  // 80-8F
+    C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8,  // 90-9F
+    C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8,  // A0-AF
+    C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8,  // B0-BF
+    C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8,  // C0-CF
+    C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8,  // D0-DF
+    C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8,  // E0-EF
+    C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8, C_HI8,  // F0-FF
+};
+
+// parser states
+enum {
+    S_ESCAPE,        // after ESC
+    S_ESCAPE_INTER,  // ESC + intermediate byte(s)
+    S_CSI_ENTRY,     // after ESC [
+    S_CSI_PARAM,     // inside the parameters of a CSI sequence
+    S_CSI_INTER,     // CSI sequence + intermediate byte(s)
+    S_CSI_IGNORE,    // malformed CSI sequence, skipped up to its final byte
+    S_OSC_STRING,    // ESC ] ... (ends with BEL or ST)
+    S_STRING,        // ESC P / X / ^ / _ ... (ends with ST)
+    S_GROUND,        // end of sequence
+    S_SAME = 15      // (in transitions only) stay in the current state
+};
+
+// actions
+enum {
+    A_NONE,          // ignore the byte
+    A_EXECUTE,       // execute a C0 control character
+    A_CLEAR,         // start a new sequence
+    A_COLLECT,       // store private marker or intermediate byte
+    A_PARAM,         // add digit or separator to the parameters
+    A_ESC_DISPATCH,  // execute ESC sequence
+    A_CSI_DISPATCH,  // execute CSI sequence
+    A_STRING,        // start of a control string (which is skipped)
+};
+
+#define T(action, state) (uint8_t)(((action) << 4) | (state))
+#define Ig T(A_NONE,         S_SAME)
+#define Ex T(A_EXECUTE,      S_SAME)
+#define Gr T(A_NONE,         S_GROUND)
+#define Es T(A_CLEAR,        S_ESCAPE)
+#define Ei T(A_COLLECT,      S_ESCAPE_INTER)
+#define Ed T(A_ESC_DISPATCH, S_GROUND)
+#define Ce T(A_CLEAR,        S_CSI_ENTRY)
+#define Cp T(A_PARAM,        S_CSI_PARAM)
+#define Cm T(A_COLLECT,      S_CSI_PARAM)
+#define Ct T(A_COLLECT,      S_CSI_INTER)
+#define Ci T(A_NONE,         S_CSI_IGNORE)
+#define Cd T(A_CSI_DISPATCH, S_GROUND)
+#define Os T(A_STRING,       S_OSC_STRING)
+#define St T(A_STRING,       S_STRING)
+
+static const uint8_t ansi_transitions[S_GROUND][NUM_BYTE_CLASSES] = {
+    //  CTL BEL CAN ESC INT DIG COL SEM PRV UPR DCS STR CSI OSC FIN DEL HI8
+    {   Ex, Ex, Gr, Es, Ei, Ed, Ed, Ed, Ed, Ed, St, St, Ce, Os, Ed, Ig, Gr },  // S_ESCAPE
+    {   Ex, Ex, Gr, Es, Ei, Ed, Ed, Ed, Ed, Ed, Ed, Ed, Ed, Ed, Ed, Ig, Gr },  // S_ESCAPE_INTER
+    {   Ex, Ex, Gr, Es, Ct, Cp, Ci, Cp, Cm, Cd, Cd, Cd, Cd, Cd, Cd, Ig, Gr },  // S_CSI_ENTRY
+    {   Ex, Ex, Gr, Es, Ct, Cp, Ci, Cp, Ci, Cd, Cd, Cd, Cd, Cd, Cd, Ig, Gr },  // S_CSI_PARAM
+    {   Ex, Ex, Gr, Es, Ct, Ci, Ci, Ci, Ci, Cd, Cd, Cd, Cd, Cd, Cd, Ig, Gr },  // S_CSI_INTER
+    {   Ex, Ex, Gr, Es, Ig, Ig, Ig, Ig, Ig, Gr, Gr, Gr, Gr, Gr, Gr, Ig, Gr },  // S_CSI_IGNORE
+    {   Ig, Gr, Gr, Es, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig },  // S_OSC_STRING
+    {   Ig, Ig, Gr, Es, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig, Ig },  // S_STRING
+};
+
+#undef Ig
+#undef Ex
+#undef Gr
+#undef Es
+#undef Ei
+#undef Ed
+#undef Ce
+#undef Cp
+#undef Cm
+#undef Ct
+#undef Ci
+#undef Cd
+#undef Os
+#undef St
+
+///////////////////////////////////////////////////////////////////////////////
+
+// get a numeric parameter, with a default for missing or zero values
+static uint32_t get_param(const RF_Context* ctx, uint8_t i, uint32_t def) {
+    uint32_t n = (i <= ctx->num_idx) ? ctx->num[i] : 0;
+    return n ? n : def;
+}
+
+// report an unsupported sequence: rebuild its text from the parser state
+// (private markers, 0x3C-0x3F, are collected before the parameters;
+// intermediate bytes, 0x20-0x2F, after them)
+static void report_sequence(RF_Context* ctx, RF_Diagnostic diag, bool csi, uint8_t c) {
+    char text[96];
+    size_t len = 0;
+    bool inter = ctx->esc_collect && (ctx->esc_collect < 0x30);
+    #define APPEND(...) do { if (len < sizeof(text)) { int n_ = snprintf(&text[len], sizeof(text) - len, __VA_ARGS__); if (n_ > 0) { len += (size_t)n_; } } } while (0)
+    APPEND("ESC%s", csi ? " [" : "");
+    if (ctx->esc_collect && !inter) { APPEND(" %c", ctx->esc_collect); }
+    for (uint8_t i = 0;  csi && (i <= ctx->num_idx);  ++i) { APPEND("%s %u", i ? " ;" : "", ctx->num[i]); }
+    if (inter) { APPEND(" %c", ctx->esc_collect); }
+    APPEND(" %c", c);
+    #undef APPEND
+    ctx->diag_func(ctx->diag_user, diag, text, ctx->diag_counts[diag]);
+}
+
+// move the cursor, clipped to the screen
+static void move_cursor_clipped(RF_Context* ctx, int64_t x, int64_t y) {
+    if (x >= ctx->screen_size.x) { x = ctx->screen_size.x - 1; }
+    if (y >= ctx->screen_size.y) { y = ctx->screen_size.y - 1; }
+    if (x < 0) { x = 0; }
+    if (y < 0) { y = 0; }
+    RF_MoveCursor(ctx, (uint16_t)x, (uint16_t)y);
+}
+
+// scroll the rows from y0 to the bottom of the scrolling region by n lines
+// (n > 0 = down, n < 0 = up)
+static void scroll_lines(RF_Context* ctx, int y0, int64_t n) {
+    int h = ctx->margin_bottom - y0;
+    if (n >  h) { n =  h; }
+    if (n < -h) { n = -h; }
+    RF_ScrollRegionAB(ctx, 0, y0, ctx->screen_size.x, ctx->margin_bottom, 0, (int)n, &ctx->attrib);
+}
+
+// move the cursor down by a line, scrolling at the bottom of the scrolling region
+static void index_down(RF_Context* ctx) {
+    if ((ctx->cursor_pos.y + 1) == ctx->margin_bottom) {
+        scroll_lines(ctx, ctx->margin_top, -1);
+    } else {
+        move_cursor_clipped(ctx, ctx->cursor_pos.x, (int64_t)ctx->cursor_pos.y + 1);
     }
-    // switch from CSI to extended CSI
-    if ((ctx->esc_type == '[') && (c == '?') && (ctx->esc_count == 2)) {
-        ctx->esc_type = '?';
-        return false;
+}
+
+// move the cursor up by a line, scrolling at the top of the scrolling region
+static void index_up(RF_Context* ctx) {
+    if (ctx->cursor_pos.y == ctx->margin_top) {
+        scroll_lines(ctx, ctx->margin_top, 1);
+    } else {
+        move_cursor_clipped(ctx, ctx->cursor_pos.x, (int64_t)ctx->cursor_pos.y - 1);
     }
+}
 
-    // handle CSI sequence
-    if ((ctx->esc_type == '[') || (ctx->esc_type == '?')) {
-        if (isdigit(c)) {
-            uint32_t n = ctx->num[ctx->num_idx];
-            ctx->num[ctx->num_idx] = n * 10 + c - '0';
-            return (n > 429496729);
-        } else if (c == ';') {
-            return (ctx->num_idx++) >= RF_MAX_NUMS;
-        }
+static void esc_dispatch(RF_Context* ctx, uint8_t c) {
+    switch (ctx->esc_collect ? 0 : c) {  // (sequences with intermediates, e.g. character set designations, aren't supported)
+        case '7':  // DECSC: save cursor
+            ctx->saved_cursor = ctx->cursor_pos;
+            ctx->saved_attrib = ctx->attrib;
+            break;
+        case '8':  // DECRC: restore cursor
+            move_cursor_clipped(ctx, ctx->saved_cursor.x, ctx->saved_cursor.y);
+            ctx->attrib = ctx->saved_attrib;
+            break;
+        case 'D':  // IND: index
+            index_down(ctx);
+            break;
+        case 'E':  // NEL: next line
+            RF_MoveCursor(ctx, 0, ctx->cursor_pos.y);
+            index_down(ctx);
+            break;
+        case 'M':  // RI: reverse index
+            index_up(ctx);
+            break;
+        case 'c':  // RIS: reset to initial state
+            ctx->attrib = RF_EmptyCell;
+            RF_ClearScreen(ctx, NULL);  // (also resets the scrolling region and saved cursor)
+            RF_MoveCursor(ctx, 0, 0);
+            break;
+        case '\\':  // ST: string terminator (end of a skipped control string)
+            break;
+        default:
+            if (RF_CountDiagnostic(ctx, RF_DIAG_ANSI_ESC)) { report_sequence(ctx, RF_DIAG_ANSI_ESC, false, c); }
+            break;
     }
-    if (ctx->esc_type == '[') {
-        switch (c) {
-            case 'A': RF_MoveCursor(ctx, ctx->cursor_pos.x, (ctx->cursor_pos.y > ctx->num[0]) ? (uint16_t)(ctx->cursor_pos.y - ctx->num[0]) : 0); return true;
-            case 'B': RF_MoveCursor(ctx, ctx->cursor_pos.x, ((ctx->cursor_pos.y + ctx->num[0]) < ctx->screen_size.y) ? (uint16_t)(ctx->cursor_pos.y + ctx->num[0]) : (ctx->screen_size.y - 1)); return true;
-            case 'C': RF_MoveCursor(ctx, ((ctx->cursor_pos.x + ctx->num[0]) < ctx->screen_size.x) ? (uint16_t)(ctx->cursor_pos.x + ctx->num[0]) : (ctx->screen_size.x - 1), ctx->cursor_pos.y); return true;
-            case 'D': RF_MoveCursor(ctx, (ctx->cursor_pos.x > ctx->num[0]) ? (uint16_t)(ctx->cursor_pos.x - ctx->num[0]) : 0, ctx->cursor_pos.y); return true;
-            case 'm': handle_SGR(ctx); return true;
-            default: break;  // "unrecognized CSI sequence" error will be handled below
-        }
+}
+
+static void csi_dispatch(RF_Context* ctx, uint8_t c) {
+    int x = ctx->cursor_pos.x, y = ctx->cursor_pos.y;
+    int w = ctx->screen_size.x, h = ctx->screen_size.y;
+    uint32_t n = get_param(ctx, 0, 1);
+    if (!ctx->cells || !w || !h) { return; }
+    if (x >= w) { x = w - 1; }
+    if (y >= h) { y = h - 1; }
+    if (ctx->num_idx >= RF_MAX_NUMS) { ctx->num_idx = RF_MAX_NUMS - 1; }  // (parameter overflow)
+    switch (ctx->esc_collect ? 0 : c) {  // (sequences with private markers or intermediates aren't supported)
+        // cursor movement
+        case 'A': move_cursor_clipped(ctx, x, (int64_t)y - n);  return;  // CUU: cursor up
+        case 'B': move_cursor_clipped(ctx, x, (int64_t)y + n);  return;  // CUD: cursor down
+        case 'C': move_cursor_clipped(ctx, (int64_t)x + n, y);  return;  // CUF: cursor forward
+        case 'D': move_cursor_clipped(ctx, (int64_t)x - n, y);  return;  // CUB: cursor back
+        case 'E': move_cursor_clipped(ctx, 0, (int64_t)y + n);  return;  // CNL: cursor next line
+        case 'F': move_cursor_clipped(ctx, 0, (int64_t)y - n);  return;  // CPL: cursor previous line
+        case 'G': case '`': move_cursor_clipped(ctx, (int64_t)n - 1, y);  return;  // CHA, HPA: column absolute
+        case 'd': move_cursor_clipped(ctx, x, (int64_t)n - 1);  return;            // VPA: row absolute
+        case 'H': case 'f': move_cursor_clipped(ctx, (int64_t)get_param(ctx, 1, 1) - 1, (int64_t)n - 1);  return;  // CUP, HVP: position
+        case 's': ctx->saved_cursor = ctx->cursor_pos;  return;  // SCOSC: save cursor position
+        case 'u': move_cursor_clipped(ctx, ctx->saved_cursor.x, ctx->saved_cursor.y);  return;  // SCORC: restore cursor position
+
+        // erasing
+        case 'J':  // ED: erase in display
+            switch (get_param(ctx, 0, 0)) {
+                case 0:  RF_ClearRegionAB(ctx, x, y, w, y + 1, &ctx->attrib);
+                         RF_ClearRegionAB(ctx, 0, y + 1, w, h, &ctx->attrib);  return;
+                case 1:  RF_ClearRegionAB(ctx, 0, 0, w, y, &ctx->attrib);
+                         RF_ClearRegionAB(ctx, 0, y, x + 1, y + 1, &ctx->attrib);  return;
+                case 2:
+                case 3:  RF_ClearRegionAB(ctx, 0, 0, w, h, &ctx->attrib);  return;
+                default: break;
+            }
+            break;
+        case 'K':  // EL: erase in line
+            switch (get_param(ctx, 0, 0)) {
+                case 0:  RF_ClearRegionAB(ctx, x, y, w, y + 1, &ctx->attrib);  return;
+                case 1:  RF_ClearRegionAB(ctx, 0, y, x + 1, y + 1, &ctx->attrib);  return;
+                case 2:  RF_ClearRegionAB(ctx, 0, y, w, y + 1, &ctx->attrib);  return;
+                default: break;
+            }
+            break;
+        case 'X':  // ECH: erase characters
+            RF_ClearRegionAB(ctx, x, y, (n < (uint32_t)(w - x)) ? (x + (int)n) : w, y + 1, &ctx->attrib);
+            return;
+
+        // inserting and deleting
+        case '@':  // ICH: insert characters
+        case 'P':  // DCH: delete characters
+            if (n > (uint32_t)(w - x)) { n = (uint32_t)(w - x); }
+            RF_ScrollRegionAB(ctx, x, y, w, y + 1, (c == '@') ? (int)n : -(int)n, 0, &ctx->attrib);
+            return;
+        case 'L':  // IL: insert lines
+        case 'M':  // DL: delete lines
+            if ((y >= ctx->margin_top) && (y < ctx->margin_bottom)) {
+                scroll_lines(ctx, y, (c == 'L') ? (int64_t)n : -(int64_t)n);
+                RF_MoveCursor(ctx, 0, (uint16_t)y);
+            }
+            return;
+        case 'S':  // SU: scroll up
+            scroll_lines(ctx, ctx->margin_top, -(int64_t)n);
+            return;
+        case 'T':  // SD: scroll down
+            scroll_lines(ctx, ctx->margin_top, (int64_t)n);
+            return;
+
+        // other
+        case 'm':  // SGR: select graphic rendition
+            handle_SGR(ctx);
+            return;
+        case 'r': {  // DECSTBM: set scrolling region
+            uint32_t top = get_param(ctx, 0, 1), bottom = get_param(ctx, 1, (uint32_t)h);
+            if (bottom > (uint32_t)h) { bottom = (uint32_t)h; }
+            if (top < bottom) {
+                ctx->margin_top = (uint16_t)(top - 1);
+                ctx->margin_bottom = (uint16_t)bottom;
+                RF_MoveCursor(ctx, 0, 0);
+            }
+            return; }
+        default:
+            break;
     }
-    if ((ctx->esc_type == '[') || (ctx->esc_type == '?')) {
-        #ifndef _NDEBUG
-            printf("unrecognized CSI sequence: ESC [%s", (ctx->esc_type == '?') ? " ?" : "");
-            for (uint8_t i = 0;  i <= ctx->num_idx;  ++i) { printf("%s %d", i ? " ;" : "", ctx->num[i]); }
-            printf(" %c\n", c);
-        #endif
-        return true;
+    {
+        RF_Diagnostic diag = (ctx->esc_collect >= 0x30) ? RF_DIAG_ANSI_PRIVATE : RF_DIAG_ANSI_CSI;
+        if (RF_CountDiagnostic(ctx, diag)) { report_sequence(ctx, diag, true, c); }
     }
+}
 
-    return true;
+// parse the bytes of an ANSI escape sequence, up to the end of the sequence
+// or the data, whichever comes first; returns the number of bytes consumed
+// and resets ctx->esc_count at the end of the sequence
+size_t RF_ParseANSIMarkup(RF_Context* ctx, const uint8_t* data, const uint8_t* end) {
+    const uint8_t* p = data;
+    uint8_t state = ctx->esc_type;
+    if ((ctx->esc_count == 1) || (state >= S_GROUND)) {
+        // first byte after the ESC that started the sequence
+        state = S_ESCAPE;
+        ctx->esc_collect = 0;
+        ctx->esc_count = 2;
+    }
+    while ((p < end) && (state < S_GROUND)) {
+        uint8_t c = *p++;
+        uint8_t t = ansi_transitions[state][ansi_byte_class[c]];
+        if ((t & 15) != S_SAME) { state = t & 15; }
+        switch (t >> 4) {
+            case A_EXECUTE:
+                // same control characters as outside of sequences (except DEL)
+                if ((c == 8) || (c == 9) || (c == 10) || (c == 13)) { RF_AddChar(ctx, c); }
+                break;
+            case A_CLEAR:
+                memset((void*)ctx->num, 0, sizeof(ctx->num));
+                ctx->num_idx = ctx->esc_collect = 0;
+                break;
+            case A_COLLECT:
+                ctx->esc_collect = c;
+                break;
+            case A_PARAM:
+                if (c == ';') {
+                    if (ctx->num_idx < RF_MAX_NUMS) { ctx->num_idx++; }
+                } else if ((ctx->num_idx < RF_MAX_NUMS) && (ctx->num[ctx->num_idx] < 100000u)) {
+                    ctx->num[ctx->num_idx] = ctx->num[ctx->num_idx] * 10 + (uint32_t)(c - '0');
+                }
+                break;
+            case A_ESC_DISPATCH:
+                esc_dispatch(ctx, c);
+                break;
+            case A_CSI_DISPATCH:
+                csi_dispatch(ctx, c);
+                break;
+            case A_STRING:
+                ctx->esc_collect = 0;
+                if (RF_CountDiagnostic(ctx, RF_DIAG_ANSI_STRING)) { report_sequence(ctx, RF_DIAG_ANSI_STRING, false, c); }
+                break;
+            default:
+                break;
+        }
+    }
+    ctx->esc_type = state;
+    if (state >= S_GROUND) { ctx->esc_count = 0; }
+    return (size_t)(p - data);
 }
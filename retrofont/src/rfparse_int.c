@@ -1,10 +1,13 @@
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "retrofont.h"
 
+extern bool RF_CountDiagnostic(RF_Context* ctx, RF_Diagnostic diag);
+
 typedef struct s_RF_InternalMarkupCommand {
     uint8_t letter;  //!< first character of the command
     bool is_color;   //!< enable special processing for color values
@@ -13,6 +16,17 @@ typedef struct s_RF_InternalMarkupCommand {
     void (*finalize_func) (RF_Context*);  //!< function to call at the end of the sequence
 } RF_InternalMarkupCommand;
 
+// invalid sequence: show a replacement character and report it
+static void invalid_sequence(RF_Context* ctx, uint8_t letter, uint32_t c) {
+    RF_AddChar(ctx, 0xFFFD);
+    if (RF_CountDiagnostic(ctx, RF_DIAG_INTERNAL)) {
+        char text[16];
+        if (letter) { snprintf(text, sizeof(text), "`%c %02X", letter, c); }
+        else        { snprintf(text, sizeof(text), "`%02X", c); }
+        ctx->diag_func(ctx->diag_user, RF_DIAG_INTERNAL, text, ctx->diag_counts[RF_DIAG_INTERNAL]);
+    }
+}
+
 static void cmd_setxpos(RF_Context* ctx) {
     RF_MoveCursor(ctx, (uint16_t)ctx->num[0], ctx->cursor_pos.y);
 }
@@ -66,38 +80,27 @@ static void cmd_attrib(RF_Context* ctx) {
         case 'R': case 'r': ctx->attrib.reverse   = value; break;
         case 'I': case 'i': ctx->attrib.invisible = value; break;
         default:  // invalid attribute
-            RF_AddChar(ctx, 0xFFFD);
+            invalid_sequence(ctx, ((const RF_InternalMarkupCommand*)(ctx->esc_class))->letter, ctx->num[0]);
             break;
     }
 }
 
 static void cmd_clreol(RF_Context* ctx) {
-    RF_Cell* c;
-    uint16_t i;
     if ((ctx->cursor_pos.x >= ctx->screen_size.x) || (ctx->cursor_pos.y >= ctx->screen_size.y)) { return; }
-    ctx->attrib.codepoint = 32;
-    ctx->attrib.dirty = 1;
-    c = &ctx->screen[ctx->cursor_pos.y * ctx->screen_size.x + ctx->cursor_pos.y];
-    for (i = ctx->screen_size.x - ctx->cursor_pos.x;  i;  --i) {
-        *c++ = ctx->attrib;
-    }
+    RF_ClearRegionAB(ctx, ctx->cursor_pos.x, ctx->cursor_pos.y, ctx->screen_size.x, ctx->cursor_pos.y + 1, &ctx->attrib);
 }
 
 static void cmd_clrscr(RF_Context* ctx) {
-    RF_Cell* c;
-    uint32_t i;
     ctx->attrib.codepoint = 32;
-    ctx->attrib.dirty = 1;
-    c = ctx->screen;
-    for (i = (uint32_t)ctx->screen_size.x * (uint32_t) ctx->screen_size.y;  i;  --i) {
-        *c++ = ctx->attrib;
-    }
+    RF_ClearScreen(ctx, &ctx->attrib);
 }
 
 static void cmd_unicode(RF_Context* ctx) {
     RF_AddChar(ctx, ctx->num[0]);
 }
 
+// NOTE: util/update_systems.py has a copy of this table for precompiling the
+//       systems' default screens; keep both in sync!
 const RF_InternalMarkupCommand RF_InternalMarkupCommands[] = {
     { 'x', false, 2, 10, cmd_setxpos },
     { 'X', false, 2, 10, cmd_setxneg },
@@ -134,7 +137,7 @@ bool RF_ParseInternalMarkup(RF_Context* ctx, uint8_t c) {
         for (cmd = RF_InternalMarkupCommands;  cmd->letter && (cmd->letter != c);  ++cmd);
         if (!cmd->letter) {
             // invalid sequence
-            RF_AddChar(ctx, 0xFFFD);
+            invalid_sequence(ctx, 0, c);
             return true;
         }
         // set up parser
@@ -166,12 +169,13 @@ bool RF_ParseInternalMarkup(RF_Context* ctx, uint8_t c) {
     // parse digit
     if (ctx->esc_remain) {
         if (cmd->base) {
-            if      ((c >= '0') && (c <= '9')) { c -= '0'; }
-            else if ((c >= 'A') && (c <= 'Z')) { c -= 'A' - 10; }
-            else if ((c >= 'a') && (c <= 'z')) { c -= 'a' - 10; }
-            else                               { c = 0xFF; /* force invalid value */ }
-            if (c >= cmd->base) { RF_AddChar(ctx, 0xFFFD); return true; }
-            ctx->num[0] = (ctx->num[0] * cmd->base) + c;
+            uint8_t d;
+            if      ((c >= '0') && (c <= '9')) { d = c - '0'; }
+            else if ((c >= 'A') && (c <= 'Z')) { d = c - 'A' + 10; }
+            else if ((c >= 'a') && (c <= 'z')) { d = c - 'a' + 10; }
+            else                               { d = 0xFF; /* force invalid value */ }
+            if (d >= cmd->base) { invalid_sequence(ctx, cmd->letter, c); return true; }
+            ctx->num[0] = (ctx->num[0] * cmd->base) + d;
         } else {
             ctx->num[0] = (ctx->num[0] << 8) | c;
         }
@@ -194,3 +198,16 @@ bool RF_ParseInternalMarkup(RF_Context* ctx, uint8_t c) {
     cmd->finalize_func(ctx);
     return true;
 }
+
+// run a single command of a precompiled default screen (RF_LoadDefaultScreen());
+// value is the final argument of the command, as assembled by the parser
+bool RF_RunInternalMarkupCommand(RF_Context* ctx, uint8_t letter, uint32_t value) {
+    const RF_InternalMarkupCommand* cmd;
+    for (cmd = RF_InternalMarkupCommands;  cmd->letter && (cmd->letter != letter);  ++cmd);
+    if (!cmd->letter) { return false; }
+    ctx->esc_class = (const void*)cmd;
+    ctx->num[0] = value;
+    cmd->finalize_func(ctx);
+    ctx->esc_class = NULL;
+    return true;
+}
@@ -6,56 +6,133 @@
 
 #include "retrofont.h"
 
+extern size_t RF_UTF8ValidPrefix(const uint8_t* data, size_t len);
+extern size_t RF_SkipPlainASCII(const uint8_t* data, size_t len);
+
 ////////////////////////////////////////////////////////////////////////////////
 
-const RF_Charset* RF_DetectCharset(const char* str) {
-    bool valid_utf8 = true;
-    uint8_t utf8_cb_count = 0;  // expected number of continuation bytes
-    uint32_t hist[256], max_run[256];  // statistics buffers
-    uint32_t run = 0;  // current run length
-    uint8_t c, prev = 0;  // current and previous character
-    const RF_Charset* common_best = NULL;
-    const RF_Charset* run_best = NULL;
-    uint32_t score, common_score = 0, run_score = 0;
-    const uint8_t* p;  // statistics position
+// check whether a character can follow a backtick in internal markup
+static inline bool is_internal_command(uint8_t c) {
+    return isalnum(c) || (c == '-') || (c == '+');
+}
 
-    if (!str || !str[0]) { return RF_Charsets; }
-    memset((void*)hist,    0, sizeof(hist));
-    memset((void*)max_run, 0, sizeof(max_run));
-    do {
-        c = (uint8_t)(*str++);
-        // update histogram and run-length statistics
-        if (c) { hist[c]++; }
+// update the histogram and run-length statistics, and check the internal
+// markup syntax (the presence of Escape and backtick characters, which is the
+// rest of the markup type detection, can be taken from the histogram later)
+static void detector_scan(RF_Detector* det, const uint8_t* data, size_t len) {
+    uint32_t run = det->run;  // current run length
+    uint8_t prev = det->prev;  // previous character
+    const uint8_t* next_skip = data;  // next position to try skipping plain ASCII text
+    det->analyzed += len;
+    for (const uint8_t* end = &data[len];  data < end;  ++data) {
+        uint8_t c;
+        if (det->skip_ascii && (prev < 0x80) && (prev != '`') && (data >= next_skip)) {
+            // plain ASCII text doesn't change any of the statistics that are
+            // evaluated (except for runs of 7-bit characters, which aren't
+            // tracked in this case), so it can be skipped in bulk
+            size_t skip = RF_SkipPlainASCII(data, (size_t)(end - data));
+            if (skip) {
+                data += skip;
+                prev = data[-1];
+                run = 1;
+                if (data >= end) { break; }
+            } else {
+                next_skip = data + 16;  // don't try again too early
+            }
+        }
+        c = *data;
+        det->hist[c]++;
+        if ((prev == '`') && !is_internal_command(c)) { det->internal_valid = false; }
         if (c == prev) { ++run; }
         else {
-            if (run > max_run[prev]) { max_run[prev] = run; }
+            if (run > det->max_run[prev]) { det->max_run[prev] = run; }
             run = 1;
             prev = c;
         }
-        // UTF-8 check
-        if (valid_utf8) {
-            if (utf8_cb_count) { --utf8_cb_count; valid_utf8 = ((c & 0xC0) == 0x80); }
-            else if ((c & 0xE0) == 0xC0) { utf8_cb_count = 1; }
-            else if ((c & 0xF0) == 0xE0) { utf8_cb_count = 2; }
-            else if ((c & 0xF8) == 0xF0) { utf8_cb_count = 3; }
-            else { valid_utf8 = (c < 0x80); }
+    }
+    det->run = run;
+    det->prev = prev;
+}
+
+// finish the current run (at the end of the data, or before a sampling gap)
+static void detector_end_run(RF_Detector* det) {
+    if (det->run > det->max_run[det->prev]) { det->max_run[det->prev] = det->run; }
+    det->run = 0;
+}
+
+// length of a UTF-8 sequence, given its lead byte (0 = invalid lead byte)
+static inline uint8_t utf8_length(uint8_t c) {
+    if (c < 0x80) { return 1; }
+    if (c < 0xC0) { return 0; }
+    if (c < 0xE0) { return 2; }
+    if (c < 0xF0) { return 3; }
+    if (c < 0xF8) { return 4; }
+    return 0;
+}
+
+// check the next chunk of data for UTF-8 validity, taking sequences that
+// are split between chunks into account
+static void detector_validate(RF_Detector* det, const uint8_t* data, size_t len) {
+    size_t pos = 0, valid;
+    uint8_t n;
+    // after a sampling gap, skip the remainder of a sequence that started in it
+    while (det->utf8_skip && (pos < len) && ((data[pos] & 0xC0) == 0x80)) { ++pos;  --det->utf8_skip; }
+    if (pos < len) { det->utf8_skip = 0; }
+    // complete the sequence that was cut off at the end of the previous chunk
+    while (det->utf8_pending && (pos < len)) {
+        if ((data[pos++] & 0xC0) != 0x80) { det->utf8_valid = false;  return; }
+        --det->utf8_pending;
+    }
+    if (pos >= len) { return; }
+    // validate the rest; anything after the valid part must be the beginning
+    // of a sequence that continues in the next chunk
+    valid = pos + RF_UTF8ValidPrefix(&data[pos], len - pos);
+    if (valid >= len) { return; }
+    n = utf8_length(data[valid]);
+    if ((n < 2) || ((len - valid) >= n)) { det->utf8_valid = false;  return; }
+    for (pos = valid + 1;  pos < len;  ++pos) {
+        if ((data[pos] & 0xC0) != 0x80) { det->utf8_valid = false;  return; }
+    }
+    det->utf8_pending = (uint8_t)(n - (len - valid));
+}
+
+// determine the character set with the longest run of one of its run_chars
+static const RF_Charset* detector_run_best(const RF_Detector* det, uint32_t* p_score) {
+    const RF_Charset* best = NULL;
+    uint32_t best_score = 0;
+    for (const RF_Charset* cs = RF_Charsets;  cs->charset_id;  ++cs) {
+        uint32_t score = 0;
+        if (!cs->run_chars) { continue; }
+        for (const uint8_t* p = cs->run_chars;  *p;  ++p) {
+            uint32_t run = ((*p == det->prev) && (det->run > det->max_run[*p])) ? det->run : det->max_run[*p];
+            if (run > score) { score = run; }
         }
-    } while (c);
-    // if it's valid UTF-8, use the first charset (which is always UTF-8 by convention)
-    if (valid_utf8) { return RF_Charsets; }
-    // evaluate statistics
+        if (score > best_score) {
+            best = cs;
+            best_score = score;
+        }
+    }
+    *p_score = best_score;
+    return best;
+}
+
+// evaluate the statistics of a non-UTF-8 document
+static const RF_Charset* detector_evaluate(const RF_Detector* det) {
+    const RF_Charset* common_best = NULL;
+    const RF_Charset* run_best;
+    uint32_t score, common_score = 0, run_score;
     for (const RF_Charset* cs = RF_Charsets;  cs->charset_id;  ++cs) {
         // compute score for common characters
         if (cs->common_chars) {
             uint32_t n = 0;
+            const uint8_t* p = cs->common_chars;
             score = 0;
-            p = cs->common_chars;
             while (*p) {
                 uint8_t a = *p++;
                 uint8_t b = *p++;
-                for (c = a;  (c >= a) && (c <= b);  ++c) {
-                    score += hist[c];
-                    if (hist[c]) { n++; }
+                for (uint8_t c = a;  (c >= a) && (c <= b);  ++c) {
+                    score += det->hist[c];
+                    if (det->hist[c]) { n++; }
                 }
             }
             score = n ? ((score << 8) / n) : 0;
@@ -64,22 +141,11 @@ const RF_Charset* RF_DetectCharset(const char* str) {
                 common_score = score;
             }
         }
-        // compute score for runs
-        if (cs->run_chars) {
-            score = 0;
-            for (p = cs->run_chars;  *p;  ++p) {
-                if (max_run[*p] > score) {
-                    score = max_run[*p];
-                }
-            }
-            if (score > run_score) {
-                run_best = cs;
-                run_score = score;
-            }
-        }
     }
+    // compute score for runs
+    run_best = detector_run_best(det, &run_score);
     // decide of final result
-    if (run_best && (run_score >= 20)) {
+    if (run_best && (run_score >= RF_DETECT_RUN_EVIDENCE)) {
         // trust the "run length" metric if the longest run was 20 characters or more
         return run_best;
     }
@@ -87,31 +153,180 @@ const RF_Charset* RF_DetectCharset(const char* str) {
     return common_best ? common_best : RF_Charsets;
 }
 
+// check whether the evidence collected so far is decisive for the character set
+static const RF_Charset* detector_decide(const RF_Detector* det) {
+    if (det->utf8_valid) {
+        // in valid UTF-8, every byte >= 0xC0 starts a multi-byte sequence
+        uint32_t sequences = 0;
+        for (int c = 0xC0;  c < 0xF8;  ++c) { sequences += det->hist[c]; }
+        return (sequences >= RF_DETECT_UTF8_EVIDENCE) ? RF_Charsets : NULL;
+    } else {
+        uint32_t score;
+        const RF_Charset* cs = detector_run_best(det, &score);
+        return (score >= RF_DETECT_RUN_EVIDENCE) ? cs : NULL;
+    }
+}
+
+// check whether the byte at a specific offset is analyzed in sampling mode
+static inline bool detector_samples(const RF_Detector* det, size_t offset) {
+    return (det->sample_rate <= 1) || (offset < RF_DETECT_SAMPLE_PREFIX)
+        || !((offset / RF_DETECT_SAMPLE_BLOCK) % det->sample_rate);
+}
+
+void RF_InitDetector(RF_Detector* det, uint32_t sample_rate, size_t scan_budget) {
+    if (!det) { return; }
+    memset((void*)det, 0, sizeof(RF_Detector));
+    det->markup = RF_MT_AUTO;
+    det->sample_rate = sample_rate;
+    det->scan_budget = scan_budget;
+    det->utf8_valid = det->internal_valid = true;
+    // plain ASCII text may only be skipped if none of the characters that
+    // are evaluated is 7-bit
+    det->skip_ascii = true;
+    for (const RF_Charset* cs = RF_Charsets;  cs->charset_id;  ++cs) {
+        for (const uint8_t* p = cs->run_chars;  p && *p;  ++p) {
+            if (*p < 0x80) { det->skip_ascii = false; }
+        }
+        for (const uint8_t* p = cs->common_chars;  p && *p;  p += 2) {
+            if (*p < 0x80) { det->skip_ascii = false; }  // (start of range; the end can't be lower)
+        }
+    }
+}
+
+bool RF_FeedDetector(RF_Detector* det, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*) data;
+    if (!det) { return false; }
+    if ((det->charset && (det->markup != RF_MT_AUTO)) || !p) {
+        det->offset += len;
+        return det->charset && (det->markup != RF_MT_AUTO);
+    }
+    while (len) {
+        // split the data at decision and sampling block boundaries and at the end of the budget
+        size_t n = len;
+        bool analyze = detector_samples(det, det->offset);
+        size_t remain = RF_DETECT_DECIDE_BLOCK - (det->offset % RF_DETECT_DECIDE_BLOCK);
+        if (n > remain) { n = remain; }
+        if ((det->sample_rate > 1) && (det->offset >= RF_DETECT_SAMPLE_PREFIX)) {
+            remain = RF_DETECT_SAMPLE_BLOCK - (det->offset % RF_DETECT_SAMPLE_BLOCK);
+            if (n > remain) { n = remain; }
+        }
+        if (analyze && det->scan_budget) {
+            if (det->analyzed >= det->scan_budget) {
+                // budget exhausted -> decide with what we have
+                det->offset += len;
+                RF_FinishDetector(det);
+                return true;
+            }
+            if (n > (det->scan_budget - det->analyzed)) { n = det->scan_budget - det->analyzed; }
+        }
+        if (analyze) {
+            if (det->utf8_valid && !det->charset) { detector_validate(det, p, n); }
+            detector_scan(det, p, n);
+        } else if (detector_samples(det, det->offset - 1)) {
+            // a sampling gap begins: runs and UTF-8 sequences end here
+            detector_end_run(det);
+            det->prev = 0;
+            det->utf8_pending = 0;
+            det->utf8_skip = 3;
+        }
+        det->offset += n;
+        p += n;
+        len -= n;
+        // a single escape character is enough for us to believe it's ANSI/VT-100
+        if (det->hist[27]) { det->markup = RF_MT_ANSI; }
+        // check the evidence only at block boundaries, not at the end of
+        // each chunk, so that the decision doesn't depend on the chunk sizes
+        if (!det->charset && !(det->offset % RF_DETECT_DECIDE_BLOCK)) { det->charset = detector_decide(det); }
+        if (det->charset && (det->markup != RF_MT_AUTO)) {
+            det->offset += len;
+            return true;
+        }
+    }
+    if (det->scan_budget && (det->analyzed >= det->scan_budget)) { RF_FinishDetector(det); }
+    return det->charset && (det->markup != RF_MT_AUTO);
+}
+
+void RF_FinishDetector(RF_Detector* det) {
+    if (!det) { return; }
+    if (!det->charset) {
+        // a UTF-8 sequence that is cut off at the end of the document is an error
+        if (det->utf8_pending) { det->utf8_valid = false; }
+        detector_end_run(det);
+        det->charset = det->utf8_valid ? RF_Charsets : detector_evaluate(det);
+    }
+    if (det->markup == RF_MT_AUTO) {
+        det->markup = det->hist[27] ? RF_MT_ANSI
+                    : (det->hist['`'] && det->internal_valid) ? RF_MT_INTERNAL
+                    : RF_MT_NONE;
+    }
+}
+
+const RF_Charset* RF_DetectCharset(const char* str) {
+    RF_Detector det;
+    size_t len;
+    if (!str || !str[0]) { return RF_Charsets; }
+    // if it's valid UTF-8, use the first charset (which is always UTF-8 by convention)
+    len = strlen(str);
+    if (RF_UTF8ValidPrefix((const uint8_t*)str, len) == len) { return RF_Charsets; }
+    // otherwise, evaluate the statistics of the whole string
+    RF_InitDetector(&det, 0, 0);
+    det.utf8_valid = false;
+    detector_scan(&det, (const uint8_t*)str, len);
+    RF_FinishDetector(&det);
+    return det.charset;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
-RF_MarkupType RF_DetectMarkupType(const char* str) {
+RF_MarkupType RF_DetectMarkupTypeEx(const void* data, size_t len) {
+    const char* str = (const char*) data;
+    const char* end;
     bool backtick_found = false;
-    bool valid_internal_markup = true;
     bool last_was_backtick = false;
     char c;
     if (!str) { return RF_MT_NONE; }
-    while ((c = *str++)) {
+    end = &str[len];
+    while (str < end) {
+        c = *str++;
         // a single escape character is enough for us to believe it's ANSI/VT-100
         if (c == 27) { return RF_MT_ANSI; }
         // check if a backtick was followed by a valid internal markup command
         if (last_was_backtick) {
-            if (!isalnum(c) && (c != '-') && (c != '+')) {
-                valid_internal_markup = false;
+            if (!isalnum((unsigned char)c) && (c != '-') && (c != '+')) {
+                // not internal markup -> only an escape character can change the result now
+                return memchr((const void*)str, 27, (size_t)(end - str)) ? RF_MT_ANSI : RF_MT_NONE;
             }
             last_was_backtick = false;
         }
         // check for a backtick character
-        if ((c == '`') && valid_internal_markup) {
+        if (c == '`') {
             backtick_found = true;
             last_was_backtick = true;
         }
     }
-    return (backtick_found && valid_internal_markup) ? RF_MT_INTERNAL : RF_MT_NONE;
+    return backtick_found ? RF_MT_INTERNAL : RF_MT_NONE;
+}
+
+RF_MarkupType RF_DetectMarkupType(const char* str) {
+    return str ? RF_DetectMarkupTypeEx(str, strlen(str)) : RF_MT_NONE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void RF_SetDiagnosticCallback(RF_Context* ctx, RF_DiagnosticFunc func, void* user, uint32_t burst) {
+    if (!ctx) { return; }
+    ctx->diag_func = func;
+    ctx->diag_user = user;
+    ctx->diag_burst = burst;
+    memset((void*)ctx->diag_counts, 0, sizeof(ctx->diag_counts));
+}
+
+// count a skipped sequence; returns true if the callback shall be called
+// (the caller only needs to build the description in that case)
+bool RF_CountDiagnostic(RF_Context* ctx, RF_Diagnostic diag) {
+    uint32_t n = ctx->diag_counts[diag];
+    if (n != UINT32_MAX) { ctx->diag_counts[diag] = ++n; }
+    return ctx->diag_func && ((n <= ctx->diag_burst) || !(n & (n - 1u)));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,378 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+// SIMD glyph rasterization kernels for RF_RenderCell().
+// A kernel gets one bit mask per cell row (bit x set = pixel x is foreground)
+// and expands it into pixels. The per-pixel loop in RF_RenderCell() is the
+// reference implementation; the kernels must produce identical output.
+// There's one kernel per pixel size; fg and bg are pixel values as returned
+// by RF_MapRGBToPixel().
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define RF_HAVE_X86_KERNELS
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define RF_TARGET(t)
+    #else
+        #define RF_TARGET(t) __attribute__((target(t)))
+    #endif
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef RF_HAVE_X86_KERNELS
+
+// fill a 48-byte buffer with a repeated RGB888 pattern
+static void fill_rgb_pattern(uint8_t* p, uint32_t color) {
+    for (int i = 16;  i;  --i) {
+        *p++ = RF_COLOR_R(color);
+        *p++ = RF_COLOR_G(color);
+        *p++ = RF_COLOR_B(color);
+    }
+}
+
+// put up to 7 remaining pixels of a row
+static void put_tail_24(uint8_t* p, uint32_t mask, uint16_t count, uint32_t fg, uint32_t bg) {
+    while (count--) {
+        uint32_t color = (mask & 1) ? fg : bg;
+        *p++ = RF_COLOR_R(color);
+        *p++ = RF_COLOR_G(color);
+        *p++ = RF_COLOR_B(color);
+        mask >>= 1;
+    }
+}
+
+static void put_tail_8(uint8_t* p, uint32_t mask, uint16_t count, uint32_t fg, uint32_t bg) {
+    for (;  count;  --count) {
+        *p++ = (uint8_t)((mask & 1) ? fg : bg);
+        mask >>= 1;
+    }
+}
+
+static void put_tail_16(uint8_t* p, uint32_t mask, uint16_t count, uint32_t fg, uint32_t bg) {
+    const uint16_t fg16 = (uint16_t)fg, bg16 = (uint16_t)bg;
+    for (;  count;  --count) {
+        memcpy((void*)p, (mask & 1) ? &fg16 : &bg16, 2);
+        p += 2;
+        mask >>= 1;
+    }
+}
+
+static void put_tail_32(uint8_t* p, uint32_t mask, uint16_t count, uint32_t fg, uint32_t bg) {
+    for (;  count;  --count) {
+        memcpy((void*)p, (mask & 1) ? &fg : &bg, 4);
+        p += 4;
+        mask >>= 1;
+    }
+}
+
+// byte i of an 8-pixel RGB888 group belongs to pixel i/3
+#define SEL3(i) (char)(1 << ((i) / 3))
+#define SEL3_16(b) SEL3(b+0), SEL3(b+1), SEL3(b+2),  SEL3(b+3),  SEL3(b+4),  SEL3(b+5),  SEL3(b+6),  SEL3(b+7), \
+                   SEL3(b+8), SEL3(b+9), SEL3(b+10), SEL3(b+11), SEL3(b+12), SEL3(b+13), SEL3(b+14), SEL3(b+15)
+
+RF_TARGET("sse2")
+static void raster_sse2_24(uint8_t* pixel, size_t stride, const uint32_t* masks, uint16_t rows, uint16_t width, uint32_t fg, uint32_t bg) {
+    uint8_t fgp[48], bgp[48];
+    fill_rgb_pattern(fgp, fg);
+    fill_rgb_pattern(bgp, bg);
+    const __m128i fg0 = _mm_loadu_si128((const __m128i*)&fgp[0]);
+    const __m128i fg1 = _mm_loadu_si128((const __m128i*)&fgp[16]);
+    const __m128i bg0 = _mm_loadu_si128((const __m128i*)&bgp[0]);
+    const __m128i bg1 = _mm_loadu_si128((const __m128i*)&bgp[16]);
+    const __m128i sel0 = _mm_setr_epi8(SEL3_16(0));
+    const __m128i sel1 = _mm_setr_epi8(SEL3(16), SEL3(17), SEL3(18), SEL3(19), SEL3(20), SEL3(21), SEL3(22), SEL3(23), 0,0,0,0,0,0,0,0);
+    for (;  rows;  --rows) {
+        uint8_t* p = pixel;
+        uint32_t mask = *masks++;
+        uint16_t x = width;
+        for (;  x >= 8;  x -= 8) {
+            const __m128i v = _mm_set1_epi8((char)mask);
+            const __m128i m0 = _mm_cmpeq_epi8(_mm_and_si128(v, sel0), sel0);
+            const __m128i m1 = _mm_cmpeq_epi8(_mm_and_si128(v, sel1), sel1);
+            _mm_storeu_si128((__m128i*)p, _mm_or_si128(_mm_and_si128(m0, fg0), _mm_andnot_si128(m0, bg0)));
+            _mm_storel_epi64((__m128i*)&p[16], _mm_or_si128(_mm_and_si128(m1, fg1), _mm_andnot_si128(m1, bg1)));
+            p += 24;
+            mask >>= 8;
+        }
+        put_tail_24(p, mask, x, fg, bg);
+        pixel += stride;
+    }
+}
+
+// byte i of a 16-pixel RGB888 group belongs to pixel i/3, which is found in
+// byte (i/3)/8 of the 16-bit mask, at bit (i/3)%8
+#define BYTE3(i) (char)(((i) / 3) >> 3)
+#define BIT3(i)  (char)(1 << (((i) / 3) & 7))
+#define BYTE3_16(b) BYTE3(b+0), BYTE3(b+1), BYTE3(b+2),  BYTE3(b+3),  BYTE3(b+4),  BYTE3(b+5),  BYTE3(b+6),  BYTE3(b+7), \
+                    BYTE3(b+8), BYTE3(b+9), BYTE3(b+10), BYTE3(b+11), BYTE3(b+12), BYTE3(b+13), BYTE3(b+14), BYTE3(b+15)
+#define BIT3_16(b)  BIT3(b+0),  BIT3(b+1),  BIT3(b+2),   BIT3(b+3),   BIT3(b+4),   BIT3(b+5),   BIT3(b+6),   BIT3(b+7), \
+                    BIT3(b+8),  BIT3(b+9),  BIT3(b+10),  BIT3(b+11),  BIT3(b+12),  BIT3(b+13),  BIT3(b+14),  BIT3(b+15)
+
+RF_TARGET("avx2")
+static void raster_avx2_24(uint8_t* pixel, size_t stride, const uint32_t* masks, uint16_t rows, uint16_t width, uint32_t fg, uint32_t bg) {
+    uint8_t fgp[48], bgp[48];
+    fill_rgb_pattern(fgp, fg);
+    fill_rgb_pattern(bgp, bg);
+    const __m256i fg0 = _mm256_loadu_si256((const __m256i*)&fgp[0]);
+    const __m128i fg1 = _mm_loadu_si128((const __m128i*)&fgp[32]);
+    const __m256i bg0 = _mm256_loadu_si256((const __m256i*)&bgp[0]);
+    const __m128i bg1 = _mm_loadu_si128((const __m128i*)&bgp[32]);
+    const __m256i shuf0 = _mm256_setr_epi8(BYTE3_16(0), BYTE3_16(16));
+    const __m256i sel0  = _mm256_setr_epi8(BIT3_16(0),  BIT3_16(16));
+    const __m128i shuf1 = _mm_setr_epi8(BYTE3_16(32));
+    const __m128i sel1  = _mm_setr_epi8(BIT3_16(32));
+    // 8-pixel steps for the remainder (same as in the SSE2 kernel)
+    const __m128i sel8a = _mm_setr_epi8(SEL3_16(0));
+    const __m128i sel8b = _mm_setr_epi8(SEL3(16), SEL3(17), SEL3(18), SEL3(19), SEL3(20), SEL3(21), SEL3(22), SEL3(23), 0,0,0,0,0,0,0,0);
+    const __m128i fg8a = _mm256_castsi256_si128(fg0), bg8a = _mm256_castsi256_si128(bg0);
+    const __m128i fg8b = _mm256_extracti128_si256(fg0, 1), bg8b = _mm256_extracti128_si256(bg0, 1);
+    for (;  rows;  --rows) {
+        uint8_t* p = pixel;
+        uint32_t mask = *masks++;
+        uint16_t x = width;
+        for (;  x >= 16;  x -= 16) {
+            const __m256i v0 = _mm256_shuffle_epi8(_mm256_set1_epi16((short)mask), shuf0);
+            const __m128i v1 = _mm_shuffle_epi8(_mm_set1_epi16((short)mask), shuf1);
+            const __m256i m0 = _mm256_cmpeq_epi8(_mm256_and_si256(v0, sel0), sel0);
+            const __m128i m1 = _mm_cmpeq_epi8(_mm_and_si128(v1, sel1), sel1);
+            _mm256_storeu_si256((__m256i*)p, _mm256_blendv_epi8(bg0, fg0, m0));
+            _mm_storeu_si128((__m128i*)&p[32], _mm_blendv_epi8(bg1, fg1, m1));
+            p += 48;
+            mask >>= 16;
+        }
+        if (x >= 8) {
+            const __m128i v = _mm_set1_epi8((char)mask);
+            const __m128i m0 = _mm_cmpeq_epi8(_mm_and_si128(v, sel8a), sel8a);
+            const __m128i m1 = _mm_cmpeq_epi8(_mm_and_si128(v, sel8b), sel8b);
+            _mm_storeu_si128((__m128i*)p, _mm_or_si128(_mm_and_si128(m0, fg8a), _mm_andnot_si128(m0, bg8a)));
+            _mm_storel_epi64((__m128i*)&p[16], _mm_or_si128(_mm_and_si128(m1, fg8b), _mm_andnot_si128(m1, bg8b)));
+            p += 24;
+            mask >>= 8;
+            x -= 8;
+        }
+        put_tail_24(p, mask, x, fg, bg);
+        pixel += stride;
+    }
+}
+
+RF_TARGET("sse2")
+static void raster_sse2_8(uint8_t* pixel, size_t stride, const uint32_t* masks, uint16_t rows, uint16_t width, uint32_t fg, uint32_t bg) {
+    const __m128i fgv = _mm_set1_epi8((char)fg);
+    const __m128i bgv = _mm_set1_epi8((char)bg);
+    const __m128i sel = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 1, 2, 4, 8, 16, 32, 64, (char)128);
+    for (;  rows;  --rows) {
+        uint8_t* p = pixel;
+        uint32_t mask = *masks++;
+        uint16_t x = width;
+        for (;  x >= 16;  x -= 16) {
+            const __m128i v = _mm_unpacklo_epi64(_mm_set1_epi8((char)mask), _mm_set1_epi8((char)(mask >> 8)));
+            const __m128i m = _mm_cmpeq_epi8(_mm_and_si128(v, sel), sel);
+            _mm_storeu_si128((__m128i*)p, _mm_or_si128(_mm_and_si128(m, fgv), _mm_andnot_si128(m, bgv)));
+            p += 16;
+            mask >>= 16;
+        }
+        if (x >= 8) {
+            const __m128i m = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8((char)mask), sel), sel);
+            _mm_storel_epi64((__m128i*)p, _mm_or_si128(_mm_and_si128(m, fgv), _mm_andnot_si128(m, bgv)));
+            p += 8;
+            mask >>= 8;
+            x -= 8;
+        }
+        put_tail_8(p, mask, x, fg, bg);
+        pixel += stride;
+    }
+}
+
+RF_TARGET("sse2")
+static void raster_sse2_16(uint8_t* pixel, size_t stride, const uint32_t* masks, uint16_t rows, uint16_t width, uint32_t fg, uint32_t bg) {
+    const __m128i fgv = _mm_set1_epi16((short)fg);
+    const __m128i bgv = _mm_set1_epi16((short)bg);
+    const __m128i sel = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    for (;  rows;  --rows) {
+        uint8_t* p = pixel;
+        uint32_t mask = *masks++;
+        uint16_t x = width;
+        for (;  x >= 8;  x -= 8) {
+            const __m128i m = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16((short)(mask & 0xFF)), sel), sel);
+            _mm_storeu_si128((__m128i*)p, _mm_or_si128(_mm_and_si128(m, fgv), _mm_andnot_si128(m, bgv)));
+            p += 16;
+            mask >>= 8;
+        }
+        put_tail_16(p, mask, x, fg, bg);
+        pixel += stride;
+    }
+}
+
+RF_TARGET("sse2")
+static void raster_sse2_32(uint8_t* pixel, size_t stride, const uint32_t* masks, uint16_t rows, uint16_t width, uint32_t fg, uint32_t bg) {
+    const __m128i fgv = _mm_set1_epi32((int)fg);
+    const __m128i bgv = _mm_set1_epi32((int)bg);
+    const __m128i sel = _mm_setr_epi32(1, 2, 4, 8);
+    for (;  rows;  --rows) {
+        uint8_t* p = pixel;
+        uint32_t mask = *masks++;
+        uint16_t x = width;
+        for (;  x >= 4;  x -= 4) {
+            const __m128i m = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)(mask & 0xF)), sel), sel);
+            _mm_storeu_si128((__m128i*)p, _mm_or_si128(_mm_and_si128(m, fgv), _mm_andnot_si128(m, bgv)));
+            p += 16;
+            mask >>= 4;
+        }
+        put_tail_32(p, mask, x, fg, bg);
+        pixel += stride;
+    }
+}
+
+RF_TARGET("avx2")
+static void raster_avx2_16(uint8_t* pixel, size_t stride, const uint32_t* masks, uint16_t rows, uint16_t width, uint32_t fg, uint32_t bg) {
+    const __m256i fgv = _mm256_set1_epi16((short)fg);
+    const __m256i bgv = _mm256_set1_epi16((short)bg);
+    const __m256i sel = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, (short)0x8000);
+    for (;  rows;  --rows) {
+        uint8_t* p = pixel;
+        uint32_t mask = *masks++;
+        uint16_t x = width;
+        for (;  x >= 16;  x -= 16) {
+            const __m256i m = _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16((short)(mask & 0xFFFF)), sel), sel);
+            _mm256_storeu_si256((__m256i*)p, _mm256_blendv_epi8(bgv, fgv, m));
+            p += 32;
+            mask >>= 16;
+        }
+        if (x >= 8) {
+            const __m128i m = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16((short)(mask & 0xFF)), _mm256_castsi256_si128(sel)), _mm256_castsi256_si128(sel));
+            _mm_storeu_si128((__m128i*)p, _mm_blendv_epi8(_mm256_castsi256_si128(bgv), _mm256_castsi256_si128(fgv), m));
+            p += 16;
+            mask >>= 8;
+            x -= 8;
+        }
+        put_tail_16(p, mask, x, fg, bg);
+        pixel += stride;
+    }
+}
+
+RF_TARGET("avx2")
+static void raster_avx2_32(uint8_t* pixel, size_t stride, const uint32_t* masks, uint16_t rows, uint16_t width, uint32_t fg, uint32_t bg) {
+    const __m256i fgv = _mm256_set1_epi32((int)fg);
+    const __m256i bgv = _mm256_set1_epi32((int)bg);
+    const __m256i sel = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    for (;  rows;  --rows) {
+        uint8_t* p = pixel;
+        uint32_t mask = *masks++;
+        uint16_t x = width;
+        for (;  x >= 8;  x -= 8) {
+            const __m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)(mask & 0xFF)), sel), sel);
+            _mm256_storeu_si256((__m256i*)p, _mm256_blendv_epi8(bgv, fgv, m));
+            p += 32;
+            mask >>= 8;
+        }
+        if (x >= 4) {
+            const __m128i m = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)(mask & 0xF)), _mm256_castsi256_si128(sel)), _mm256_castsi256_si128(sel));
+            _mm_storeu_si128((__m128i*)p, _mm_blendv_epi8(_mm256_castsi256_si128(bgv), _mm256_castsi256_si128(fgv), m));
+            p += 16;
+            mask >>= 4;
+            x -= 4;
+        }
+        put_tail_32(p, mask, x, fg, bg);
+        pixel += stride;
+    }
+}
+
+static bool cpu_has_avx2(void) {
+    #ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) { return false; }
+        __cpuid(info, 1);
+        if (!(info[2] & (1 << 27))) { return false; }  // no OSXSAVE
+        if ((_xgetbv(0) & 6) != 6) { return false; }    // OS doesn't save YMM registers
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    #else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    #endif
+}
+
+static bool cpu_has_sse2(void) {
+    #if defined(__x86_64__) || defined(_M_X64)
+        return true;  // always present on x86-64
+    #elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+    #else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2") != 0;
+    #endif
+}
+
+#endif // RF_HAVE_X86_KERNELS
+
+///////////////////////////////////////////////////////////////////////////////
+
+extern void RF_LockGlobal(void);
+extern void RF_UnlockGlobal(void);
+extern bool RF_TestFlag(volatile long* flag);
+extern void RF_SetFlag(volatile long* flag);
+
+// The kernel selection is only ever written with the global lock held.
+// RF_Render() calls RF_InitRasterKernel() before any rendering happens
+// (in particular, before the band threads start), so the selection can't
+// race between contexts that render for the first time on different threads;
+// after that, the renderer only reads it, and RF_InitRasterKernel() only
+// checks rf_kernel_selected without taking the lock.
+static RF_RasterKernel rf_kernel = RF_RK_AUTO;  // currently selected kernel (AUTO = not yet selected)
+static RF_RasterFunc rf_raster_funcs[4];        // kernel functions for 1 to 4 bytes per pixel (NULL = use scalar code)
+static volatile long rf_kernel_selected = 0;    // set once rf_kernel and rf_raster_funcs are valid
+
+// select a kernel (the global lock must be held)
+static RF_RasterKernel select_kernel(RF_RasterKernel kernel) {
+    RF_RasterFunc funcs[4] = { NULL, NULL, NULL, NULL };
+    #ifdef RF_HAVE_X86_KERNELS
+        bool avx2 = cpu_has_avx2();
+        bool sse2 = avx2 || cpu_has_sse2();
+        if ((kernel == RF_RK_AUTO) || (kernel == RF_RK_AVX2)) {
+            kernel = avx2 ? RF_RK_AVX2 : RF_RK_SSE2;
+        }
+        if ((kernel == RF_RK_SSE2) && !sse2) {
+            kernel = RF_RK_SCALAR;
+        }
+        switch (kernel) {
+            // (cells are at most 32 pixels wide, so there's no point in a 32-pixel AVX2 kernel for 8-bit pixels)
+            case RF_RK_AVX2: funcs[0] = raster_sse2_8;  funcs[1] = raster_avx2_16;  funcs[2] = raster_avx2_24;  funcs[3] = raster_avx2_32;  break;
+            case RF_RK_SSE2: funcs[0] = raster_sse2_8;  funcs[1] = raster_sse2_16;  funcs[2] = raster_sse2_24;  funcs[3] = raster_sse2_32;  break;
+            default: break;
+        }
+    #else
+        (void)kernel;
+    #endif
+    memcpy((void*)rf_raster_funcs, (const void*)funcs, sizeof(funcs));
+    rf_kernel = funcs[0] ? kernel : RF_RK_SCALAR;
+    RF_SetFlag(&rf_kernel_selected);
+    return rf_kernel;
+}
+
+RF_RasterKernel RF_SetRasterKernel(RF_RasterKernel kernel) {
+    RF_LockGlobal();
+    kernel = select_kernel(kernel);
+    RF_UnlockGlobal();
+    return kernel;
+}
+
+void RF_InitRasterKernel(void) {
+    if (RF_TestFlag(&rf_kernel_selected)) { return; }  // (the common case: nothing to do)
+    RF_LockGlobal();
+    if (rf_kernel == RF_RK_AUTO) { select_kernel(RF_RK_AUTO); }
+    RF_UnlockGlobal();
+}
+
+RF_RasterFunc RF_GetRasterFunc(uint8_t bytes_per_pixel) {
+    // (if no kernel has been selected yet, the table is empty -> scalar code)
+    return ((bytes_per_pixel >= 1) && (bytes_per_pixel <= 4)) ? rf_raster_funcs[bytes_per_pixel - 1] : NULL;
+}
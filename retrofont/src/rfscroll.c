@@ -0,0 +1,236 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+// Scrollback buffer: stores lines that have been scrolled off the top of the
+// screen, compressed into run-length encoded attribute runs.
+//
+// Lines are packed into chunks ("arenas") that are allocated and freed as a
+// whole; when the memory budget is exhausted, the oldest chunk is dropped.
+// Inside a chunk, line data grows upwards from the start, and the offsets of
+// the lines grow downwards from the end.
+//
+// Encoded line format:
+//   varint   number of cells (trailing empty cells are not stored)
+//   per attribute run:
+//     uint8  flags: bits 0-5 = bold, dim, underline, blink, reverse, invisible;
+//                   bit 6 = foreground color follows, bit 7 = background color follows
+//     uint32 foreground color (little endian, only if not RF_COLOR_DEFAULT)
+//     uint32 background color (little endian, only if not RF_COLOR_DEFAULT)
+//     varint number of cells in the run
+//     varint codepoint of each cell in the run
+
+#define RF_SCROLLBACK_CHUNK_SIZE 65536  //!< regular size of a chunk's data area
+#define RF_LINE_MAX_OVERHEAD(cells) (3u + (size_t)(cells) * 19u)  //!< upper bound for an encoded line's size
+
+typedef struct s_RF_ScrollbackChunk {
+    uint32_t size;     //!< size of the data area in bytes (multiple of 4)
+    uint32_t used;     //!< number of bytes used by line data
+    uint32_t lines;    //!< number of lines in the chunk
+    uint32_t data[1];  //!< data area (actually 'size' bytes)
+} RF_ScrollbackChunk;
+
+typedef struct s_RF_Scrollback {
+    size_t max_bytes;             //!< memory budget
+    size_t bytes;                 //!< memory currently used by chunks
+    RF_ScrollbackChunk **chunks;  //!< chunks, oldest first
+    uint32_t chunk_count;         //!< number of valid entries in 'chunks'
+    uint32_t chunk_capacity;      //!< allocated number of entries in 'chunks'
+    uint32_t lines;               //!< total number of stored lines
+    uint8_t *scratch;             //!< line encoding buffer
+    size_t scratch_size;          //!< size of the line encoding buffer
+} RF_Scrollback;
+
+#define CHUNK_BYTES(c) ((uint8_t*)((c)->data))
+#define CHUNK_OFFSETS_END(c) ((uint32_t*)(CHUNK_BYTES(c) + (c)->size))  // line k's offset is at [-1-k]
+
+static inline bool is_empty_cell(const RF_Cell* c) {
+    return (c->codepoint == RF_EmptyCell.codepoint) && (c->fg == RF_EmptyCell.fg) && (c->bg == RF_EmptyCell.bg)
+        && !c->bold && !c->dim && !c->underline && !c->blink && !c->reverse && !c->invisible;
+}
+
+static inline uint8_t run_flags(const RF_Cell* c) {
+    return (uint8_t)((c->bold      ?  1u : 0u) | (c->dim     ?  2u : 0u) | (c->underline ?  4u : 0u)
+                   | (c->blink     ?  8u : 0u) | (c->reverse ? 16u : 0u) | (c->invisible ? 32u : 0u)
+                   | ((c->fg != RF_COLOR_DEFAULT) ? 64u : 0u) | ((c->bg != RF_COLOR_DEFAULT) ? 128u : 0u));
+}
+
+static inline uint8_t* put_varint(uint8_t* p, uint32_t v) {
+    while (v >= 0x80u) { *p++ = (uint8_t)(v | 0x80u);  v >>= 7; }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static inline const uint8_t* get_varint(const uint8_t* p, uint32_t* v) {
+    uint32_t res = 0;
+    for (int shift = 0;  ;  shift += 7) {
+        uint8_t b = *p++;
+        res |= (uint32_t)(b & 0x7Fu) << shift;
+        if (!(b & 0x80u)) { break; }
+    }
+    *v = res;
+    return p;
+}
+
+static inline uint8_t* put_u32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;  p[1] = (uint8_t)(v >> 8);  p[2] = (uint8_t)(v >> 16);  p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+static inline uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void* RF_CreateScrollback(size_t max_bytes) {
+    RF_Scrollback* sb;
+    if (!max_bytes) { return NULL; }
+    sb = (RF_Scrollback*) calloc(1, sizeof(RF_Scrollback));
+    if (!sb) { return NULL; }
+    sb->max_bytes = max_bytes;
+    return (void*)sb;
+}
+
+static void drop_oldest_chunk(RF_Scrollback* sb) {
+    RF_ScrollbackChunk* c = sb->chunks[0];
+    sb->lines -= c->lines;
+    sb->bytes -= sizeof(RF_ScrollbackChunk) + c->size;
+    free((void*)c);
+    memmove((void*)sb->chunks, (const void*)&sb->chunks[1], (--sb->chunk_count) * sizeof(RF_ScrollbackChunk*));
+}
+
+void RF_ClearScrollback(void* sb_) {
+    RF_Scrollback* sb = (RF_Scrollback*) sb_;
+    if (!sb) { return; }
+    while (sb->chunk_count) { drop_oldest_chunk(sb); }
+}
+
+void RF_FreeScrollback(void* sb_) {
+    RF_Scrollback* sb = (RF_Scrollback*) sb_;
+    if (!sb) { return; }
+    RF_ClearScrollback(sb);
+    free((void*)sb->chunks);
+    free((void*)sb->scratch);
+    free((void*)sb);
+}
+
+void RF_SetScrollbackBudget(void* sb_, size_t max_bytes) {
+    RF_Scrollback* sb = (RF_Scrollback*) sb_;
+    if (!sb) { return; }
+    sb->max_bytes = max_bytes;
+    while (sb->chunk_count && (sb->bytes > max_bytes)) { drop_oldest_chunk(sb); }
+}
+
+uint32_t RF_GetScrollbackLineCount(const void* sb_) {
+    const RF_Scrollback* sb = (const RF_Scrollback*) sb_;
+    return sb ? sb->lines : 0;
+}
+
+// allocate a new chunk that can hold at least 'min_bytes' of line data
+// plus its offset, evicting old chunks to stay within the budget
+static RF_ScrollbackChunk* new_chunk(RF_Scrollback* sb, size_t min_bytes) {
+    RF_ScrollbackChunk* c;
+    size_t size = RF_SCROLLBACK_CHUNK_SIZE;
+    if ((sb->max_bytes / 4u) < size) { size = sb->max_bytes / 4u; }  // keep at least four chunks' worth of budget
+    min_bytes = (min_bytes + sizeof(uint32_t) + 3u) & ~(size_t)3u;
+    if (size < min_bytes) { size = min_bytes; }
+    size = (size + 3u) & ~(size_t)3u;
+    if ((sizeof(RF_ScrollbackChunk) + size) > sb->max_bytes) { return NULL; }  // would never fit
+    while (sb->chunk_count && ((sb->bytes + sizeof(RF_ScrollbackChunk) + size) > sb->max_bytes)) {
+        drop_oldest_chunk(sb);
+    }
+    if (sb->chunk_count >= sb->chunk_capacity) {
+        uint32_t cap = sb->chunk_capacity ? (2u * sb->chunk_capacity) : 16u;
+        RF_ScrollbackChunk** list = (RF_ScrollbackChunk**) realloc((void*)sb->chunks, cap * sizeof(RF_ScrollbackChunk*));
+        if (!list) { return NULL; }
+        sb->chunks = list;
+        sb->chunk_capacity = cap;
+    }
+    c = (RF_ScrollbackChunk*) malloc(sizeof(RF_ScrollbackChunk) + size);
+    if (!c) { return NULL; }
+    c->size = (uint32_t)size;
+    c->used = c->lines = 0;
+    sb->chunks[sb->chunk_count++] = c;
+    sb->bytes += sizeof(RF_ScrollbackChunk) + size;
+    return c;
+}
+
+bool RF_ScrollbackPush(void* sb_, const RF_Cell* cells, uint16_t count) {
+    RF_Scrollback* sb = (RF_Scrollback*) sb_;
+    RF_ScrollbackChunk* c;
+    uint8_t *p;
+    size_t len;
+    if (!sb) { return false; }
+    while (count && is_empty_cell(&cells[count - 1])) { --count; }
+
+    // encode the line into the scratch buffer
+    if (sb->scratch_size < RF_LINE_MAX_OVERHEAD(count)) {
+        uint8_t* buf = (uint8_t*) realloc((void*)sb->scratch, RF_LINE_MAX_OVERHEAD(count));
+        if (!buf) { return false; }
+        sb->scratch = buf;
+        sb->scratch_size = RF_LINE_MAX_OVERHEAD(count);
+    }
+    p = put_varint(sb->scratch, count);
+    for (uint16_t start = 0, end;  start < count;  start = end) {
+        const RF_Cell* first = &cells[start];
+        uint8_t flags = run_flags(first);
+        for (end = start + 1;  (end < count) && (cells[end].fg == first->fg) && (cells[end].bg == first->bg) && (run_flags(&cells[end]) == flags);  ++end) {}
+        *p++ = flags;
+        if (flags &  64u) { p = put_u32(p, first->fg); }
+        if (flags & 128u) { p = put_u32(p, first->bg); }
+        p = put_varint(p, end - start);
+        for (uint16_t i = start;  i < end;  ++i) { p = put_varint(p, cells[i].codepoint); }
+    }
+    len = (size_t)(p - sb->scratch);
+
+    // store it in the newest chunk, or start a new one
+    c = sb->chunk_count ? sb->chunks[sb->chunk_count - 1] : NULL;
+    if (!c || ((c->size - c->used - c->lines * sizeof(uint32_t)) < (len + sizeof(uint32_t)))) {
+        c = new_chunk(sb, len);
+        if (!c) { return false; }
+    }
+    memcpy((void*)&CHUNK_BYTES(c)[c->used], (const void*)sb->scratch, len);
+    CHUNK_OFFSETS_END(c)[-1 - (int32_t)c->lines] = c->used;
+    c->used += (uint32_t)len;
+    ++c->lines;
+    ++sb->lines;
+    return true;
+}
+
+int RF_ScrollbackGet(const void* sb_, uint32_t age, RF_Cell* cells, int max_cells) {
+    const RF_Scrollback* sb = (const RF_Scrollback*) sb_;
+    const RF_ScrollbackChunk* c = NULL;
+    const uint8_t *p;
+    uint32_t count, i = 0;
+    if (!sb || !age || (age > sb->lines) || !cells || (max_cells < 0)) { return -1; }
+    // find the chunk, searching backwards from the newest one
+    for (uint32_t ci = sb->chunk_count;  ci--;) {
+        c = sb->chunks[ci];
+        if (age <= c->lines) { break; }
+        age -= c->lines;
+    }
+    p = &CHUNK_BYTES(c)[CHUNK_OFFSETS_END(c)[-1 - (int32_t)(c->lines - age)]];
+    p = get_varint(p, &count);
+    while (i < count) {
+        RF_Cell tmpl = RF_EmptyCell;
+        uint32_t run, cp;
+        uint8_t flags = *p++;
+        tmpl.bold      = (flags &  1u) ? 1 : 0;
+        tmpl.dim       = (flags &  2u) ? 1 : 0;
+        tmpl.underline = (flags &  4u) ? 1 : 0;
+        tmpl.blink     = (flags &  8u) ? 1 : 0;
+        tmpl.reverse   = (flags & 16u) ? 1 : 0;
+        tmpl.invisible = (flags & 32u) ? 1 : 0;
+        if (flags &  64u) { tmpl.fg = get_u32(p);  p += 4; }
+        if (flags & 128u) { tmpl.bg = get_u32(p);  p += 4; }
+        p = get_varint(p, &run);
+        for (;  run;  --run, ++i) {
+            p = get_varint(p, &cp);
+            if (i < (uint32_t)max_cells) { cells[i] = tmpl;  cells[i].codepoint = cp; }
+        }
+    }
+    for (;  i < (uint32_t)max_cells;  ++i) { cells[i] = RF_EmptyCell; }
+    return (int)((count < (uint32_t)max_cells) ? count : (uint32_t)max_cells);
+}
@@ -0,0 +1,186 @@
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 200809L  // for pthreads and sysconf()
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "retrofont.h"
+
+// Minimal worker pool for the multi-threaded renderer. Its "run" function
+// has the same signature as an application-supplied RF_ParallelFor, so the
+// renderer doesn't care which one it's using.
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+    typedef CRITICAL_SECTION   rf_mutex_t;
+    typedef CONDITION_VARIABLE rf_cond_t;
+    typedef HANDLE             rf_thread_t;
+    #define rf_mutex_init(m)    InitializeCriticalSection(m)
+    #define rf_mutex_destroy(m) DeleteCriticalSection(m)
+    #define rf_mutex_lock(m)    EnterCriticalSection(m)
+    #define rf_mutex_unlock(m)  LeaveCriticalSection(m)
+    #define rf_cond_init(c)     InitializeConditionVariable(c)
+    #define rf_cond_destroy(c)  (void)(c)
+    #define rf_cond_wait(c,m)   SleepConditionVariableCS(c, m, INFINITE)
+    #define rf_cond_wake_all(c) WakeAllConditionVariable(c)
+    #define RF_THREAD_PROC(name, arg) static DWORD WINAPI name(LPVOID arg)
+    #define RF_THREAD_RETURN    return 0
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+    typedef pthread_mutex_t rf_mutex_t;
+    typedef pthread_cond_t  rf_cond_t;
+    typedef pthread_t       rf_thread_t;
+    #define rf_mutex_init(m)    pthread_mutex_init(m, NULL)
+    #define rf_mutex_destroy(m) pthread_mutex_destroy(m)
+    #define rf_mutex_lock(m)    pthread_mutex_lock(m)
+    #define rf_mutex_unlock(m)  pthread_mutex_unlock(m)
+    #define rf_cond_init(c)     pthread_cond_init(c, NULL)
+    #define rf_cond_destroy(c)  pthread_cond_destroy(c)
+    #define rf_cond_wait(c,m)   pthread_cond_wait(c, m)
+    #define rf_cond_wake_all(c) pthread_cond_broadcast(c)
+    #define RF_THREAD_PROC(name, arg) static void* name(void* arg)
+    #define RF_THREAD_RETURN    return NULL
+#endif
+
+typedef struct s_RF_WorkerPool {
+    rf_mutex_t lock;      //!< protects all other members
+    rf_cond_t wake;       //!< signaled when new work is available (or when shutting down)
+    rf_cond_t done;       //!< signaled when the last work item has finished
+    bool quit;            //!< true if the workers shall exit
+    RF_JobFunc func;      //!< current job function
+    void* job;            //!< current job data
+    int count;            //!< number of items in the current job
+    int next;             //!< next item to run
+    int pending;          //!< number of items not yet finished
+    int num_workers;      //!< number of worker threads (not including the caller)
+    rf_thread_t workers[1];
+} RF_WorkerPool;
+
+// run items of the current job until there are none left;
+// must be called with the lock held
+static void run_items(RF_WorkerPool* pool) {
+    while (pool->next < pool->count) {
+        int index = pool->next++;
+        rf_mutex_unlock(&pool->lock);
+        pool->func(pool->job, index);
+        rf_mutex_lock(&pool->lock);
+        if (!--pool->pending) { rf_cond_wake_all(&pool->done); }
+    }
+}
+
+RF_THREAD_PROC(worker_main, arg) {
+    RF_WorkerPool* pool = (RF_WorkerPool*) arg;
+    rf_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && (pool->next >= pool->count)) {
+            rf_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->quit) { break; }
+        run_items(pool);
+    }
+    rf_mutex_unlock(&pool->lock);
+    RF_THREAD_RETURN;
+}
+
+// global lock for lazily initialized data that is shared between contexts
+#ifdef _WIN32
+    static SRWLOCK global_lock = SRWLOCK_INIT;
+    void RF_LockGlobal(void)   { AcquireSRWLockExclusive(&global_lock); }
+    void RF_UnlockGlobal(void) { ReleaseSRWLockExclusive(&global_lock); }
+#else
+    static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+    void RF_LockGlobal(void)   { pthread_mutex_lock(&global_lock); }
+    void RF_UnlockGlobal(void) { pthread_mutex_unlock(&global_lock); }
+#endif
+
+// flags for double-checked initialization: a flag that is read as set
+// guarantees that everything written before it was set is visible
+#ifdef _WIN32
+    bool RF_TestFlag(volatile long* flag) { return InterlockedCompareExchange(flag, 0, 0) != 0; }
+    void RF_SetFlag(volatile long* flag)  { InterlockedExchange(flag, 1); }
+#else
+    bool RF_TestFlag(volatile long* flag) { return __atomic_load_n(flag, __ATOMIC_ACQUIRE) != 0; }
+    void RF_SetFlag(volatile long* flag)  { __atomic_store_n(flag, 1, __ATOMIC_RELEASE); }
+#endif
+
+int RF_GetCPUCount(void) {
+    #ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return (int)info.dwNumberOfProcessors;
+    #elif defined(_SC_NPROCESSORS_ONLN)
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return (n > 0) ? (int)n : 1;
+    #else
+        return 1;
+    #endif
+}
+
+void* RF_CreateWorkerPool(int num_threads) {
+    RF_WorkerPool* pool;
+    if (num_threads < 2) { return NULL; }
+    pool = (RF_WorkerPool*) calloc(1, sizeof(RF_WorkerPool) + (size_t)(num_threads - 2) * sizeof(rf_thread_t));
+    if (!pool) { return NULL; }
+    rf_mutex_init(&pool->lock);
+    rf_cond_init(&pool->wake);
+    rf_cond_init(&pool->done);
+    for (pool->num_workers = 0;  pool->num_workers < (num_threads - 1);  ++pool->num_workers) {
+        #ifdef _WIN32
+            pool->workers[pool->num_workers] = CreateThread(NULL, 0, worker_main, (LPVOID)pool, 0, NULL);
+            if (!pool->workers[pool->num_workers]) { break; }
+        #else
+            if (pthread_create(&pool->workers[pool->num_workers], NULL, worker_main, (void*)pool)) { break; }
+        #endif
+    }
+    return (void*)pool;
+}
+
+void RF_FreeWorkerPool(void* pool_) {
+    RF_WorkerPool* pool = (RF_WorkerPool*) pool_;
+    if (!pool) { return; }
+    rf_mutex_lock(&pool->lock);
+    pool->quit = true;
+    rf_cond_wake_all(&pool->wake);
+    rf_mutex_unlock(&pool->lock);
+    for (int i = 0;  i < pool->num_workers;  ++i) {
+        #ifdef _WIN32
+            WaitForSingleObject(pool->workers[i], INFINITE);
+            CloseHandle(pool->workers[i]);
+        #else
+            pthread_join(pool->workers[i], NULL);
+        #endif
+    }
+    rf_cond_destroy(&pool->done);
+    rf_cond_destroy(&pool->wake);
+    rf_mutex_destroy(&pool->lock);
+    free((void*)pool);
+}
+
+int RF_GetWorkerPoolSize(void* pool_) {
+    RF_WorkerPool* pool = (RF_WorkerPool*) pool_;
+    return pool ? (pool->num_workers + 1) : 1;
+}
+
+void RF_RunWorkerPool(void* pool_, RF_JobFunc func, void* job, int count) {
+    RF_WorkerPool* pool = (RF_WorkerPool*) pool_;
+    if (!pool) {
+        for (int i = 0;  i < count;  ++i) { func(job, i); }
+        return;
+    }
+    rf_mutex_lock(&pool->lock);
+    pool->func = func;
+    pool->job = job;
+    pool->next = 0;
+    pool->pending = pool->count = count;
+    rf_cond_wake_all(&pool->wake);
+    run_items(pool);  // the calling thread helps out, too
+    while (pool->pending) {
+        rf_cond_wait(&pool->done, &pool->lock);
+    }
+    pool->count = pool->next = 0;
+    rf_mutex_unlock(&pool->lock);
+}
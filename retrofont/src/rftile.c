@@ -0,0 +1,160 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+// LRU cache of fully rendered cells ("tiles").
+// A tile is identified by a key of RF_TILE_KEY_WORDS words that contains
+// everything the cell's rendering depends on; the tile pixels are stored
+// packed, i.e. with a stride of cell_size.x * bytes_per_pixel.
+
+#define NO_TILE (-1)
+
+typedef struct s_RF_TileEntry {
+    uint32_t key[RF_TILE_KEY_WORDS];
+    int32_t hash_next;  //!< next entry in the same hash bucket
+    int32_t lru_prev;   //!< previous (more recently used) entry
+    int32_t lru_next;   //!< next (less recently used) entry
+} RF_TileEntry;
+
+typedef struct s_RF_TileCache {
+    int32_t capacity;      //!< maximum number of tiles
+    int32_t count;         //!< number of tiles in use
+    int32_t lru_head;      //!< most recently used tile
+    int32_t lru_tail;      //!< least recently used tile
+    uint32_t hash_mask;    //!< number of hash buckets minus 1
+    size_t tile_bytes;     //!< size of a tile's pixel data
+    uint16_t width;        //!< tile width in pixels
+    uint16_t height;       //!< tile height in pixels
+    uint8_t bpp;           //!< bytes per pixel
+    int32_t *buckets;      //!< hash buckets (first entry index or NO_TILE)
+    RF_TileEntry *entries; //!< tile metadata
+    uint8_t *pixels;       //!< tile pixel data
+} RF_TileCache;
+
+static uint32_t tile_hash(const uint32_t* key) {
+    uint32_t h = 0x811C9DC5u;
+    for (int i = 0;  i < RF_TILE_KEY_WORDS;  ++i) {
+        h = (h ^ key[i]) * 0x01000193u;
+        h ^= h >> 15;
+    }
+    return h;
+}
+
+void RF_ClearTileCache(void* tc_) {
+    RF_TileCache* tc = (RF_TileCache*) tc_;
+    if (!tc) { return; }
+    tc->count = 0;
+    tc->lru_head = tc->lru_tail = NO_TILE;
+    for (uint32_t i = 0;  i <= tc->hash_mask;  ++i) { tc->buckets[i] = NO_TILE; }
+}
+
+void* RF_CreateTileCache(int capacity, uint16_t width, uint16_t height, uint8_t bpp) {
+    RF_TileCache* tc;
+    uint32_t buckets = 16;
+    if (capacity < 1) { return NULL; }
+    while ((int32_t)buckets < (2 * capacity)) { buckets <<= 1; }
+    tc = (RF_TileCache*) calloc(1, sizeof(RF_TileCache));
+    if (!tc) { return NULL; }
+    tc->capacity = capacity;
+    tc->hash_mask = buckets - 1u;
+    tc->width = width;
+    tc->height = height;
+    tc->bpp = bpp;
+    tc->tile_bytes = (size_t)width * (size_t)height * bpp;
+    tc->buckets = (int32_t*) malloc(buckets * sizeof(int32_t));
+    tc->entries = (RF_TileEntry*) malloc((size_t)capacity * sizeof(RF_TileEntry));
+    tc->pixels = (uint8_t*) malloc((size_t)capacity * tc->tile_bytes);
+    if (!tc->buckets || !tc->entries || !tc->pixels) {
+        free((void*)tc->buckets);  free((void*)tc->entries);  free((void*)tc->pixels);
+        free((void*)tc);
+        return NULL;
+    }
+    RF_ClearTileCache(tc);
+    return (void*)tc;
+}
+
+void RF_FreeTileCache(void* tc_) {
+    RF_TileCache* tc = (RF_TileCache*) tc_;
+    if (!tc) { return; }
+    free((void*)tc->buckets);
+    free((void*)tc->entries);
+    free((void*)tc->pixels);
+    free((void*)tc);
+}
+
+bool RF_TileCacheMatches(void* tc_, int capacity, uint16_t width, uint16_t height, uint8_t bpp) {
+    RF_TileCache* tc = (RF_TileCache*) tc_;
+    return tc && (tc->capacity == capacity) && (tc->width == width) && (tc->height == height) && (tc->bpp == bpp);
+}
+
+static void lru_unlink(RF_TileCache* tc, int32_t i) {
+    RF_TileEntry* e = &tc->entries[i];
+    if (e->lru_prev != NO_TILE) { tc->entries[e->lru_prev].lru_next = e->lru_next; } else { tc->lru_head = e->lru_next; }
+    if (e->lru_next != NO_TILE) { tc->entries[e->lru_next].lru_prev = e->lru_prev; } else { tc->lru_tail = e->lru_prev; }
+}
+
+static void lru_push_front(RF_TileCache* tc, int32_t i) {
+    RF_TileEntry* e = &tc->entries[i];
+    e->lru_prev = NO_TILE;
+    e->lru_next = tc->lru_head;
+    if (tc->lru_head != NO_TILE) { tc->entries[tc->lru_head].lru_prev = i; } else { tc->lru_tail = i; }
+    tc->lru_head = i;
+}
+
+static int32_t tile_lookup(const RF_TileCache* tc, const uint32_t* key) {
+    int32_t i;
+    for (i = tc->buckets[tile_hash(key) & tc->hash_mask];  i != NO_TILE;  i = tc->entries[i].hash_next) {
+        if (!memcmp((const void*)tc->entries[i].key, (const void*)key, sizeof(tc->entries[i].key))) { break; }
+    }
+    return i;
+}
+
+// look up a tile; returns its pixel data, or NULL if it's not in the cache
+const uint8_t* RF_TileCacheFind(void* tc_, const uint32_t* key) {
+    RF_TileCache* tc = (RF_TileCache*) tc_;
+    int32_t i = tile_lookup(tc, key);
+    if (i == NO_TILE) { return NULL; }
+    if (tc->lru_head != i) {
+        lru_unlink(tc, i);
+        lru_push_front(tc, i);
+    }
+    return &tc->pixels[(size_t)i * tc->tile_bytes];
+}
+
+// look up a tile without marking it as recently used; unlike
+// RF_TileCacheFind(), this doesn't modify the cache, so it can be
+// called from multiple threads at once (as long as nobody inserts tiles)
+const uint8_t* RF_TileCachePeek(const void* tc_, const uint32_t* key) {
+    const RF_TileCache* tc = (const RF_TileCache*) tc_;
+    int32_t i = tile_lookup(tc, key);
+    return (i == NO_TILE) ? NULL : &tc->pixels[(size_t)i * tc->tile_bytes];
+}
+
+// add a tile (evicting the least recently used one if the cache is full);
+// returns the location where the caller shall store the tile's pixel data
+uint8_t* RF_TileCacheInsert(void* tc_, const uint32_t* key) {
+    RF_TileCache* tc = (RF_TileCache*) tc_;
+    int32_t i;
+    if (tc->count < tc->capacity) {
+        i = tc->count++;
+    } else {
+        // evict the least recently used tile
+        int32_t *link;
+        i = tc->lru_tail;
+        lru_unlink(tc, i);
+        link = &tc->buckets[tile_hash(tc->entries[i].key) & tc->hash_mask];
+        while (*link != i) { link = &tc->entries[*link].hash_next; }
+        *link = tc->entries[i].hash_next;
+    }
+    memcpy((void*)tc->entries[i].key, (const void*)key, sizeof(tc->entries[i].key));
+    {
+        int32_t* bucket = &tc->buckets[tile_hash(key) & tc->hash_mask];
+        tc->entries[i].hash_next = *bucket;
+        *bucket = i;
+    }
+    lru_push_front(tc, i);
+    return &tc->pixels[(size_t)i * tc->tile_bytes];
+}
@@ -0,0 +1,131 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+// UTF-8 validation for text ingest (RF_AddText() / RF_Feed()) and charset
+// detection (RF_DetectCharset() / RF_Detector).
+// "Valid" is defined by the rules of the byte-wise decoder in rfcore.c, not
+// by the strict Unicode definition: a lead byte 0xC0-0xDF, 0xE0-0xEF or
+// 0xF0-0xF7 must be followed by exactly 1, 2 or 3 continuation bytes
+// (0x80-0xBF), and every other byte >= 0x80 is an error. Overlong forms and
+// surrogates are accepted, because the decoder accepts them as well; this way,
+// skipping the decoder for validated data can't change which characters end
+// up as U+FFFD.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define RF_HAVE_SSE2_UTF8
+    #include <emmintrin.h>
+#endif
+
+// length of a sequence, given its lead byte (0 = invalid lead byte)
+static inline size_t sequence_length(uint8_t c) {
+    if (c < 0x80) { return 1; }
+    if (c < 0xC0) { return 0; }
+    if (c < 0xE0) { return 2; }
+    if (c < 0xF0) { return 3; }
+    if (c < 0xF8) { return 4; }
+    return 0;
+}
+
+// validate the sequences starting between pos and stop-1; returns the end of
+// the last complete, valid sequence (which may be beyond stop)
+static size_t validate_scalar(const uint8_t* data, size_t pos, size_t len, size_t stop) {
+    while ((pos < stop) && (pos < len)) {
+        size_t n = sequence_length(data[pos]);
+        if (!n || (n > (len - pos))) { break; }
+        for (size_t i = 1;  i < n;  ++i) {
+            if ((data[pos + i] & 0xC0) != 0x80) { return pos; }
+        }
+        pos += n;
+    }
+    return pos;
+}
+
+// portable version of RF_UTF8ValidPrefix(); the SIMD version must return
+// the same results (tests/test_utf8.c checks that)
+size_t RF_UTF8ValidPrefixScalar(const uint8_t* data, size_t len) {
+    return data ? validate_scalar(data, 0, len, len) : 0;
+}
+
+#ifdef RF_HAVE_SSE2_UTF8
+
+// find the start of a sequence that might straddle pos
+// (all data before pos must be validated already)
+static size_t sequence_start(const uint8_t* data, size_t pos) {
+    for (size_t back = 1;  (back <= 3) && (back <= pos);  ++back) {
+        uint8_t c = data[pos - back];
+        if (c < 0x80) { break; }
+        if (c >= 0xC0) { return (sequence_length(c) > back) ? (pos - back) : pos; }
+    }
+    return pos;
+}
+
+// unsigned "a >= b" for bytes
+static inline __m128i cmpge_epu8(__m128i a, __m128i b) {
+    return _mm_cmpeq_epi8(_mm_max_epu8(a, b), a);
+}
+
+size_t RF_UTF8ValidPrefix(const uint8_t* data, size_t len) {
+    const __m128i c0 = _mm_set1_epi8((char)0xC0), e0 = _mm_set1_epi8((char)0xE0);
+    const __m128i f0 = _mm_set1_epi8((char)0xF0), f8 = _mm_set1_epi8((char)0xF8);
+    const __m128i cont = _mm_set1_epi8((char)0x80);
+    size_t pos;
+    if (!data) { return 0; }
+
+    // the vector loop looks back 3 bytes, so the first few are done here
+    pos = validate_scalar(data, 0, len, 3);
+    if (pos < 3) { return pos; }
+
+    // 16 bytes at a time: a byte must be a continuation byte if and only if
+    // one of the three bytes before it is a lead byte that asks for it
+    while ((pos + 16) <= len) {
+        const __m128i c  = _mm_loadu_si128((const __m128i*)&data[pos]);
+        const __m128i p3 = _mm_loadu_si128((const __m128i*)&data[pos - 3]);
+        if (_mm_movemask_epi8(_mm_or_si128(c, p3))) {
+            const __m128i p1 = _mm_loadu_si128((const __m128i*)&data[pos - 1]);
+            const __m128i p2 = _mm_loadu_si128((const __m128i*)&data[pos - 2]);
+            __m128i need = _mm_or_si128(_mm_or_si128(cmpge_epu8(p1, c0), cmpge_epu8(p2, e0)), cmpge_epu8(p3, f0));
+            __m128i is_cont = _mm_cmpeq_epi8(_mm_and_si128(c, c0), cont);
+            __m128i err = _mm_or_si128(_mm_xor_si128(need, is_cont), cmpge_epu8(c, f8));
+            if (_mm_movemask_epi8(err)) {
+                // the scalar code finds the exact position of the error
+                break;
+            }
+        }
+        pos += 16;
+    }
+
+    // remainder, error blocks and sequences that are cut off at the end
+    pos = sequence_start(data, pos);
+    return validate_scalar(data, pos, len, len);
+}
+
+// skip 16-byte blocks of 7-bit ASCII text that contain neither Escape nor
+// backtick characters (i.e. nothing that could affect the character set or
+// markup type detection); returns the number of bytes skipped
+size_t RF_SkipPlainASCII(const uint8_t* data, size_t len) {
+    const __m128i esc = _mm_set1_epi8(27), bt = _mm_set1_epi8('`');
+    size_t pos = 0;
+    while ((pos + 16) <= len) {
+        const __m128i c = _mm_loadu_si128((const __m128i*)&data[pos]);
+        if (_mm_movemask_epi8(_mm_or_si128(c, _mm_or_si128(_mm_cmpeq_epi8(c, esc), _mm_cmpeq_epi8(c, bt))))) { break; }
+        pos += 16;
+    }
+    return pos;
+}
+
+#else // !RF_HAVE_SSE2_UTF8
+
+size_t RF_UTF8ValidPrefix(const uint8_t* data, size_t len) {
+    return RF_UTF8ValidPrefixScalar(data, len);
+}
+
+size_t RF_SkipPlainASCII(const uint8_t* data, size_t len) {
+    (void)data, (void)len;
+    return 0;  // not worth it without SIMD; the caller checks byte by byte
+}
+
+#endif // RF_HAVE_SSE2_UTF8
@@ -25,9 +25,12 @@ uint32_t amiga_map_border_color(RF_Context* ctx, uint32_t color) {
     return amiga_map_color(ctx->system->sys_id, color, false);
 }
 
-void amiga_prepare_cell(RF_RenderCommand* cmd) {
+void amiga_map_cell_colors(RF_RenderCommand* cmd) {
     cmd->fg = amiga_map_color(cmd->ctx->system->sys_id, cmd->fg, true);
     cmd->bg = amiga_map_color(cmd->ctx->system->sys_id, cmd->bg, false);
+}
+
+void amiga_prepare_cell(RF_RenderCommand* cmd) {
     cmd->reverse_cursor = cmd->is_cursor;
     // The AmigaOS API has support for bold and underline text, so assume
     // that there attributes are supported.
@@ -46,6 +49,8 @@ static const RF_SysClass amigaclass = {
     amiga_prepare_cell,
     NULL,  // render_cell = default
     amiga_check_font,
+    amiga_map_cell_colors,
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char ks13default[] =
@@ -39,6 +39,8 @@ static const RF_SysClass a2class = {
     a2_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    NULL,  // map_cell_colors = none
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char defaulta1[]  = "\\\n";
@@ -54,12 +54,15 @@ uint32_t atari8_map_border_color(RF_Context* ctx, uint32_t color) {
     return atari8_palettes[atari8_map_color(ctx, color, 0)];
 }
 
-void atari8_prepare_cell(RF_RenderCommand* cmd) {
+void atari8_map_cell_colors(RF_RenderCommand* cmd) {
     cmd->bg = atari8_map_color(cmd->ctx, cmd->ctx->default_bg, 0x29);
     cmd->fg = atari8_map_color(cmd->ctx, cmd->ctx->default_fg, 0x50);
     cmd->fg = (cmd->fg & 0xF0) | (cmd->bg & 0x0F);  // ANTIC mode 2 color mapping
     cmd->fg = atari8_palettes[cmd->fg];
     cmd->bg = atari8_palettes[cmd->bg];
+}
+
+void atari8_prepare_cell(RF_RenderCommand* cmd) {
     cmd->reverse_cursor = cmd->is_cursor;
 }
 
@@ -68,6 +71,8 @@ static const RF_SysClass a8class = {
     atari8_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    atari8_map_cell_colors,
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char a8default[] =
@@ -53,16 +53,12 @@ void bbc_render_cell(RF_RenderCommand* cmd) {
 
     // draw the inverted cursor
     if (cursor) {
-        uint8_t* p = &cmd->pixel[cmd->ctx->stride * 7];
-        for (uint8_t c = 24;  c;  --c) {
-            *p ^= 0xFF;
-            ++p;
-        }
+        RF_InvertPixels(cmd->ctx, &cmd->pixel[cmd->ctx->stride * 7], 8);
     }
 
     // fill spacer lines in text mode with black (or white if the cursor is here)
     for (size_t y = 8;  y < cmd->ctx->system->cell_size.y;  ++y) {
-        memset(&cmd->pixel[cmd->ctx->stride * y], cursor ? 0xFF : 0, 24);
+        RF_FillPixels(cmd->ctx, &cmd->pixel[cmd->ctx->stride * y], cursor ? 0xFFFFFF : 0x000000, 8);
     }
 }
 
@@ -71,6 +67,8 @@ static const RF_SysClass bbcclass = {
     NULL,  // prepare_cell = default
     bbc_render_cell,
     NULL,  // check_font = default
+    NULL,  // map_cell_colors = none
+    true,  // render_cell_cacheable
 };
 
 static const char defaultbbc[] =
@@ -87,9 +87,12 @@ uint32_t cbm_map_border_color(RF_Context* ctx, uint32_t color) {
     return cbm_map_color(ctx, color, true, true);
 }
 
-void cbm_prepare_cell(RF_RenderCommand* cmd) {
+void cbm_map_cell_colors(RF_RenderCommand* cmd) {
     cmd->fg = cbm_map_color(cmd->ctx, cmd->fg, true, false);
     cmd->bg = cbm_map_color(cmd->ctx, cmd->ctx->default_bg, false, false);
+}
+
+void cbm_prepare_cell(RF_RenderCommand* cmd) {
     cmd->reverse_cursor = cmd->is_cursor && !(cmd->blink_phase & 1);
 }
 
@@ -105,7 +108,7 @@ void pet_render_cell(RF_RenderCommand* cmd) {
     RF_RenderCell(cmd);
     if (cmd->ctx->system->cell_size.y > 8) {
         // PET 8032's ninth row is *always* black
-        memset(&cmd->pixel[cmd->ctx->stride * 8], 0, 24);
+        RF_FillPixels(cmd->ctx, &cmd->pixel[cmd->ctx->stride * 8], 0x000000, 8);
     }
 }
 
@@ -114,6 +117,8 @@ static const RF_SysClass cbmclass = {
     cbm_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    cbm_map_cell_colors,
+    false,  // render_cell_cacheable = n/a
 };
 
 static const RF_SysClass petclass = {
@@ -121,6 +126,8 @@ static const RF_SysClass petclass = {
     NULL,  // prepare_cell = default (unused)
     pet_render_cell,
     NULL,  // check_font = default
+    NULL,  // map_cell_colors = none
+    true,  // render_cell_cacheable
 };
 
 static const char pet40default[] =
@@ -87,6 +87,8 @@ static const RF_SysClass cpcclass = {
     cpc_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    NULL,  // map_cell_colors = none
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char cpcdefault[] =
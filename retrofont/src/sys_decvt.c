@@ -41,6 +41,8 @@ static const RF_SysClass decvtclass = {
     decvt_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    NULL,  // map_cell_colors = none
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char vt100default[] =
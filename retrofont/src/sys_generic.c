@@ -10,12 +10,15 @@ uint32_t gen_map_border_color(RF_Context* ctx, uint32_t color) {
     return RF_MapStandardColorToRGB(color, 0,160, 0,255);
 }
 
-void gen_prepare_cell(RF_RenderCommand* cmd) {
+void gen_map_cell_colors(RF_RenderCommand* cmd) {
     if (cmd->fg == RF_COLOR_DEFAULT) { cmd->fg = 0xEEDC82; }
     if (cmd->bg == RF_COLOR_DEFAULT) { cmd->bg = 0x000000; }
     if (cmd->cell->dim) {
         cmd->fg = ((cmd->fg & 0xFEFEFE) + (cmd->bg & 0xFEFEFE)) >> 1;
     }
+}
+
+void gen_prepare_cell(RF_RenderCommand* cmd) {
     cmd->reverse_cursor = cmd->is_cursor;
     cmd->bold = !!(cmd->cell->bold);
     cmd->underline = !!(cmd->cell->underline);
@@ -26,6 +29,8 @@ static const RF_SysClass genclass = {
     gen_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    gen_map_cell_colors,
+    false,  // render_cell_cacheable = n/a
 };
 
 //                                 sys_id,            name,      class,    scrn, scrsz,   cellsz, fontsz, b_ul,  b_lr, aspect, blink, monitor,          default_font_id
@@ -33,11 +33,14 @@ uint32_t mc6847_map_color(RF_Context* ctx, uint32_t color, uint8_t default_index
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void atom_prepare_cell(RF_RenderCommand* cmd) {
+void atom_map_cell_colors(RF_RenderCommand* cmd) {
     uint32_t color = RF_MapStandardColorToRGB((cmd->ctx->default_fg == RF_COLOR_DEFAULT) ? RF_COLOR_GREEN : cmd->ctx->default_fg, 0,255, 0,255);
     bool is_orange = (RF_COLOR_R(color) > RF_COLOR_G(color)) || ((RF_COLOR_B(color) < RF_COLOR_G(color)) && (RF_COLOR_B(color) < RF_COLOR_R(color)));
     cmd->fg = mc6847_palette[is_orange ?  7 : 0];
     cmd->bg = mc6847_palette[is_orange ? 10 : 9];
+}
+
+void atom_prepare_cell(RF_RenderCommand* cmd) {
     cmd->reverse_cursor = cmd->is_cursor;
 }
 
@@ -46,6 +49,8 @@ static const RF_SysClass atomclass = {
     atom_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    atom_map_cell_colors,
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char defaultatom[] = "ACORN ATOM\n\n>";
@@ -82,6 +87,8 @@ static const RF_SysClass cococlass = {
     coco_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    NULL,  // map_cell_colors = none
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char defaultcoco[] =
@@ -3,10 +3,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "retrofont.h"
 
 #define SYSTEM_IS_MDA(sys_id)  ((sys_id) == RF_MAKE_ID('P','M','D','A'))
+#define IS_BLINKING_TEXT_MODE(sys_id) ((RF_EXTRACT_ID(sys_id, 3) != 'g') && (RF_EXTRACT_ID(sys_id, 3) != 't'))
 
 #define pc_std_color(color) RF_MapRGBToStandardColor(color, 200)
 
@@ -26,8 +28,7 @@ uint32_t pc_map_border_color(RF_Context* ctx, uint32_t color) {
     }
 }
 
-void pc_render_cell(RF_RenderCommand* cmd) {
-    bool is_gfx = (RF_EXTRACT_ID(cmd->ctx->system->sys_id, 3) == 'g');
+void pc_map_cell_colors(RF_RenderCommand* cmd) {
     bool is_mda = SYSTEM_IS_MDA(cmd->ctx->system->sys_id);
 
     // resolve to standard color
@@ -45,17 +46,24 @@ void pc_render_cell(RF_RenderCommand* cmd) {
             { cmd->bg = RF_COLOR_BLACK | (cmd->bg & RF_COLOR_BRIGHT); }
     }
 
-    // text mode blink handling
-    if (!is_gfx && (RF_EXTRACT_ID(cmd->ctx->system->sys_id, 3) != 't')) {
-        cmd->bg &= ~RF_COLOR_BRIGHT;  // no bright background
-        if (cmd->cell->blink && !(cmd->blink_phase & 1)) {
-            cmd->invisible = true;
-        }
+    // no bright background in blinking text modes
+    if (IS_BLINKING_TEXT_MODE(cmd->ctx->system->sys_id)) {
+        cmd->bg &= ~RF_COLOR_BRIGHT;
     }
 
     // map color back to RGB
     cmd->fg = pc_rgb_color(cmd->fg);
     cmd->bg = pc_rgb_color(cmd->bg);
+}
+
+void pc_render_cell(RF_RenderCommand* cmd) {
+    bool is_gfx = (RF_EXTRACT_ID(cmd->ctx->system->sys_id, 3) == 'g');
+    bool is_mda = SYSTEM_IS_MDA(cmd->ctx->system->sys_id);
+
+    // text mode blink handling (colors have already been resolved by pc_map_cell_colors)
+    if (IS_BLINKING_TEXT_MODE(cmd->ctx->system->sys_id) && cmd->cell->blink && !(cmd->blink_phase & 1)) {
+        cmd->invisible = true;
+    }
 
     // set cursor
     if (cmd->is_cursor && !(cmd->blink_phase & 1) && !is_gfx) {
@@ -82,11 +90,10 @@ void pc_render_cell(RF_RenderCommand* cmd) {
     ||  ((cmd->codepoint & (~0x0F)) == 0x2580)
     ||  ( cmd->codepoint            == 0x2590)
     )) {
-        uint8_t *p = &cmd->pixel[7 * 3];
+        const uint8_t bpp = cmd->ctx->bytes_per_pixel;
+        uint8_t *p = &cmd->pixel[7 * bpp];
         for (uint16_t i = cmd->ctx->cell_size.y;  i;  --i) {
-            p[3] = p[0];
-            p[4] = p[1];
-            p[5] = p[2];
+            memcpy((void*)&p[bpp], (const void*)p, bpp);
             p += cmd->ctx->stride;
         }
     }
@@ -97,6 +104,8 @@ static const RF_SysClass pcclass = {
     NULL,  // prepare_cell = default (unused)
     pc_render_cell,
     NULL,  // check_font = default
+    pc_map_cell_colors,
+    true,  // render_cell_cacheable
 };
 
 static const char default_pc[] =
@@ -20,12 +20,15 @@ uint32_t kc85_map_border_color(RF_Context* ctx, uint32_t color) {
     return 0;  // border is always black
 }
 
-void kc85_prepare_cell(RF_RenderCommand* cmd) {
-    bool line_cursor = cmd->is_cursor && (cmd->codepoint == 32);
+void kc85_map_cell_colors(RF_RenderCommand* cmd) {
     cmd->fg = kc85_pre_map_color(cmd->fg, RF_COLOR_WHITE);
     cmd->bg = kc85_pre_map_color(cmd->bg, RF_COLOR_BLUE);
     cmd->fg = kc85_fg_color_map[cmd->fg & 15];
     cmd->bg = RF_MapStandardColorToRGB(cmd->bg, 0,160, 0,160);
+}
+
+void kc85_prepare_cell(RF_RenderCommand* cmd) {
+    bool line_cursor = cmd->is_cursor && (cmd->codepoint == 32);
     if (line_cursor) {
         cmd->line_start = 6;
         cmd->line_end = 7;
@@ -39,6 +42,8 @@ static const RF_SysClass kc85class = {
     kc85_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    kc85_map_cell_colors,
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char kc85default[] =
@@ -76,9 +81,12 @@ uint32_t kc87_map_border_color(RF_Context* ctx, uint32_t color) {
     return kc87_map_color(color, RF_COLOR_BLACK);
 }
 
-void kc87_prepare_cell(RF_RenderCommand* cmd) {
+void kc87_map_cell_colors(RF_RenderCommand* cmd) {
     cmd->fg = kc87_map_color(cmd->fg, RF_COLOR_WHITE);
     cmd->bg = kc87_map_color(cmd->bg, RF_COLOR_BLACK);
+}
+
+void kc87_prepare_cell(RF_RenderCommand* cmd) {
     cmd->reverse_cursor = cmd->is_cursor && !(cmd->blink_phase & 1);
     cmd->reverse_blink = !cmd->is_cursor && cmd->cell->blink && (cmd->blink_phase & 1);
 }
@@ -88,6 +96,8 @@ static const RF_SysClass kc87class = {
     kc87_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    kc87_map_cell_colors,
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char kc87default[] = "`f4robotron  Z 9001\n`0\n`F2OS\n>";
@@ -109,6 +119,8 @@ static const RF_SysClass z1013class = {
     z1013_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    NULL,  // map_cell_colors = none
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char default1013[] = "robotron Z 1013/A.2\n # ";
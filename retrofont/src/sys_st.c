@@ -31,9 +31,12 @@ uint32_t st_map_border_color(RF_Context* ctx, uint32_t color) {
     return st_map_color(ctx->system->sys_id, color, RF_COLOR_WHITE | RF_COLOR_BRIGHT);
 }
 
-void st_prepare_cell(RF_RenderCommand* cmd) {
+void st_map_cell_colors(RF_RenderCommand* cmd) {
     cmd->fg = st_map_color(cmd->ctx->system->sys_id, cmd->fg, RF_COLOR_BLACK);
     cmd->bg = st_map_color(cmd->ctx->system->sys_id, cmd->bg, RF_COLOR_WHITE | RF_COLOR_BRIGHT);
+}
+
+void st_prepare_cell(RF_RenderCommand* cmd) {
     cmd->reverse_cursor = cmd->is_cursor;
 }
 
@@ -42,6 +45,8 @@ static const RF_SysClass stclass = {
     st_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    st_map_cell_colors,
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char stdefault[] = "`y12Memory Test:\nST RAM       `+r  1024 KB`0\nMemory Test Complete.\n\n";
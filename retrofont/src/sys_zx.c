@@ -27,7 +27,7 @@ uint32_t zx_map_border_color(RF_Context* ctx, uint32_t color) {
     }
 }
 
-void zx_prepare_cell(RF_RenderCommand* cmd) {
+void zx_map_cell_colors(RF_RenderCommand* cmd) {
     if (IS_SPECTRUM(cmd->ctx->system->sys_id)) {
         cmd->fg = zx_std_color(cmd->fg, true);
         cmd->bg = zx_std_color(cmd->bg, false);
@@ -47,6 +47,9 @@ void zx_prepare_cell(RF_RenderCommand* cmd) {
         cmd->fg = 0;
         cmd->bg = 0xFFFFFF;
     }
+}
+
+void zx_prepare_cell(RF_RenderCommand* cmd) {
     cmd->reverse_cursor = cmd->is_cursor   && !(cmd->blink_phase & 1);
     cmd->reverse_blink  = cmd->cell->blink && !(cmd->blink_phase & 1);
 }
@@ -56,6 +59,8 @@ static const RF_SysClass zxclass = {
     zx_prepare_cell,
     NULL,  // render_cell = default
     NULL,  // check_font = default
+    zx_map_cell_colors,
+    false,  // render_cell_cacheable = n/a
 };
 
 static const char zx81default[] = "`x00`Y01K`x00";
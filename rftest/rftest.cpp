@@ -188,7 +188,8 @@ int RFTestApp::run(int argc, char *argv[]) {
             return 1;
         }
     }
-    RF_ResizeScreen(m_ctx, 0, 0, true);
+    RF_SetRenderThreads(m_ctx, RF_THREADS_AUTO);
+    RF_ResizeScreenEx(m_ctx, 0, 0, true, RF_PF_RGBA8888, 4);
     loadDefaultScreen();
 
     // main loop
@@ -225,29 +226,42 @@ int RFTestApp::run(int argc, char *argv[]) {
 
         // update typewriter
         if (m_typerStr) {
-            int start = m_typerPos;
             int end = getTyperPos();
-            while ((m_typerPos < end) && m_typerStr[m_typerPos]) {
-                ++m_typerPos;
-            }
-            if (m_typerPos > start) {
-                char old = m_typerStr[m_typerPos];
-                m_typerStr[m_typerPos] = '\0';
-                RF_AddText(m_ctx, &m_typerStr[start], m_typerCharset, m_typerType);
-                m_typerStr[m_typerPos] = old;
-                if (!old) { cancelTyper(); }  // EOS reached
+            if (end > m_typerLen) { end = m_typerLen; }
+            if (end > m_typerPos) {
+                RF_Feed(m_ctx, &m_typerStr[m_typerPos], size_t(end - m_typerPos), m_typerCharset, m_typerType);
+                m_typerPos = end;
             }
+            if (m_typerPos >= m_typerLen) { cancelTyper(); }  // EOS reached
             requestFrames(1);
         }
 
         // process screen content update from RetroFont library
         if (m_ctx) {
-            if (RF_Render(m_ctx, uint32_t(glfwGetTime() * 1000.0))) {
+            RF_Rect rects[16];
+            int nRects = RF_RenderEx(m_ctx, uint32_t(glfwGetTime() * 1000.0), rects, 16);
+            if (nRects > 0) {
                 glBindTexture(GL_TEXTURE_2D, m_tex);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8,
-                             m_ctx->bitmap_size.x, m_ctx->bitmap_size.y,
-                             0, GL_RGB, GL_UNSIGNED_BYTE,
-                             (const void*) m_ctx->bitmap);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, int(m_ctx->stride / m_ctx->bytes_per_pixel));
+                if ((m_texWidth != m_ctx->bitmap_size.x) || (m_texHeight != m_ctx->bitmap_size.y)) {
+                    // size changed -> (re-)allocate and upload the full texture
+                    m_texWidth  = m_ctx->bitmap_size.x;
+                    m_texHeight = m_ctx->bitmap_size.y;
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
+                                 m_texWidth, m_texHeight,
+                                 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                                 (const void*) m_ctx->bitmap);
+                } else {
+                    // same size -> upload the changed parts only
+                    for (int i = 0;  i < nRects;  ++i) {
+                        const RF_Rect& r = rects[i];
+                        glTexSubImage2D(GL_TEXTURE_2D, 0,
+                                        r.ul.x, r.ul.y, r.lr.x - r.ul.x, r.lr.y - r.ul.y,
+                                        GL_RGBA, GL_UNSIGNED_BYTE,
+                                        (const void*) &m_ctx->bitmap[r.ul.y * m_ctx->stride + r.ul.x * m_ctx->bytes_per_pixel]);
+                    }
+                }
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
                 glBindTexture(GL_TEXTURE_2D, 0);
                 GLutil::checkError("texture update");
             }
@@ -421,11 +435,12 @@ void RFTestApp::handleKeyEvent(int key, int scancode, int action, int mods) {
             }
             break;
         case GLFW_KEY_END:
-            if (m_ctx && m_ctx->screen && (m_ctx->cursor_pos.y < m_ctx->screen_size.y)) {
+            if (m_ctx && (m_ctx->cursor_pos.y < m_ctx->screen_size.y)) {
                 uint16_t x = m_ctx->screen_size.x - 1;
-                const RF_Cell* pos = &m_ctx->screen[m_ctx->cursor_pos.y * m_ctx->screen_size.x + x];
-                while (x && ((pos->codepoint == 32) || (pos->codepoint == 0))) {
-                    --x;  --pos;
+                RF_Cell cell;
+                while (x && RF_ReadCell(m_ctx, x, m_ctx->cursor_pos.y, &cell)
+                         && ((cell.codepoint == 32) || (cell.codepoint == 0))) {
+                    --x;
                 }
                 if ((x + 1) < m_ctx->screen_size.x) { ++x; }
                 RF_MoveCursor(m_ctx, x, m_ctx->cursor_pos.y);
@@ -592,10 +607,9 @@ void RFTestApp::loadDefaultScreen(int type) {
     }
     RF_MoveCursor(m_ctx, 0, 0);
     if (type == dsDefault) {
-        RF_AddText(m_ctx,
-            (m_ctx && m_ctx->system && m_ctx->system->default_screen)
-                                     ? m_ctx->system->default_screen
-                                     : DefaultDefaultScreen, 0, RF_MT_INTERNAL);
+        if (!RF_LoadDefaultScreen(m_ctx)) {
+            RF_AddText(m_ctx, DefaultDefaultScreen, 0, RF_MT_INTERNAL);
+        }
     } else if ((type == dsPrevious) && m_docData) {
         RF_AddText(m_ctx, m_docData, m_docCharset ? m_docCharset : m_docAutoCharset, m_docType);
         m_justLoadedDocument = true;
@@ -611,6 +625,7 @@ void RFTestApp::loadScreen(const char* text, const RF_Charset* charset, RF_Marku
     RF_MoveCursor(m_ctx, 0, 0);
     if (m_baud) {
         m_typerStr = StringUtil::copy(text);
+        m_typerLen = m_typerStr ? int(strlen(m_typerStr)) : 0;
         m_typerCharset = charset;
         m_typerType = markup;
         m_typerStartPos = m_typerPos = 0;
@@ -629,8 +644,12 @@ void RFTestApp::handleDropEvent(int path_count, const char* paths[]) {
     char* eof;
     eof = const_cast<char*>(strstr(m_docData, "\x1A" "SAUCE00"));  if (eof) { *eof = '\0'; }
     eof = const_cast<char*>(strstr(m_docData, "\x1A" "COMNT"));    if (eof) { *eof = '\0'; }
-    m_docAutoCharset = RF_DetectCharset(m_docData);
-    m_docType = RF_DetectMarkupType(m_docData);
+    RF_Detector det;
+    RF_InitDetector(&det, 0, 0);
+    RF_FeedDetector(&det, m_docData, strlen(m_docData));
+    RF_FinishDetector(&det);
+    m_docAutoCharset = det.charset;
+    m_docType = det.markup;
     loadScreen(m_docData, m_docCharset ? m_docCharset : m_docAutoCharset, m_docType);
     m_justLoadedDocument = true;
 }
@@ -796,7 +815,7 @@ void RFTestApp::drawUI() {
             if (ImGui::Selectable("immediately", &sel)) {
                 m_baud = 0;
                 if (m_typerStr) {
-                    RF_AddText(m_ctx, &m_typerStr[m_typerPos], m_typerCharset, m_typerType);
+                    RF_Feed(m_ctx, &m_typerStr[m_typerPos], size_t(m_typerLen - m_typerPos), m_typerCharset, m_typerType);
                 }
                 cancelTyper();
             }
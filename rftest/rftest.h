@@ -23,6 +23,8 @@ class RFTestApp {
 
     // rendering stuff
     GLuint m_tex = 0;
+    int m_texWidth = 0;
+    int m_texHeight = 0;
     GLutil::Program m_prog;
     GLfloat m_area[4];
     GLint m_locArea;
@@ -49,6 +51,7 @@ class RFTestApp {
     // automatic typewriter state
     char* m_typerStr = nullptr;
     int m_typerPos = 0;
+    int m_typerLen = 0;
     const RF_Charset* m_typerCharset = nullptr;
     RF_MarkupType m_typerType = RF_MT_NONE;
     double m_typerStartTime = 0.0;
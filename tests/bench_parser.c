@@ -0,0 +1,78 @@
+// Measure the throughput of the ANSI markup parser: a synthetic stream of
+// typical ANSI art (SGR color changes, cursor positioning, line erasing and
+// runs of CP437 block characters and text) is fed through RF_Feed() in
+// pipe-sized chunks, and the best of several passes is reported in MB/s.
+// Usage: bench_parser [megabytes]
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "retrofont.h"
+
+#define CHUNK_SIZE 4096
+#define PASSES 5
+
+// append a random piece of ANSI art (at most 64 bytes) to the buffer
+static size_t make_piece(char* p) {
+    size_t n;
+    switch (rand() % 10) {
+        case 0: case 1: case 2: case 3:
+            n = (size_t)sprintf(p, "\x1b[%d;%dm", rand() % 2, 30 + rand() % 8);  break;
+        case 4: case 5:
+            n = (size_t)sprintf(p, "\x1b[%d;%dH", 1 + rand() % 25, 1 + rand() % 80);  break;
+        case 6:
+            n = (size_t)sprintf(p, "\x1b[%dC", 1 + rand() % 10);  break;
+        case 7:
+            n = (size_t)sprintf(p, "\x1b[K");  break;
+        case 8:
+            n = (size_t)sprintf(p, "\x1b[s\x1b[u");  break;
+        default:
+            n = (size_t)sprintf(p, "\x1b[0;1;4%dm", rand() % 8);  break;
+    }
+    for (int len = rand() % 24;  len;  --len) {
+        p[n++] = (rand() % 4) ? "\xB0\xB1\xB2\xDB\xDC\xDF"[rand() % 6] : (char)('a' + rand() % 26);
+    }
+    if (!(rand() % 10)) { p[n++] = '\r';  p[n++] = '\n'; }
+    return n;
+}
+
+int main(int argc, char** argv) {
+    size_t size = (size_t)((argc > 1) ? atoi(argv[1]) : 16) << 20;
+    const RF_Charset* cp437 = NULL;
+    RF_Context* ctx;
+    char* data;
+    size_t len = 0;
+    double best = 0.0;
+
+    for (const RF_Charset* cs = RF_Charsets;  cs->charset_id;  ++cs) {
+        if (cs->codepage == 437) { cp437 = cs;  break; }
+    }
+    data = (char*) malloc(size + 64);
+    ctx = RF_CreateContext(0);
+    if (!size || !data || !ctx || !RF_ResizeScreen(ctx, 80, 25, false)) {
+        printf("initialization failed\n");
+        return 1;
+    }
+    srand(1);
+    while (len < size) { len += make_piece(&data[len]); }
+
+    for (int pass = 0;  pass < PASSES;  ++pass) {
+        clock_t t0 = clock();
+        double sec;
+        RF_ResetParser(ctx);
+        for (size_t pos = 0;  pos < len;  pos += CHUNK_SIZE) {
+            RF_Feed(ctx, &data[pos], ((len - pos) < CHUNK_SIZE) ? (len - pos) : CHUNK_SIZE, cp437, RF_MT_ANSI);
+        }
+        sec = (double)(clock() - t0) / CLOCKS_PER_SEC;
+        if ((sec > 0.0) && ((best <= 0.0) || (sec < best))) { best = sec; }
+    }
+    printf("parsed %.1f MB of ANSI data: %.1f MB/s\n", (double)len / 1048576.0, (best > 0.0) ? ((double)len / 1048576.0 / best) : 0.0);
+
+    RF_DestroyContext(ctx);
+    free((void*)data);
+    return 0;
+}
@@ -0,0 +1,223 @@
+// Check that streaming input in arbitrary chunks gives the same results as
+// passing it all at once: random documents with ANSI, internal or no markup,
+// in UTF-8 or CP437, are split into random pieces of 1 to 7 bytes (so that
+// UTF-8 and markup sequences are cut everywhere) and fed through RF_Feed()
+// and an RF_Detector, and the screens, cursors and attributes or the
+// detection results must match those of a single RF_Feed() / RF_FeedDetector()
+// call with the whole document.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+#define NUM_DOCS 60          // number of documents per markup type and character set
+#define NUM_SPLITS 4         // number of different random splits per document
+#define DOC_SIZE 3000        // maximum size of a document for RF_Feed()
+#define BIG_DOC_SIZE 200000  // approximate size of a document that is large enough for sampling
+#define MAX_PIECE 48         // maximum size of a piece generated by add_piece()
+
+static const RF_MarkupType markup_types[3] = { RF_MT_ANSI, RF_MT_INTERNAL, RF_MT_NONE };
+static const char* const markup_names[3] = { "ANSI", "internal", "no" };
+
+static const char* const ansi_pieces[] = {
+    "\x1b[0m", "\x1b[1;31m", "\x1b[5;44m", "\x1b[7m", "\x1b[38;5;208m", "\x1b[48;2;10;20;30m",
+    "\x1b[10;5H", "\x1b[H", "\x1b[3A", "\x1b[2C", "\x1b[K", "\x1b[1J", "\x1b[s", "\x1b[u",
+    "\x1b[5;20r", "\x1b[r", "\x1b[2L", "\x1b[M", "\x1b[?25l", "\x1b]0;title\x07", "\x1b" "7", "\x1b" "8",
+};
+
+static const char* const internal_pieces[] = {
+    "`f4", "`bC", "`f-", "`b#204080", "`+b", "`-b", "`+r", "`-u", "`+f", "`0",
+    "`x05", "`X10", "`c20", "`y03", "`Y02", "`C04", "`z", "`u20AC", "`U01F600", "``", "`q", "`f#12",
+};
+
+// random value in the range [lo, hi]
+static int rand_range(int lo, int hi) {
+    return lo + (rand() % (hi - lo + 1));
+}
+
+// append a codepoint in UTF-8 encoding
+static size_t put_utf8(uint8_t* p, uint32_t cp) {
+    if (cp < 0x80)    { p[0] = (uint8_t)cp;  return 1; }
+    if (cp < 0x800)   { p[0] = (uint8_t)(0xC0 | (cp >> 6));   p[1] = (uint8_t)(0x80 | (cp & 63));  return 2; }
+    if (cp < 0x10000) { p[0] = (uint8_t)(0xE0 | (cp >> 12));  p[1] = (uint8_t)(0x80 | ((cp >> 6) & 63));  p[2] = (uint8_t)(0x80 | (cp & 63));  return 3; }
+    p[0] = (uint8_t)(0xF0 | (cp >> 18));  p[1] = (uint8_t)(0x80 | ((cp >> 12) & 63));
+    p[2] = (uint8_t)(0x80 | ((cp >> 6) & 63));  p[3] = (uint8_t)(0x80 | (cp & 63));
+    return 4;
+}
+
+// append a random piece of a document (at most MAX_PIECE bytes)
+static size_t add_piece(uint8_t* p, int markup, bool utf8) {
+    size_t n = 0;
+    int kind = rand() % 10;
+    if ((kind == 0) && (markup != 1)) {
+        const char* s = ansi_pieces[rand() % (int)(sizeof(ansi_pieces) / sizeof(*ansi_pieces))];
+        n = strlen(s);  memcpy((void*)p, (const void*)s, n);
+    } else if ((kind == 1) && (markup != 0)) {
+        const char* s = internal_pieces[rand() % (int)(sizeof(internal_pieces) / sizeof(*internal_pieces))];
+        n = strlen(s);  memcpy((void*)p, (const void*)s, n);
+    } else if (kind == 2) {
+        // a run of a single character, like pseudographics lines
+        uint32_t cp = utf8 ? (uint32_t)(0x2500 + (rand() % 0x80)) : (uint32_t)rand_range(0xB0, 0xDF);
+        for (int len = rand_range(1, 8);  len;  --len) {
+            if (utf8) { n += put_utf8(&p[n], cp); } else { p[n++] = (uint8_t)cp; }
+        }
+    } else if (kind == 3) {
+        static const char* const controls[] = { "\r\n", "\n", "\r", "\t", "\b", "\x07", "\0" };
+        const char* s = controls[rand() % 7];
+        n = s[0] ? strlen(s) : 1;  memcpy((void*)p, (const void*)s, n);
+    } else if ((kind == 4) && utf8) {
+        // invalid or unusual UTF-8: stray continuation bytes, truncated or
+        // overlong sequences, surrogates, codepoints beyond U+10FFFF
+        static const char* const bad[] = { "\x80", "\xBF\xBF", "\xC3", "\xE2\x82", "\xC0\xAF", "\xE0\x80\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xF8\x88\x80\x80\x80", "\xFF" };
+        const char* s = bad[rand() % 10];
+        n = strlen(s);  memcpy((void*)p, (const void*)s, n);
+    } else {
+        // plain text
+        for (int len = rand_range(1, 12);  len;  --len) {
+            int r = rand() % 8;
+            if (r < 5) { p[n++] = (uint8_t)rand_range(0x20, 0x7E); }
+            else if (!utf8) { p[n++] = (uint8_t)rand_range(0x80, 0xFF); }
+            else if (r == 5) { n += put_utf8(&p[n], (uint32_t)rand_range(0x80, 0x7FF)); }
+            else if (r == 6) { n += put_utf8(&p[n], (uint32_t)rand_range(0x800, 0xD7FF)); }
+            else { n += put_utf8(&p[n], (uint32_t)rand_range(0x10000, 0x10FFFF)); }
+        }
+    }
+    return n;
+}
+
+// generate a random document with at least 'size' bytes
+static size_t make_doc(uint8_t* doc, size_t size, int markup, bool utf8) {
+    size_t len = 0;
+    while (len < size) { len += add_piece(&doc[len], markup, utf8); }
+    return len;
+}
+
+static bool same_cell(const RF_Cell* a, const RF_Cell* b) {
+    return (a->codepoint == b->codepoint) && (a->fg == b->fg) && (a->bg == b->bg)
+        && (a->bold == b->bold) && (a->dim == b->dim) && (a->underline == b->underline)
+        && (a->blink == b->blink) && (a->reverse == b->reverse) && (a->invisible == b->invisible);
+}
+
+// compare everything the parser may have changed
+static bool same_state(const RF_Context* a, const RF_Context* b) {
+    for (int y = 0;  y < a->screen_size.y;  ++y) {
+        for (int x = 0;  x < a->screen_size.x;  ++x) {
+            RF_Cell ca, cb;
+            if (!RF_ReadCell(a, x, y, &ca) || !RF_ReadCell(b, x, y, &cb) || !same_cell(&ca, &cb)) { return false; }
+        }
+    }
+    return (a->cursor_pos.x == b->cursor_pos.x) && (a->cursor_pos.y == b->cursor_pos.y)
+        && same_cell(&a->attrib, &b->attrib)
+        && (a->default_fg == b->default_fg) && (a->default_bg == b->default_bg) && (a->border_color == b->border_color);
+}
+
+static RF_Context* create_context(void) {
+    RF_Context* ctx = RF_CreateContext(RF_MAKE_ID('P','V','2','t'));
+    if (ctx && !RF_ResizeScreen(ctx, RF_SIZE_DEFAULT, RF_SIZE_DEFAULT, false)) {
+        RF_DestroyContext(ctx);
+        ctx = NULL;
+    }
+    return ctx;
+}
+
+// feed a document through RF_Feed() in random pieces
+static void feed_split(RF_Context* ctx, const uint8_t* doc, size_t len, const RF_Charset* charset, RF_MarkupType mt) {
+    for (size_t pos = 0;  pos < len;) {
+        size_t n = (size_t)rand_range(1, 7);
+        if (n > (len - pos)) { n = len - pos; }
+        RF_Feed(ctx, &doc[pos], n, charset, mt);
+        pos += n;
+    }
+}
+
+// run a detector on a whole document, or in random pieces
+static void detect(RF_Detector* det, const uint8_t* doc, size_t len, bool split, uint32_t sample_rate, size_t scan_budget) {
+    RF_InitDetector(det, sample_rate, scan_budget);
+    if (!split) {
+        RF_FeedDetector(det, doc, len);
+    } else {
+        for (size_t pos = 0;  pos < len;) {
+            size_t n = (size_t)rand_range(1, 7);
+            if (n > (len - pos)) { n = len - pos; }
+            RF_FeedDetector(det, &doc[pos], n);
+            pos += n;
+        }
+    }
+    RF_FinishDetector(det);
+}
+
+int main(void) {
+    int checks = 0, fails = 0;
+    const RF_Charset* cp437 = NULL;
+    uint8_t* doc = (uint8_t*) malloc(BIG_DOC_SIZE + MAX_PIECE);
+    for (const RF_Charset* cs = RF_Charsets;  cs->charset_id;  ++cs) {
+        if (cs->codepage == 437) { cp437 = cs;  break; }
+    }
+    if (!doc || !cp437) {
+        printf("FAIL: initialization failed\n");
+        return 1;
+    }
+    srand(1);
+
+    // RF_Feed()
+    for (int markup = 0;  markup < 3;  ++markup) {
+        for (int utf8 = 0;  utf8 < 2;  ++utf8) {
+            const RF_Charset* charset = utf8 ? NULL : cp437;
+            for (int n = 0;  n < NUM_DOCS;  ++n) {
+                size_t len = make_doc(doc, (size_t)rand_range(1, DOC_SIZE), markup, !!utf8);
+                RF_Context* whole = create_context();
+                if (!whole) { printf("FAIL: can't create context\n");  ++fails;  continue; }
+                RF_Feed(whole, doc, len, charset, markup_types[markup]);
+                for (int s = 0;  s < NUM_SPLITS;  ++s) {
+                    RF_Context* split = create_context();
+                    bool ok;
+                    if (!split) { printf("FAIL: can't create context\n");  ++fails;  break; }
+                    feed_split(split, doc, len, charset, markup_types[markup]);
+                    ok = same_state(whole, split);
+                    RF_DestroyContext(split);
+                    ++checks;
+                    if (!ok) {
+                        printf("FAIL: RF_Feed() in pieces differs for %s markup, %s, document %d, split %d\n",
+                               markup_names[markup], utf8 ? "UTF-8" : "CP437", n, s);
+                        ++fails;
+                        break;
+                    }
+                }
+                RF_DestroyContext(whole);
+            }
+        }
+    }
+
+    // RF_Detector, with and without sampling and scan budget
+    for (int markup = 0;  markup < 3;  ++markup) {
+        for (int utf8 = 0;  utf8 < 2;  ++utf8) {
+            for (int n = 0;  n < NUM_DOCS;  ++n) {
+                bool big = (n % 10) == 0;
+                uint32_t sample_rate = big ? (uint32_t)rand_range(0, 4) : 0;
+                size_t scan_budget = (n & 1) ? (size_t)rand_range(100, big ? 100000 : 10000) : 0;
+                size_t len = make_doc(doc, (size_t)rand_range(1, big ? BIG_DOC_SIZE : (4 * RF_DETECT_DECIDE_BLOCK)), markup, !!utf8);
+                RF_Detector ref, det;
+                detect(&ref, doc, len, false, sample_rate, scan_budget);
+                for (int s = 0;  s < NUM_SPLITS;  ++s) {
+                    detect(&det, doc, len, true, sample_rate, scan_budget);
+                    ++checks;
+                    if ((det.charset != ref.charset) || (det.markup != ref.markup)) {
+                        printf("FAIL: RF_Detector in pieces differs for %s markup, %s, document %d, split %d: %s/%02X vs. %s/%02X\n",
+                               markup_names[markup], utf8 ? "UTF-8" : "CP437", n, s,
+                               det.charset ? det.charset->short_name : "?", det.markup, ref.charset ? ref.charset->short_name : "?", ref.markup);
+                        ++fails;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    free((void*)doc);
+    printf("%d checks, %d fails\n", checks, fails);
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+// Check that the precompiled default screens are up to date: for every
+// system, in both screen layouts and at the default and a non-default screen
+// size, RF_LoadDefaultScreen() must produce exactly the same cells, cursor
+// position, attributes and colors as parsing the system's default_screen
+// markup with RF_AddText(ctx, ..., NULL, RF_MT_INTERNAL) at the home position.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+#define NUM_SIZES 2
+
+static const uint16_t screen_sizes[NUM_SIZES][2] = { { RF_SIZE_DEFAULT, RF_SIZE_DEFAULT }, { 97, 37 } };
+
+static bool same_cell(const RF_Cell* a, const RF_Cell* b) {
+    return (a->codepoint == b->codepoint) && (a->fg == b->fg) && (a->bg == b->bg)
+        && (a->bold == b->bold) && (a->dim == b->dim) && (a->underline == b->underline)
+        && (a->blink == b->blink) && (a->reverse == b->reverse) && (a->invisible == b->invisible);
+}
+
+// describe the first difference between the two contexts (NULL = none)
+static const char* compare(const RF_Context* a, const RF_Context* b) {
+    for (int y = 0;  y < a->screen_size.y;  ++y) {
+        for (int x = 0;  x < a->screen_size.x;  ++x) {
+            RF_Cell ca, cb;
+            if (!RF_ReadCell(a, x, y, &ca) || !RF_ReadCell(b, x, y, &cb) || !same_cell(&ca, &cb)) { return "cells"; }
+        }
+    }
+    if ((a->cursor_pos.x != b->cursor_pos.x) || (a->cursor_pos.y != b->cursor_pos.y)) { return "cursor position"; }
+    if (!same_cell(&a->attrib, &b->attrib)) { return "current attribute"; }
+    if ((a->default_fg != b->default_fg) || (a->default_bg != b->default_bg)) { return "default colors"; }
+    if (a->border_color != b->border_color) { return "border color"; }
+    return NULL;
+}
+
+// leave some state behind that loading the default screen must reset
+static void scribble(RF_Context* ctx) {
+    RF_AddText(ctx, "`fa`b3`+r`+bjunk`x10`y05more junk`F2`B4`r5", NULL, RF_MT_INTERNAL);
+    RF_Feed(ctx, "\xE2\x82", 2, NULL, RF_MT_INTERNAL);  // (incomplete UTF-8 sequence)
+}
+
+int main(void) {
+    int checks = 0, fails = 0;
+    for (const RF_System* const* p_sys = RF_SystemList;  *p_sys;  ++p_sys) {
+        for (int compact = 0;  compact < 2;  ++compact) {
+            for (int size = 0;  size < NUM_SIZES;  ++size) {
+                // 'ref' parses the markup, 'pre' runs the precompiled version
+                RF_Context* ref = RF_CreateContext((*p_sys)->sys_id);
+                RF_Context* pre = RF_CreateContext((*p_sys)->sys_id);
+                const char* diff;
+                bool ok = ref && pre
+                       && RF_ResizeScreen(ref, screen_sizes[size][0], screen_sizes[size][1], true)
+                       && RF_ResizeScreen(pre, screen_sizes[size][0], screen_sizes[size][1], true)
+                       && RF_SetCompactScreen(ref, !!compact)
+                       && RF_SetCompactScreen(pre, !!compact);
+                if (!ok) {
+                    if (!size) {
+                        printf("FAIL: can't create contexts for %s\n", (*p_sys)->name);
+                        ++fails;
+                    }
+                    RF_DestroyContext(ref);
+                    RF_DestroyContext(pre);
+                    continue;
+                }
+                scribble(ref);
+                scribble(pre);
+                RF_ClearAll(ref);
+                RF_MoveCursor(ref, 0, 0);
+                RF_ResetParser(ref);
+                if ((*p_sys)->default_screen) { RF_AddText(ref, (*p_sys)->default_screen, NULL, RF_MT_INTERNAL); }
+                ++checks;
+                if (RF_LoadDefaultScreen(pre) != ((*p_sys)->default_screen != NULL)) {
+                    printf("FAIL: RF_LoadDefaultScreen() returns the wrong result for %s\n", (*p_sys)->name);
+                    ++fails;
+                } else if ((diff = compare(ref, pre)) != NULL) {
+                    printf("FAIL: RF_LoadDefaultScreen() and RF_AddText() differ in the %s for %s, %s layout, %ux%u\n",
+                           diff, (*p_sys)->name, compact ? "compact" : "normal", ref->screen_size.x, ref->screen_size.y);
+                    ++fails;
+                }
+                RF_DestroyContext(ref);
+                RF_DestroyContext(pre);
+            }
+        }
+    }
+    printf("%d checks, %d fails\n", checks, fails);
+    return fails ? 1 : 0;
+}
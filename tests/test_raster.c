@@ -0,0 +1,67 @@
+// Check that the SIMD glyph rasterization kernels produce exactly the same
+// bitmaps as the portable reference implementation, for all systems and
+// pixel formats.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+static const char* const kernel_names[] = { "auto", "scalar", "SSE2", "AVX2" };
+static const char* const format_names[] = { "RGB888", "RGBA8888", "BGRA8888", "XRGB8888", "RGB565", "INDEXED8" };
+
+// fully re-render the screen with a specific kernel and return a copy of
+// the bitmap (or NULL if the CPU doesn't support the kernel)
+static uint8_t* render_with(RF_Context* ctx, RF_RasterKernel kernel, uint32_t time_msec) {
+    size_t size = ctx->stride * ctx->bitmap_size.y;
+    uint8_t* copy;
+    if (RF_SetRasterKernel(kernel) != kernel) { return NULL; }
+    RF_Invalidate(ctx, true);
+    RF_Render(ctx, time_msec);
+    copy = (uint8_t*) malloc(size);
+    if (copy) { memcpy((void*)copy, (const void*)ctx->bitmap, size); }
+    return copy;
+}
+
+int main(void) {
+    int checks = 0, fails = 0;
+    for (const RF_System* const* p_sys = RF_SystemList;  *p_sys;  ++p_sys) {
+        for (int format = 0;  format < _RF_PF_COUNT;  ++format) {
+            RF_Context* ctx = RF_CreateContext((*p_sys)->sys_id);
+            if (!ctx || !RF_ResizeScreenEx(ctx, RF_SIZE_DEFAULT, RF_SIZE_DEFAULT, true, (RF_PixelFormat)format, 0)) {
+                printf("FAIL: can't create a %s context for %s\n", format_names[format], (*p_sys)->name);
+                ++fails;
+                RF_DestroyContext(ctx);
+                continue;
+            }
+            RF_SetFallbackMode(ctx, RF_FB_FONT_CHAR);
+            srand(1);
+            RF_DemoScreen(ctx);
+            RF_MoveCursor(ctx, 3, 2);
+            // two blink phases, so blinking cells and the cursor are drawn both ways
+            for (uint32_t phase = 0;  phase < 2;  ++phase) {
+                uint32_t time_msec = phase * (*p_sys)->blink_interval_msec;
+                uint8_t* ref = render_with(ctx, RF_RK_SCALAR, time_msec);
+                for (int kernel = RF_RK_SSE2;  ref && (kernel <= RF_RK_AVX2);  ++kernel) {
+                    uint8_t* bmp = render_with(ctx, (RF_RasterKernel)kernel, time_msec);
+                    if (!bmp) { continue; }  // not supported by this CPU
+                    ++checks;
+                    if (memcmp((const void*)ref, (const void*)bmp, ctx->stride * ctx->bitmap_size.y)) {
+                        printf("FAIL: %s kernel differs from scalar code for %s, %s, blink phase %u\n",
+                               kernel_names[kernel], (*p_sys)->name, format_names[format], phase);
+                        ++fails;
+                    }
+                    free((void*)bmp);
+                }
+                free((void*)ref);
+            }
+            RF_DestroyContext(ctx);
+        }
+    }
+    RF_SetRasterKernel(RF_RK_AUTO);
+    printf("%d checks, %d fails\n", checks, fails);
+    return fails ? 1 : 0;
+}
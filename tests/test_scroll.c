@@ -0,0 +1,112 @@
+// Check that incremental rendering, which moves the pixels of scrolled and
+// copied regions instead of redrawing them, produces exactly the same
+// bitmaps as a full re-render, for all systems and both screen layouts.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+#define NUM_FRAMES 40
+#define MAX_OPS_PER_FRAME 24  // (more than RF_MAX_PENDING_MOVES, to check overflow handling too)
+
+// random value in the range [lo, hi]
+static int rand_range(int lo, int hi) {
+    return lo + (rand() % (hi - lo + 1));
+}
+
+static void random_cell(RF_Cell* cell) {
+    memset((void*)cell, 0, sizeof(RF_Cell));
+    cell->codepoint = (uint32_t)rand_range(0x20, 0x7E);
+    cell->fg = (rand() & 1) ? RF_COLOR_DEFAULT : (RF_COLOR_BLACK | (uint32_t)(rand() & 15));
+    cell->bg = (rand() & 1) ? RF_COLOR_DEFAULT : (RF_COLOR_BLACK | (uint32_t)(rand() & 15));
+    cell->reverse = (rand() & 7) == 0;
+    cell->blink   = (rand() & 7) == 0;
+}
+
+// apply one random screen operation; the rectangles may extend beyond the
+// screen, so clipping is exercised as well
+static void random_op(RF_Context* ctx) {
+    int w = ctx->screen_size.x, h = ctx->screen_size.y;
+    int x0 = rand_range(-2, w - 1), y0 = rand_range(-2, h - 1);
+    int x1 = rand_range(x0 + 1, w + 2), y1 = rand_range(y0 + 1, h + 2);
+    RF_Cell cell;
+    random_cell(&cell);
+    switch (rand() % 6) {
+        case 0:  // scroll a region
+            RF_ScrollRegionAB(ctx, x0, y0, x1, y1, rand_range(-3, 3), rand_range(-3, 3), (rand() & 1) ? &cell : NULL);
+            break;
+        case 1:  // scroll a whole-width region vertically (like a terminal does)
+            RF_ScrollRegionAB(ctx, 0, y0, w, y1, 0, rand_range(-2, 2), NULL);
+            break;
+        case 2:  // copy a region
+            RF_CopyRegionAB(ctx, x0, y0, x1, y1, rand_range(-2, w - 1), rand_range(-2, h - 1), (rand() & 1) ? &cell : NULL);
+            break;
+        case 3:  // write a few cells
+            for (int n = rand_range(1, 8);  n;  --n) {
+                random_cell(&cell);
+                RF_WriteCell(ctx, rand_range(0, w - 1), rand_range(0, h - 1), &cell);
+            }
+            break;
+        case 4:  // move the cursor
+            RF_MoveCursor(ctx, (uint16_t)rand_range(0, w - 1), (uint16_t)rand_range(0, h - 1));
+            break;
+        default:  // type some text, which may scroll the whole screen
+            RF_MoveCursor(ctx, (uint16_t)rand_range(0, w - 1), (uint16_t)rand_range(h - 2, h - 1));
+            for (int n = rand_range(1, 2 * w);  n;  --n) {
+                RF_AddChar(ctx, (rand() % 10) ? (uint32_t)rand_range(0x20, 0x7E) : RF_CP_ENTER);
+            }
+            break;
+    }
+}
+
+int main(void) {
+    int checks = 0, fails = 0;
+    for (const RF_System* const* p_sys = RF_SystemList;  *p_sys;  ++p_sys) {
+        for (int compact = 0;  compact < 2;  ++compact) {
+            // 'inc' is rendered incrementally, 'ref' is fully re-rendered every frame
+            RF_Context* inc = RF_CreateContext((*p_sys)->sys_id);
+            RF_Context* ref = RF_CreateContext((*p_sys)->sys_id);
+            bool ok = inc && ref
+                   && RF_ResizeScreen(inc, RF_SIZE_DEFAULT, RF_SIZE_DEFAULT, true)
+                   && RF_ResizeScreen(ref, RF_SIZE_DEFAULT, RF_SIZE_DEFAULT, true)
+                   && RF_SetCompactScreen(inc, !!compact)
+                   && RF_SetCompactScreen(ref, !!compact);
+            if (!ok) {
+                printf("FAIL: can't create contexts for %s\n", (*p_sys)->name);
+                ++fails;
+            }
+            for (int frame = 0;  ok && (frame < NUM_FRAMES);  ++frame) {
+                uint32_t time_msec = (uint32_t)(frame / 4) * (*p_sys)->blink_interval_msec;
+                RF_Context* ctx[2];
+                ctx[0] = inc;  ctx[1] = ref;
+                for (int i = 0;  i < 2;  ++i) {
+                    // both contexts get the same sequence of operations
+                    srand(1000 * (unsigned)frame + 7);
+                    if (!frame) {
+                        RF_SetFallbackMode(ctx[i], RF_FB_FONT_CHAR);
+                        RF_DemoScreen(ctx[i]);
+                    }
+                    for (int n = rand_range(1, MAX_OPS_PER_FRAME);  n;  --n) { random_op(ctx[i]); }
+                }
+                RF_Invalidate(ref, false);
+                RF_Render(inc, time_msec);
+                RF_Render(ref, time_msec);
+                ++checks;
+                if (memcmp((const void*)inc->bitmap, (const void*)ref->bitmap, inc->stride * inc->bitmap_size.y)) {
+                    printf("FAIL: incremental rendering differs from full rendering for %s, %s layout, frame %d\n",
+                           (*p_sys)->name, compact ? "compact" : "normal", frame);
+                    ++fails;
+                    break;
+                }
+            }
+            RF_DestroyContext(inc);
+            RF_DestroyContext(ref);
+        }
+    }
+    printf("%d checks, %d fails\n", checks, fails);
+    return fails ? 1 : 0;
+}
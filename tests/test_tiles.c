@@ -0,0 +1,86 @@
+// Check that rendering through the tile cache produces exactly the same
+// bitmaps as rendering without it, for all systems (including those with
+// their own render_cell() method), with single-threaded and band rendering.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+#define NUM_VARIANTS 4
+#define NUM_STEPS 12
+
+static const char* const variant_names[NUM_VARIANTS] = { "reference", "tile cache", "small tile cache", "tile cache + bands" };
+
+// run the bands one after another in the calling thread
+static void serial_for(void* user, RF_JobFunc func, void* job, int count) {
+    (void)user;
+    for (int i = 0;  i < count;  ++i) { func(job, i); }
+}
+
+// change a few random cells, with random attributes
+static void scribble(RF_Context* ctx) {
+    for (int n = 20;  n;  --n) {
+        RF_Cell cell;
+        memset((void*)&cell, 0, sizeof(cell));
+        cell.codepoint = (rand() & 1) ? (uint32_t)(0x20 + (rand() % 95)) : (uint32_t)(0x2500 + (rand() % 0xA0));
+        cell.fg = (rand() & 1) ? RF_COLOR_DEFAULT : (RF_COLOR_BLACK | (uint32_t)(rand() & 15));
+        cell.bg = (rand() & 1) ? RF_COLOR_DEFAULT : (RF_COLOR_BLACK | (uint32_t)(rand() & 15));
+        cell.bold      = (rand() & 7) == 0;
+        cell.underline = (rand() & 7) == 0;
+        cell.blink     = (rand() & 3) == 0;
+        cell.reverse   = (rand() & 7) == 0;
+        RF_WriteCell(ctx, rand() % ctx->screen_size.x, rand() % ctx->screen_size.y, &cell);
+    }
+}
+
+int main(void) {
+    int checks = 0, fails = 0;
+    uint32_t hits = 0;
+    for (const RF_System* const* p_sys = RF_SystemList;  *p_sys;  ++p_sys) {
+        RF_Context* ctx[NUM_VARIANTS];
+        bool ok = true;
+        for (int v = 0;  v < NUM_VARIANTS;  ++v) {
+            ctx[v] = RF_CreateContext((*p_sys)->sys_id);
+            if (!ctx[v] || !RF_ResizeScreen(ctx[v], RF_SIZE_DEFAULT, RF_SIZE_DEFAULT, true)) { ok = false;  continue; }
+            RF_SetFallbackMode(ctx[v], RF_FB_FONT_CHAR);
+            if (v) { RF_SetTileCacheSize(ctx[v], (v == 2) ? 64 : 4096); }  // (the small one evicts a lot)
+            if (v == 3) { RF_SetParallelFor(ctx[v], serial_for, NULL, 7); }
+            srand(1);
+            RF_DemoScreen(ctx[v]);
+        }
+        if (!ok) {
+            printf("FAIL: can't create contexts for %s\n", (*p_sys)->name);
+            ++fails;
+        }
+        for (int step = 0;  ok && (step < NUM_STEPS);  ++step) {
+            // alternate between full and partial redraws, at changing blink phases
+            uint32_t time_msec = (uint32_t)step * (*p_sys)->blink_interval_msec;
+            for (int v = 0;  v < NUM_VARIANTS;  ++v) {
+                srand(100 + step);
+                if (step & 1) { scribble(ctx[v]); } else { RF_Invalidate(ctx[v], false); }
+                RF_MoveCursor(ctx[v], (uint16_t)(step / 4), (uint16_t)(step / 4));
+                ctx[v]->insert = (step & 2) != 0;
+                RF_Render(ctx[v], time_msec);
+            }
+            for (int v = 1;  v < NUM_VARIANTS;  ++v) {
+                ++checks;
+                if (memcmp((const void*)ctx[0]->bitmap, (const void*)ctx[v]->bitmap, ctx[0]->stride * ctx[0]->bitmap_size.y)) {
+                    printf("FAIL: %s differs from reference for %s, step %d\n", variant_names[v], (*p_sys)->name, step);
+                    ++fails;
+                }
+            }
+        }
+        if (ok) { hits += ctx[1]->tile_hits + ctx[2]->tile_hits + ctx[3]->tile_hits; }
+        for (int v = 0;  v < NUM_VARIANTS;  ++v) { RF_DestroyContext(ctx[v]); }
+    }
+    if (!hits) {
+        printf("FAIL: the tile cache has never been used\n");
+        ++fails;
+    }
+    printf("%d checks, %d fails, %u tile hits\n", checks, fails, hits);
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+// Check the UTF-8 validation used by the text ingest fast path: the SIMD
+// version of RF_UTF8ValidPrefix() must return the same valid prefix length
+// as the scalar version and as a byte-wise reference decoder with the rules
+// of the regular decoder, for random data and for hand-picked valid and
+// invalid sequences (U+FFFD itself, overlong forms, surrogates, codepoints
+// beyond U+10FFFF, 0xF8+ lead bytes, truncated sequences) at every position
+// around the 16-byte block boundaries. In addition, RF_Feed() (which uses the
+// fast path) must put the same characters on the screen as the reference
+// decoder does.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "retrofont.h"
+
+extern size_t RF_UTF8ValidPrefix(const uint8_t* data, size_t len);
+extern size_t RF_UTF8ValidPrefixScalar(const uint8_t* data, size_t len);
+
+#define MAX_LEN 128         // maximum length of a test buffer
+#define NUM_RANDOM 3000     // number of random buffers
+#define MAX_SEQ_POS 48      // hand-picked sequences are put at positions 0...MAX_SEQ_POS-1
+
+static const char* const sequences[] = {
+    "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\x7F",                           // valid
+    "\xEF\xBF\xBD",                                                                   // U+FFFD itself
+    "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xF0\x80\x80\x80",       // overlong (accepted)
+    "\xED\xA0\x80", "\xED\xBF\xBF",                                                   // surrogates (accepted)
+    "\xF4\x90\x80\x80", "\xF7\xBF\xBF\xBF",                                           // beyond U+10FFFF (accepted)
+    "\xF8", "\xF8\x88\x80\x80", "\xF8\x88\x80\x80\x80", "\xFC\x84\x80\x80\x80\x80",            // invalid lead bytes
+    "\xFE", "\xFF\xBF\xBF\xBF", "\xFF",
+    "\xC3", "\xE2\x82", "\xF0\x9F\x98",                                               // truncated
+    "\x80", "\xBF\xBF",                                                               // stray continuation bytes
+    "\xC3\x28", "\xE2\x28\xA1", "\xE2\x82\x28", "\xF0\x9F\x28\x80", "\xF0\x9F\x98\xC3\xA9",  // bad continuation bytes
+};
+#define NUM_SEQUENCES ((int)(sizeof(sequences) / sizeof(*sequences)))
+
+// byte-wise reference decoder with the same rules as the regular decoder in
+// rfcore.c: stores the decoded characters (U+FFFD for errors) and returns
+// their number; *valid gets the length of the longest prefix that decodes
+// without errors and doesn't end within a sequence
+static size_t ref_decode(const uint8_t* data, size_t len, uint32_t* out, size_t* valid) {
+    size_t count = 0;
+    uint32_t cp = 0;
+    int pending = 0;
+    bool error = false;
+    *valid = 0;
+    for (size_t i = 0;  i < len;  ++i) {
+        uint8_t c = data[i];
+        if (pending) {
+            if ((c & 0xC0) == 0x80) {
+                cp = (cp << 6) | (c & 0x3F);
+                if (!--pending) { out[count++] = cp; }
+                if (!error && !pending) { *valid = i + 1; }
+                continue;
+            }
+            out[count++] = 0xFFFD;
+            error = true;
+            pending = 0;
+        }
+        if      (c < 0x80) { out[count++] = c; }
+        else if (c < 0xC0) { out[count++] = 0xFFFD;  error = true; }
+        else if (c < 0xE0) { pending = 1;  cp = c & 0x1F; }
+        else if (c < 0xF0) { pending = 2;  cp = c & 0x0F; }
+        else if (c < 0xF8) { pending = 3;  cp = c & 0x07; }
+        else               { out[count++] = 0xFFFD;  error = true; }
+        if (!error && !pending) { *valid = i + 1; }
+    }
+    return count;
+}
+
+static RF_Context* create_context(void) {
+    RF_Context* ctx = RF_CreateContext(RF_MAKE_ID('P','V','2','t'));
+    if (ctx && !RF_ResizeScreen(ctx, RF_SIZE_DEFAULT, RF_SIZE_DEFAULT, false)) {
+        RF_DestroyContext(ctx);
+        ctx = NULL;
+    }
+    return ctx;
+}
+
+// compare both validators with the reference for all prefixes of the buffer
+// (and a few start offsets, so that the blocks are aligned differently)
+static int check_validators(const uint8_t* data, size_t len) {
+    uint32_t decoded[MAX_LEN];
+    for (size_t start = 0;  (start < 4) && (start <= len);  ++start) {
+        for (size_t n = 0;  n <= (len - start);  ++n) {
+            size_t ref, simd = RF_UTF8ValidPrefix(&data[start], n), scalar = RF_UTF8ValidPrefixScalar(&data[start], n);
+            ref_decode(&data[start], n, decoded, &ref);
+            if ((simd != ref) || (scalar != ref)) {
+                printf("FAIL: valid prefix of %u bytes at offset %u: SIMD %u, scalar %u, reference %u:",
+                       (unsigned)n, (unsigned)start, (unsigned)simd, (unsigned)scalar, (unsigned)ref);
+                for (size_t i = 0;  i < n;  ++i) { printf(" %02X", data[start + i]); }
+                printf("\n");
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// compare what RF_Feed() puts on the screen with the reference decoder's
+// output, put on the screen character by character
+static int check_decoder(RF_Context* feed, RF_Context* ref, const uint8_t* data, size_t len) {
+    uint32_t decoded[MAX_LEN];
+    size_t valid, count = ref_decode(data, len, decoded, &valid);
+    RF_ClearAll(feed);  RF_ResetParser(feed);  RF_MoveCursor(feed, 0, 0);
+    RF_ClearAll(ref);   RF_ResetParser(ref);   RF_MoveCursor(ref, 0, 0);
+    // (internal markup, but without backticks in the data; this way, no
+    // byte is taken as the start of a markup sequence)
+    RF_Feed(feed, data, len, NULL, RF_MT_INTERNAL);
+    for (size_t i = 0;  i < count;  ++i) { RF_AddChar(ref, decoded[i]); }
+    for (int y = 0;  y < feed->screen_size.y;  ++y) {
+        for (int x = 0;  x < feed->screen_size.x;  ++x) {
+            RF_Cell a, b;
+            RF_ReadCell(feed, x, y, &a);
+            RF_ReadCell(ref, x, y, &b);
+            if (a.codepoint != b.codepoint) {
+                printf("FAIL: RF_Feed() shows U+%04X instead of U+%04X at %d,%d:", a.codepoint, b.codepoint, x, y);
+                for (size_t i = 0;  i < len;  ++i) { printf(" %02X", data[i]); }
+                printf("\n");
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// append a random valid sequence (or, rarely, a random byte or a hand-picked sequence)
+static size_t add_random(uint8_t* p) {
+    int r = rand() % 20;
+    uint32_t cp;
+    if (r == 0) {
+        p[0] = (uint8_t)(rand() & 0xFF);
+        return 1;
+    } else if (r == 1) {
+        const char* s = sequences[rand() % NUM_SEQUENCES];
+        memcpy((void*)p, (const void*)s, strlen(s));
+        return strlen(s);
+    }
+    cp = (r < 10) ? (uint32_t)(0x20 + (rand() % 0x5F))
+       : (r < 14) ? (uint32_t)(0x80 + (rand() % 0x780))
+       : (r < 18) ? (uint32_t)(0x800 + (rand() % 0xF800))
+       :            (uint32_t)(0x10000 + (rand() % 0x100000));
+    if (cp < 0x80)    { p[0] = (uint8_t)cp;  return 1; }
+    if (cp < 0x800)   { p[0] = (uint8_t)(0xC0 | (cp >> 6));   p[1] = (uint8_t)(0x80 | (cp & 63));  return 2; }
+    if (cp < 0x10000) { p[0] = (uint8_t)(0xE0 | (cp >> 12));  p[1] = (uint8_t)(0x80 | ((cp >> 6) & 63));  p[2] = (uint8_t)(0x80 | (cp & 63));  return 3; }
+    p[0] = (uint8_t)(0xF0 | (cp >> 18));  p[1] = (uint8_t)(0x80 | ((cp >> 12) & 63));
+    p[2] = (uint8_t)(0x80 | ((cp >> 6) & 63));  p[3] = (uint8_t)(0x80 | (cp & 63));
+    return 4;
+}
+
+static void remove_backticks(uint8_t* data, size_t len) {
+    for (size_t i = 0;  i < len;  ++i) {
+        if (data[i] == '`') { data[i] = '\''; }
+    }
+}
+
+int main(void) {
+    int checks = 0, fails = 0;
+    uint8_t data[MAX_LEN + 8];
+    RF_Context* feed = create_context();
+    RF_Context* ref = create_context();
+    if (!feed || !ref) {
+        printf("FAIL: can't create contexts\n");
+        return 1;
+    }
+    srand(1);
+
+    // hand-picked sequences at every position around the first block
+    // boundaries, surrounded by ASCII or multi-byte characters
+    for (int s = 0;  s < NUM_SEQUENCES;  ++s) {
+        size_t seq_len = strlen(sequences[s]);
+        for (int pad = 0;  pad < 2;  ++pad) {
+            for (size_t pos = 0;  pos < MAX_SEQ_POS;  ++pos) {
+                size_t len = 0;
+                while (len < pos) {
+                    if (pad && ((pos - len) >= 2)) { data[len++] = 0xC3;  data[len++] = 0xA4; }
+                    else { data[len++] = 'x'; }
+                }
+                memcpy((void*)&data[len], (const void*)sequences[s], seq_len);
+                len += seq_len;
+                while (len < (MAX_SEQ_POS + 16)) {
+                    if (pad) { data[len++] = 0xE2;  data[len++] = 0x94;  data[len++] = 0x80; }
+                    else { data[len++] = 'y'; }
+                }
+                ++checks;
+                if (check_validators(data, len) || check_decoder(feed, ref, data, len)) { ++fails; }
+            }
+        }
+    }
+
+    // random data
+    for (int n = 0;  n < NUM_RANDOM;  ++n) {
+        size_t len = 0, max_len = (size_t)(rand() % MAX_LEN);
+        while (len < max_len) { len += add_random(&data[len]); }
+        if (len > MAX_LEN) { len = MAX_LEN; }
+        remove_backticks(data, len);
+        ++checks;
+        if (check_validators(data, len) || check_decoder(feed, ref, data, len)) { ++fails; }
+    }
+
+    RF_DestroyContext(feed);
+    RF_DestroyContext(ref);
+    printf("%d checks, %d fails\n", checks, fails);
+    return fails ? 1 : 0;
+}
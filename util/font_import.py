@@ -8,6 +8,12 @@ import os
 
 FORCE_VERBOSE = False
 
+# must match the definitions in retrofont.h
+GLYPH_PAGE_BITS = 6
+GLYPH_BLOCK_BITS = 6
+GLYPH_MISSING = 0xFFFFFFFF
+GLYPH_FROM_FALLBACK = 0x80000000
+
 class coord:
     def __init__(self, x, y): self.x, self.y = x, y
     def __str__(self):        return f"{self.x},{self.y}"
@@ -299,6 +305,39 @@ if __name__ == "__main__":
             if not(cp in fb):
                 fb[cp] = (f.font_id, offset)
 
+    # build three-level lookup tables for all fonts and fallback glyph sets:
+    # a per-font block map indexes blocks of page numbers, which in turn
+    # index pages of bitmap offsets; blocks and pages are shared between all
+    # tables, and block 0 / page 0 are always the empty ones
+    pagesize = 1 << GLYPH_PAGE_BITS
+    blocksize = 1 << GLYPH_BLOCK_BITS
+    pages = [(GLYPH_MISSING,) * pagesize]
+    page_ids = { pages[0]: 0 }
+    blocks = [(0,) * blocksize]
+    block_ids = { blocks[0]: 0 }
+    def intern(items, ids, item):
+        try:
+            return ids[item]
+        except KeyError:
+            ids[item] = len(items)
+            items.append(item)
+            return ids[item]
+    def make_block_map(glyphs):
+        if not glyphs: return []
+        page_map = [intern(pages, page_ids, tuple(glyphs.get(cp, GLYPH_MISSING) for cp in range(base, base + pagesize)))
+                    for base in range(0, max(glyphs) + 1, pagesize)]
+        page_map += [0] * (-len(page_map) % blocksize)
+        return [intern(blocks, block_ids, tuple(page_map[i:i+blocksize])) for i in range(0, len(page_map), blocksize)]
+    # the fonts' tables already have font fallback applied: codepoints that
+    # are missing from the font, but are present in another font of the
+    # same size, map to that glyph, marked with GLYPH_FROM_FALLBACK
+    for f in fonts:
+        merged = { cp: (offset | GLYPH_FROM_FALLBACK) for cp, (source, offset) in fallback[f.font_size.to_tuple()].items() }
+        merged.update(f.glyphs)
+        f.block_map = make_block_map(merged)
+    fallback_block_maps = { fs: make_block_map({ cp: offset for cp, (source, offset) in fb.items() }) for fs, fb in fallback.items() }
+    if verbose: print("- lookup tables:", len(blocks), "distinct blocks,", len(pages), "distinct pages")
+
     # generate fonts.c
     namelen = max(len(f.name) for f in fonts) + 3
     dumplen = max(b-a for a,b in segments) * 6
@@ -322,6 +361,27 @@ if __name__ == "__main__":
                 out.write(f'    {{ {cp_s:>8},{f.glyphs[cp]:6d} }},  // {charname(cp)}\n')
             out.write('};\n\n')
 
+        out.write(f'const uint32_t RF_GlyphPages[] = {{\n')
+        for i, page in enumerate(pages):
+            out.write(f'    // page {i}\n')
+            for a in range(0, pagesize, 8):
+                out.write('    ' + ' '.join(f"0x{v:08X}," for v in page[a:a+8]) + '\n')
+        out.write('};\n\n')
+
+        out.write(f'const uint16_t RF_GlyphBlocks[] = {{\n')
+        for i, block in enumerate(blocks):
+            out.write(f'    // block {i}\n')
+            for a in range(0, blocksize, 16):
+                out.write('    ' + ' '.join(f"{v:4d}," for v in block[a:a+16]) + '\n')
+        out.write('};\n\n')
+
+        for name, block_map in [(f"blockmap_{f.font_id}", f.block_map) for f in fonts] \
+                             + [(f"fbblockmap_{fs[0]}x{fs[1]}", fallback_block_maps[fs]) for fs in sorted(fallback)]:
+            out.write(f'const uint16_t {name}[] = {{\n')
+            for a in range(0, len(block_map), 16):
+                out.write('    ' + ' '.join(f"{v:4d}," for v in block_map[a:a+16]) + '\n')
+            out.write('};\n\n')
+
         for fs in sorted(fallback):
             out.write(f'const RF_GlyphMapEntry fallback_{fs[0]}x{fs[1]}[] = {{\n')
             fb = fallback[fs]
@@ -335,17 +395,17 @@ if __name__ == "__main__":
         for f in fonts:
             name = f'"{f.name}",'.ljust(namelen)
             id_s = ','.join("'"+c+"'" for c in f.font_id)
-            out.write(f'    {{ RF_MAKE_ID({id_s}), {name} {{{f.font_size.x:2d},{f.font_size.y:2d}}}, glyphmap_{f.font_id}, {len(f.glyphs):4d},{f.glyphs.get(0xFFFD,0):6d}, {f.underline:2d} }},\n')
+            out.write(f'    {{ RF_MAKE_ID({id_s}), {name} {{{f.font_size.x:2d},{f.font_size.y:2d}}}, glyphmap_{f.font_id}, {len(f.glyphs):4d},{f.glyphs.get(0xFFFD,0):6d}, {f.underline:2d}, blockmap_{f.font_id}, {len(f.block_map):2d} }},\n')
         name = "NULL,".ljust(namelen)
-        out.write(f'    {{ 0,                           {name} {{ 0, 0}}, NULL,             0,     0,  0 }}\n')
+        out.write(f'    {{ 0,                           {name} {{ 0, 0}}, NULL,             0,     0,  0, NULL,          0 }}\n')
         out.write('};\n\n')
 
         out.write('const RF_FallbackGlyphs RF_FallbackGlyphsList[] = {\n')
         for fs in sorted(fallback):
             x,y = fs
             name = f"{x}x{y},"
-            out.write(f'    {{ {{ {x:2d}, {y:2d} }}, fallback_{name:<6s} {len(fallback[fs]):4d} }},\n')
-        out.write('    { {  0,  0 }, NULL,              0 }\n')
+            out.write(f'    {{ {{ {x:2d}, {y:2d} }}, fallback_{name:<6s} {len(fallback[fs]):4d}, fbblockmap_{name:<6s} {len(fallback_block_maps[fs]):2d} }},\n')
+        out.write('    { {  0,  0 }, NULL,              0, NULL,              0 }\n')
         out.write('};\n')
 
     sys.exit(g_errors)
@@ -3,26 +3,146 @@ import sys
 import re
 import os
 
+# internal markup commands: letter -> (is_color, digits, base)
+# (must match RF_InternalMarkupCommands in rfparse_int.c)
+MarkupCommands = {
+    'x': (False, 2, 10), 'X': (False, 2, 10), 'c': (False, 2, 10),
+    'y': (False, 2, 10), 'Y': (False, 2, 10), 'C': (False, 2, 10),
+    'f': (True,  1, 16), 'b': (True,  1, 16), 'F': (True,  1, 16),
+    'B': (True,  1, 16), 'r': (True,  1, 16),
+    '-': (False, 1,  0), '+': (False, 1,  0),
+    '0': (False, 0,  0), 'z': (False, 0,  0), 'Z': (False, 0,  0),
+    'u': (False, 4, 16), 'U': (False, 6, 16),
+}
+COLOR_DEFAULT = 0xFFFFFFFF
+COLOR_BLACK = 0x1000000
+
+def parse_c_string(s):
+    "decode the contents of one C string literal (without the quotes) into bytes"
+    res = bytearray()
+    pos = 0
+    while pos < len(s):
+        if s[pos] != '\\':
+            res += s[pos].encode('utf-8')
+            pos += 1
+            continue
+        c = s[pos + 1]
+        pos += 2
+        if c == 'x':
+            m = re.match(r'[0-9a-fA-F]+', s[pos:])
+            res.append(int(m.group(0), 16) & 0xFF)
+            pos += len(m.group(0))
+        elif c in "01234567":
+            m = re.match(r'[0-7]{1,3}', s[pos-1:])
+            res.append(int(m.group(0), 8) & 0xFF)
+            pos += len(m.group(0)) - 1
+        else:
+            res += { 'n': b'\n', 't': b'\t', 'r': b'\r', 'a': b'\a', 'b': b'\b', 'f': b'\f', 'v': b'\v' }.get(c, c.encode('utf-8'))
+    return bytes(res)
+
+def compile_screen(data):
+    """
+    translate a default screen in internal markup format into a list of
+    precompiled operations (see RF_LoadDefaultScreen() in rfcore.c):
+    plain codepoints, or RF_SCREEN_CMD(letter) followed by the final value
+    of the command's argument; returns None if the screen can't be compiled
+    """
+    try:
+        text = data.decode('utf-8')
+    except UnicodeDecodeError:
+        return None
+    ops = []
+    pos = 0
+    while pos < len(text):
+        c = text[pos]
+        pos += 1
+        if c != '`':
+            ops.append(ord(c))
+            continue
+        if pos >= len(text): return None
+        letter = text[pos]
+        pos += 1
+        if letter == '`':
+            ops.append(ord(letter))
+            continue
+        if not(letter in MarkupCommands): return None
+        is_color, digits, base = MarkupCommands[letter]
+        if is_color and text[pos:pos+1] == '-':
+            value = COLOR_DEFAULT
+            pos += 1
+        else:
+            if is_color and text[pos:pos+1] == '#':
+                digits = 6
+                pos += 1
+            arg = text[pos:pos+digits]
+            if len(arg) < digits: return None
+            pos += digits
+            if base:
+                if not(re.fullmatch(r'[0-9A-Za-z]*', arg)): return None
+                try:
+                    value = int(arg, base) if arg else 0
+                except ValueError:
+                    return None
+                if is_color and (digits == 1):
+                    value |= COLOR_BLACK
+            else:
+                value = 0
+                for d in arg:
+                    value = (value << 8) | ord(d)
+        if letter in "uU":
+            if value:  # (NUL is ignored by RF_AddChar anyway)
+                ops.append(value)
+        else:
+            if not(base) and (32 <= value < 127) and not(chr(value) in "'\\"): arg = f"'{chr(value)}'"
+            elif base == 10: arg = str(value)
+            else:            arg = f"0x{value:X}"
+            ops += [f"RF_SCREEN_CMD('{letter}')", arg]
+    return ops
+
 if __name__ == "__main__":
     # determine used system files from CMakeLists
     os.chdir(os.path.join(os.path.dirname(sys.argv[0]), ".."))
     with open("CMakeLists.txt") as f:
         sysfiles = re.findall(r'sys_\w+\.c', f.read())
 
-    # enumerate systems from these files
+    # enumerate systems and default screens from these files
     os.chdir(os.path.join("retrofont", "src"))
     systems = []
+    screens = {}
     for fn in sysfiles:
         with open(fn) as f:
-            systems += re.findall(r'^const\s+RF_System\s+(RF_Sys_\w+)\s*=', f.read(), flags=re.M)
+            code = f.read()
+        for name, body in re.findall(r'^static\s+const\s+char\s+(\w+)\s*\[\s*\]\s*=\s*((?:\s*"(?:[^"\\\n]|\\.)*")+)\s*;', code, flags=re.M):
+            data = b''.join(parse_c_string(s) for s in re.findall(r'"((?:[^"\\\n]|\\.)*)"', body))
+            ops = compile_screen(data)
+            if ops is None:
+                print(f"WARNING: default screen {name} in {fn} contains invalid markup, not precompiling it", file=sys.stderr)
+            screens[(fn, name)] = ops
+        for sysname, screen in re.findall(r'^const\s+RF_System\s+(RF_Sys_\w+)\s*=\s*\{\s*(?:RF_MAKE_ID\([^)]*\)|[^,]+),\s*"(?:[^"\\]|\\.)*"\s*,[^,]+,\s*(\w+)\s*,', code, flags=re.M):
+            systems.append((sysname, screens.get((fn, screen)) and f"screen_{os.path.splitext(fn)[0]}_{screen}"))
 
     # generate systems.c
     with open("systems.c", "w") as out:
         out.write(f'// This file has been auto-generated by {os.path.basename(sys.argv[0])}. DO NOT EDIT BY HAND!\n\n')
         out.write('#include "retrofont.h"\n\n')
-        for sys in systems:
-            out.write(f'extern const RF_System {sys};\n')
+        for sysname, screen in systems:
+            out.write(f'extern const RF_System {sysname};\n')
         out.write('\nconst RF_System* const RF_SystemList[] = {\n')
-        for sys in systems:
-            out.write(f'    &{sys},\n')
+        for sysname, screen in systems:
+            out.write(f'    &{sysname},\n')
+        out.write('    NULL\n};\n')
+
+        # precompiled default screens
+        used = set(screen for sysname, screen in systems if screen)
+        for (fn, name), ops in screens.items():
+            ident = f"screen_{os.path.splitext(fn)[0]}_{name}"
+            if not(ident in used): continue
+            out.write(f'\nstatic const uint32_t {ident}[] = {{\n')
+            ops = [op if isinstance(op, str) else f"'{chr(op)}'" if (32 <= op < 127) and not(chr(op) in "'\\") else f"0x{op:X}" for op in ops] + ["0"]
+            for i in range(0, len(ops), 12):
+                out.write('    ' + ', '.join(ops[i:i+12]) + ',\n')
+            out.write('};\n')
+        out.write('\nconst uint32_t* const RF_DefaultScreenOps[] = {\n')
+        for sysname, screen in systems:
+            out.write(f'    {screen or "NULL"},\n')
         out.write('    NULL\n};\n')